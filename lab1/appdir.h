@@ -0,0 +1,37 @@
+#ifndef WEENSYOS_APPDIR_H
+#define WEENSYOS_APPDIR_H
+
+/*****************************************************************************
+ * appdir.h
+ *
+ *   Layout of the application directory that build/mkbootdisk.c writes to
+ *   the boot disk after the kernel, and that k-loader.c reads at boot.
+ *
+ *   The directory starts on a sector boundary.  Its sector number is
+ *   stored, little endian, at byte APPDIR_SECTOR_OFFSET of the boot sector
+ *   (just before the 0x55 0xAA signature).  The directory is an
+ *   'appdir_header' followed by 'ad_napps' 'appdir_entry' structures.
+ *   Each application is stored as a contiguous run of sectors, either as an
+ *   ELF binary or as an LZ4 image of one (see lz4.h).
+ *
+ *   Include types.h (in the kernel) or <stdint.h> (on the host) first.
+ *
+ *****************************************************************************/
+
+#define APPDIR_MAGIC		0x52494441U	/* "ADIR" in little endian */
+#define APPDIR_SECTOR_OFFSET	506
+#define APPDIR_NAMELEN		24
+
+struct appdir_header {
+	uint32_t ad_magic;		// must equal APPDIR_MAGIC
+	uint32_t ad_napps;		// number of entries that follow
+};
+
+struct appdir_entry {
+	char ade_name[APPDIR_NAMELEN];	// null-terminated name
+	uint32_t ade_sector;		// first sector on disk
+	uint32_t ade_length;		// length in bytes
+	uint32_t ade_entry;		// ELF entry point
+};
+
+#endif /* !WEENSYOS_APPDIR_H */
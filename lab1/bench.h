@@ -0,0 +1,57 @@
+#ifndef WEENSYOS_BENCH_H
+#define WEENSYOS_BENCH_H
+#include "process.h"
+#include "x86.h"
+
+/*****************************************************************************
+ * bench.h
+ *
+ *   Timing helpers for benchmark applications.  Times are measured with the
+ *   processor's cycle counter, and converted using the kernel's measurement
+ *   of its speed ('tsc_khz', see const.h).  There is no 64-bit division in
+ *   a freestanding 32-bit build, so conversions shift 64-bit cycle counts
+ *   down to 32 bits first, keeping about six significant digits.
+ *
+ *****************************************************************************/
+
+static inline uint64_t
+bench_now(void)
+{
+	return read_cycle_counter();
+}
+
+// Convert 'cycles' to microseconds.
+static uint32_t
+cycles_to_us(uint64_t cycles)
+{
+	int shift = 0;
+	// keep 'cycles * 1000' within 32 bits
+	while ((cycles >> shift) > 0xFFFFFFFFU / 1000)
+		shift++;
+	return ((uint32_t) (cycles >> shift) * 1000 / tsc_khz) << shift;
+}
+
+// Return how many times per second 'n' events happen if they take
+// 'cycles' cycles altogether.
+static uint32_t
+per_second(uint32_t n, uint64_t cycles)
+{
+	uint32_t us = cycles_to_us(cycles), scale = 1000000;
+	while (scale > 1 && n > 0xFFFFFFFFU / scale) {
+		scale /= 10;
+		us /= 10;
+	}
+	return us ? n * scale / us : 0;
+}
+
+// Return 'cycles' divided by 'n'.
+static uint32_t
+cycles_per(uint64_t cycles, uint32_t n)
+{
+	int shift = 0;
+	while ((cycles >> shift) > 0xFFFFFFFFU)
+		shift++;
+	return ((uint32_t) (cycles >> shift) / n) << shift;
+}
+
+#endif
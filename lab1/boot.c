@@ -20,8 +20,9 @@
  *  * This program (bootstart.S and boot.c) is the bootloader.
  *    It should be stored in the disk's sector 0 (the first sector).
  *
- *  * Sectors 1 through 32 hold the image for the kernel
- *    (kernel.c, x86.c, k-int.S).
+ *  * The image for the kernel (kernel.c, x86.c, k-int.S) starts at
+ *    sector 1.  It may be any size: it is read with one disk command per
+ *    256 sectors (128 KB), not one per sector.
  *
  *  * The kernel image must be in ELF executable format.
  *
@@ -39,7 +40,9 @@
  *    and a stack so C code then run, then calls bootmain().
  *
  *  * bootmain() in this file takes over, reads in the kernel image,
- *    and jumps to it.
+ *    and jumps to it.  The first page of the image, which holds the ELF
+ *    headers, is read only once: any segment data it contains is copied
+ *    from memory instead of being read from the disk again.
  *
  **********************************************************************/
 
@@ -47,8 +50,8 @@
 #define PAGESIZE	4096
 #define ELFHDR		((struct Elf *) 0x10000) // scratch space
 
-void readsect(void *addr, uint32_t sect);
-void readseg(uint32_t va, uint32_t filesz, uint32_t memsz, uint32_t sect);
+void readsects(void *addr, uint32_t sect, uint32_t nsect);
+void readseg(uint32_t va, uint32_t filesz, uint32_t memsz, uint32_t offset);
 
 void
 bootmain(void)
@@ -57,7 +60,7 @@ bootmain(void)
 	uint32_t *stackptr;
 
 	// read 1st page off disk
-	readseg((uint32_t) ELFHDR, PAGESIZE, PAGESIZE, 1);
+	readsects(ELFHDR, 1, PAGESIZE / SECTORSIZE);
 
 	// is this a valid ELF?
 	if (ELFHDR->e_magic != ELF_MAGIC)
@@ -67,7 +70,7 @@ bootmain(void)
 	ph = (struct Proghdr*) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
 	eph = ph + ELFHDR->e_phnum;
 	for (; ph < eph; ph++)
-		readseg(ph->p_va, ph->p_filesz, ph->p_memsz, 1 + ph->p_offset / SECTORSIZE);
+		readseg(ph->p_va, ph->p_filesz, ph->p_memsz, ph->p_offset);
 
 	// jump to the kernel, clearing %eax
 	__asm __volatile("movl %0, %%esp; ret" : : "r" (&ELFHDR->e_entry), "a" (0));
@@ -75,8 +78,9 @@ bootmain(void)
 
 // Read 'filesz' bytes at 'offset' from kernel into virtual address 'va',
 // then clear the memory from 'va+filesz' up to 'va+memsz' (set it to 0).
+// Bytes that lie in the first page of the kernel are copied from ELFHDR.
 void
-readseg(uint32_t va, uint32_t filesz, uint32_t memsz, uint32_t sect)
+readseg(uint32_t va, uint32_t filesz, uint32_t memsz, uint32_t offset)
 {
 	uint32_t end_va;
 
@@ -84,14 +88,17 @@ readseg(uint32_t va, uint32_t filesz, uint32_t memsz, uint32_t sect)
 	memsz += va;
 
 	// round down to sector boundary
-	va &= ~(SECTORSIZE - 1);
+	va -= offset % SECTORSIZE;
+	offset -= offset % SECTORSIZE;
 
-	// read sectors
-	while (va < end_va) {
-		readsect((uint8_t*) va, sect);
-		va += SECTORSIZE;
-		sect++;
-	}
+	// copy the part that is already in memory
+	for (; offset < PAGESIZE && va < end_va; va++, offset++)
+		*((uint8_t*) va) = ((uint8_t*) ELFHDR)[offset];
+
+	// read the rest
+	if (va < end_va)
+		readsects((uint8_t*) va, 1 + offset / SECTORSIZE,
+			  (end_va - va + SECTORSIZE - 1) / SECTORSIZE);
 
 	// clear bss segment
 	while (end_va < memsz)
@@ -106,22 +113,34 @@ waitdisk(void)
 		/* do nothing */;
 }
 
+// Read 'nsect' sectors starting at 'sect' into 'dst'.  Each READ SECTORS
+// command transfers up to 256 sectors; the disk signals when each sector's
+// data is ready.
 void
-readsect(void *dst, uint32_t sect)
+readsects(void *dst, uint32_t sect, uint32_t nsect)
 {
-	// wait for disk to be ready
-	waitdisk();
-
-	outb(0x1F2, 1);		// count = 1
-	outb(0x1F3, sect);
-	outb(0x1F4, sect >> 8);
-	outb(0x1F5, sect >> 16);
-	outb(0x1F6, (sect >> 24) | 0xE0);
-	outb(0x1F7, 0x20);	// cmd 0x20 - read sectors
-
-	// wait for disk to be ready
-	waitdisk();
-
-	// read a sector
-	insl(0x1F0, dst, SECTORSIZE/4);
+	while (nsect > 0) {
+		uint32_t n = (nsect > 256 ? 256 : nsect);
+
+		// wait for disk to be ready
+		waitdisk();
+
+		outb(0x1F2, n);		// count = n (0 means 256)
+		outb(0x1F3, sect);
+		outb(0x1F4, sect >> 8);
+		outb(0x1F5, sect >> 16);
+		outb(0x1F6, (sect >> 24) | 0xE0);
+		outb(0x1F7, 0x20);	// cmd 0x20 - read sectors
+
+		sect += n;
+		nsect -= n;
+		for (; n > 0; n--) {
+			// wait for the next sector's data
+			waitdisk();
+
+			// read a sector
+			insl(0x1F0, dst, SECTORSIZE/4);
+			dst = (uint8_t *) dst + SECTORSIZE;
+		}
+	}
 }
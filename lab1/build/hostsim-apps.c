@@ -0,0 +1,412 @@
+#include "const.h"
+#include "build/hostsim.h"
+
+/*****************************************************************************
+ * hostsim-apps.c
+ *
+ *   The host simulator's applications.  Each stands in for a program's
+ *   code with a step function, which runs a process from where it is,
+ *   'p->eip', to its next system call.  A process keeps all its state in
+ *   its registers, so sys_fork() copies it, and a child tells itself
+ *   from its parent by sys_fork()'s return value in %eax, as in a real
+ *   program.  What processes share lives in the program's globals.
+ *
+ *   'sim_cfg->nprocs' and 'sim_cfg->iters' size each program; 0 means
+ *   the program's default.
+ *
+ *****************************************************************************/
+
+const struct sim_config *sim_cfg;
+
+// Labels every program uses; each program numbers its own from L_FIRST.
+enum {
+	L_START = 0,			// the entry point
+	L_WAITED,			// in wait_all()
+	L_EXITED,			// after sys_exit(), which never returns
+	L_FIRST
+};
+
+// Make system call 'intno', which returns to 'label'.
+#define SYSCALL(label, intno) \
+	do { p->eip = SIM_LABEL(label); return (intno); } while (0)
+// Carry on at 'label' without a system call.  Step functions are a
+// switch on 'pc' in an endless loop, which 'continue' restarts (so this
+// cannot be wrapped in 'do ... while (0)').
+#define JUMP(label) \
+	{ pc = SIM_LABEL(label); continue; }
+
+static int
+param(int value, int dflt, int max)
+{
+	if (value <= 0)
+		value = dflt;
+	return value < max ? value : max;
+}
+
+// Wait for every other process in turn, retrying each until it has
+// exited, then exit.  %edx is the process waited for.
+static int
+wait_all(struct sim_proc *p, int first)
+{
+	if (first)
+		p->edx = 2;
+	else if ((int) p->eax != WAIT_TRYAGAIN)
+		p->edx++;
+	if (p->edx == (unsigned long) p->pid)
+		p->edx++;
+	if (p->edx < SIM_NPROCS) {
+		p->eax = p->edx;
+		SYSCALL(L_WAITED, INT_SYS_WAIT);
+	}
+	p->eax = 0;
+	SYSCALL(L_EXITED, INT_SYS_EXIT);
+}
+
+
+// fanout: p-procos-app2.  Start 'nprocs' children (1024), as many at a
+// time as there are free process slots, reaping once after each batch,
+// as many as have exited.  Each child counts itself in a shared counter,
+// calls sys_getpid() and exits.
+enum {
+	FO_BATCH = L_FIRST, FO_FORK, FO_FORKED, FO_REAP, FO_CHILD, FO_REAPED
+};
+
+#define FO_CHILD_STACK		4096
+
+static int
+fanout_step(struct sim_proc *p)
+{
+	volatile int *counter = (volatile int *) p->globals;
+	int total = param(sim_cfg->nprocs, 1024, 1 << 30);
+	unsigned long pc = p->eip;
+
+	// %esi: children started this batch; %edx: process to reap
+	while (1)
+		switch (pc) {
+		case SIM_LABEL(L_START):
+			*counter = 0;
+			JUMP(FO_BATCH);
+		case SIM_LABEL(FO_BATCH):
+			if (*counter >= total)
+				return wait_all(p, 1);
+			p->esi = 0;
+			JUMP(FO_FORK);
+		case SIM_LABEL(FO_FORK):
+			if (*counter + (int) p->esi < total) {
+				p->eax = FO_CHILD_STACK;
+				SYSCALL(FO_FORKED, INT_SYS_FORK);
+			}
+			JUMP(FO_REAP);
+		case SIM_LABEL(FO_FORKED):
+			if (p->eax == 0) {
+				p->ebx = (*counter)++;
+				SYSCALL(FO_CHILD, INT_SYS_GETPID);
+			}
+			if ((int) p->eax > 0) {
+				p->esi++;
+				JUMP(FO_FORK);
+			}
+			JUMP(FO_REAP);
+		case SIM_LABEL(FO_REAP):
+			if (p->esi == 0)
+				return wait_all(p, 1);
+			p->edx = 2;
+			p->eax = p->edx;
+			SYSCALL(FO_REAPED, INT_SYS_WAIT);
+		case SIM_LABEL(FO_CHILD):
+			p->eax = p->ebx;
+			SYSCALL(L_EXITED, INT_SYS_EXIT);
+		case SIM_LABEL(FO_REAPED):
+			if (++p->edx < SIM_NPROCS) {
+				p->eax = p->edx;
+				SYSCALL(FO_REAPED, INT_SYS_WAIT);
+			}
+			JUMP(FO_BATCH);
+		default:
+			return wait_all(p, 0);
+		}
+}
+
+
+// yield and sleep: 'nprocs' processes (16 for yield, 8 for sleep) each
+// work and then call sys_yield(), or sys_sleep() for 1 to 4 ms, 'iters'
+// times (10000 for yield, 200 for sleep), then exit.  The first process
+// then waits for the others.
+enum {
+	W_FORK = L_FIRST, W_FORKED, W_LOOP
+};
+
+static int
+worker_step(struct sim_proc *p, int sleep)
+{
+	int n = param(sim_cfg->nprocs, sleep ? 8 : 16, SIM_NPROCS - 1);
+	int iters = param(sim_cfg->iters, sleep ? 200 : 10000, 1 << 30);
+	unsigned long pc = p->eip;
+
+	// %esi: processes started; %edi: iterations done; %ebp: 1 in the
+	// first process
+	while (1)
+		switch (pc) {
+		case SIM_LABEL(L_START):
+			p->esi = 1;
+			p->ebp = 1;
+			JUMP(W_FORK);
+		case SIM_LABEL(W_FORK):
+			if ((int) p->esi < n) {
+				p->eax = 0;
+				SYSCALL(W_FORKED, INT_SYS_FORK);
+			}
+			p->edi = 0;
+			JUMP(W_LOOP);
+		case SIM_LABEL(W_FORKED):
+			if (p->eax == 0) {
+				p->ebp = 0;
+				p->edi = 0;
+				JUMP(W_LOOP);
+			}
+			p->esi = (int) p->eax > 0 ? p->esi + 1 : n;
+			JUMP(W_FORK);
+		case SIM_LABEL(W_LOOP):
+			if ((int) p->edi < iters) {
+				p->edi++;
+				if (!sleep)
+					SYSCALL(W_LOOP, INT_SYS_YIELD);
+				p->eax = 1 + (p->pid + p->edi) % 4;
+				SYSCALL(W_LOOP, INT_SYS_SLEEP);
+			}
+			if (p->ebp)
+				return wait_all(p, 1);
+			p->eax = 0;
+			SYSCALL(L_EXITED, INT_SYS_EXIT);
+		default:
+			return wait_all(p, 0);
+		}
+}
+
+static int
+yield_step(struct sim_proc *p)
+{
+	return worker_step(p, 0);
+}
+
+static int
+sleep_step(struct sim_proc *p)
+{
+	return worker_step(p, 1);
+}
+
+
+// pipe: 'nprocs' producer-consumer pairs (1), each with its own pipe.  The
+// producer writes 'iters' 64-byte messages (100000) and closes the pipe;
+// the consumer reads until it is empty and closed.  The first process
+// sets them up, then waits for them.
+enum {
+	P_PAIR = L_FIRST, P_PIPED, P_FORKED1, P_FORKED2, P_CLOSED1, P_CLOSED2,
+	P_PRODUCE, P_CONSUME, P_READ, P_DONE
+};
+
+#define P_MSGSIZE		64
+#define P_BUF			0x1000	// message buffer, in the globals
+
+static int
+pipe_step(struct sim_proc *p)
+{
+	int npairs = param(sim_cfg->nprocs, 1, (SIM_NPROCS - 1) / 2);
+	int iters = param(sim_cfg->iters, 100000, 1 << 30);
+	unsigned long pc = p->eip;
+	int *fds;
+
+	// %esi: pair number, whose fds are at 'fds'; %edi: messages written
+	while (1) {
+		fds = (int *) p->globals + 2 * p->esi;
+		switch (pc) {
+		case SIM_LABEL(L_START):
+			p->esi = 0;
+			JUMP(P_PAIR);
+		case SIM_LABEL(P_PAIR):
+			if ((int) p->esi == npairs)
+				return wait_all(p, 1);
+			p->eax = (unsigned long) fds;
+			SYSCALL(P_PIPED, INT_SYS_PIPE);
+		case SIM_LABEL(P_PIPED):
+			if ((int) p->eax < 0)
+				return wait_all(p, 1);
+			p->eax = 0;
+			SYSCALL(P_FORKED1, INT_SYS_FORK);
+		case SIM_LABEL(P_FORKED1):
+			if (p->eax == 0) {
+				p->edi = 0;
+				p->eax = fds[0];
+				SYSCALL(P_PRODUCE, INT_SYS_CLOSE);
+			}
+			p->eax = 0;
+			SYSCALL(P_FORKED2, INT_SYS_FORK);
+		case SIM_LABEL(P_FORKED2):
+			if (p->eax == 0) {
+				p->eax = fds[1];
+				SYSCALL(P_CONSUME, INT_SYS_CLOSE);
+			}
+			p->eax = fds[0];
+			SYSCALL(P_CLOSED1, INT_SYS_CLOSE);
+		case SIM_LABEL(P_CLOSED1):
+			p->eax = fds[1];
+			SYSCALL(P_CLOSED2, INT_SYS_CLOSE);
+		case SIM_LABEL(P_CLOSED2):
+			p->esi++;
+			JUMP(P_PAIR);
+		case SIM_LABEL(P_PRODUCE):
+			if ((int) p->edi == iters) {
+				p->eax = fds[1];
+				SYSCALL(P_DONE, INT_SYS_CLOSE);
+			}
+			p->edi++;
+			p->eax = fds[1];
+			p->ebx = (unsigned long) p->globals + P_BUF;
+			p->ecx = P_MSGSIZE;
+			SYSCALL(P_PRODUCE, INT_SYS_WRITE);
+		case SIM_LABEL(P_READ):
+			if ((int) p->eax <= 0)
+				JUMP(P_DONE);
+			/* fall through */
+		case SIM_LABEL(P_CONSUME):
+			p->eax = fds[0];
+			p->ebx = (unsigned long) p->globals + P_BUF;
+			p->ecx = P_MSGSIZE;
+			SYSCALL(P_READ, INT_SYS_READ);
+		case SIM_LABEL(P_DONE):
+			p->eax = 0;
+			SYSCALL(L_EXITED, INT_SYS_EXIT);
+		default:
+			return wait_all(p, 0);
+		}
+	}
+}
+
+
+// handoff and handoff-yield: the first process passes a token to a
+// partner, which passes it straight back, 'iters' times (10000), with
+// 'nprocs' processes runnable in all (2); the rest just yield until the
+// round trips are done.  handoff passes the token with sys_yield_to() to
+// the other process, handoff-yield with sys_yield().
+enum {
+	H_FORK = L_FIRST, H_FORKED, H_PING, H_PONG, H_SPIN
+};
+
+static int
+handoff_step(struct sim_proc *p, int directed)
+{
+	// the token (odd: the partner's turn), 1 when done, and the first
+	// process's and the partner's pids
+	volatile int *g = (volatile int *) p->globals;
+	int n = param(sim_cfg->nprocs, 2, SIM_NPROCS - 1);
+	int iters = param(sim_cfg->iters, 10000, 1 << 30);
+	unsigned long pc = p->eip;
+
+	// %esi: processes started; %edi: round trips done
+	while (1)
+		switch (pc) {
+		case SIM_LABEL(L_START):
+			g[0] = g[1] = 0;
+			g[2] = p->pid;
+			p->esi = 1;
+			JUMP(H_FORK);
+		case SIM_LABEL(H_FORK):
+			if ((int) p->esi < n) {
+				p->eax = 0;
+				SYSCALL(H_FORKED, INT_SYS_FORK);
+			}
+			p->edi = 0;
+			g[0] = 1;
+			JUMP(H_PING);
+		case SIM_LABEL(H_FORKED):
+			if (p->eax == 0 && p->esi == 1)
+				JUMP(H_PONG);
+			if (p->eax == 0)
+				JUMP(H_SPIN);
+			if ((int) p->eax < 0) {
+				p->esi = n;
+				JUMP(H_FORK);
+			}
+			if (p->esi++ == 1)
+				g[3] = p->eax;
+			JUMP(H_FORK);
+		case SIM_LABEL(H_PING):
+			if (!(g[0] & 1)) {
+				if ((int) ++p->edi >= iters) {
+					g[1] = 1;
+					return wait_all(p, 1);
+				}
+				g[0]++;
+			}
+			p->eax = g[3];
+			if (directed)
+				SYSCALL(H_PING, INT_SYS_YIELD_TO);
+			SYSCALL(H_PING, INT_SYS_YIELD);
+		case SIM_LABEL(H_PONG):
+			if (g[1]) {
+				p->eax = 0;
+				SYSCALL(L_EXITED, INT_SYS_EXIT);
+			}
+			if (g[0] & 1)
+				g[0]++;
+			p->eax = g[2];
+			if (directed)
+				SYSCALL(H_PONG, INT_SYS_YIELD_TO);
+			SYSCALL(H_PONG, INT_SYS_YIELD);
+		case SIM_LABEL(H_SPIN):
+			if (g[1]) {
+				p->eax = 0;
+				SYSCALL(L_EXITED, INT_SYS_EXIT);
+			}
+			SYSCALL(H_SPIN, INT_SYS_YIELD);
+		default:
+			return wait_all(p, 0);
+		}
+}
+
+static int
+handoff_directed_step(struct sim_proc *p)
+{
+	return handoff_step(p, 1);
+}
+
+static int
+handoff_yield_step(struct sim_proc *p)
+{
+	return handoff_step(p, 0);
+}
+
+
+static const struct program {
+	const char *name;
+	int (*step)(struct sim_proc *p);
+} programs[] = {
+	{ "fanout", fanout_step },
+	{ "yield", yield_step },
+	{ "pipe", pipe_step },
+	{ "sleep", sleep_step },
+	{ "handoff", handoff_directed_step },
+	{ "handoff-yield", handoff_yield_step }
+};
+
+#define NPROGRAMS	((int) (sizeof(programs) / sizeof(programs[0])))
+
+int
+sim_nprograms(void)
+{
+	return NPROGRAMS;
+}
+
+const char *
+sim_program_name(int program)
+{
+	return program >= 0 && program < NPROGRAMS
+		? programs[program].name : 0;
+}
+
+int
+sim_step(struct sim_proc *p, unsigned long *work_ns)
+{
+	*work_ns = sim_cfg->work_ns;
+	return programs[p->program].step(p);
+}
@@ -0,0 +1,553 @@
+/*****************************************************************************
+ * hostsim-x86.c
+ *
+ *   The host simulator's kernel: kernel.c itself, compiled for the host
+ *   with -DWEENSYOS_HOSTSIM, together with a mock of the hardware
+ *   interface that x86.c, k-disk.c, k-smp.c and k-loader.c provide on a
+ *   real machine.  k-alloc.c, k-pipe.c, k-timer.c, k-bcache.c and k-fs.c
+ *   are compiled unchanged.
+ *   (kernel.c is included, rather than linked, so the simulator can
+ *   watch its process table.)
+ *
+ *   Simulated CPUs take turns, each with its own clock: the loop in
+ *   sim_run() always advances the CPU whose clock is furthest behind.  A
+ *   running CPU advances by executing its process up to its next system
+ *   call, in hostsim-apps.c, and entering the kernel through interrupt(),
+ *   just as the hardware would.  The kernel leaves through run(), which
+ *   jumps back to the loop instead of to the process, or idle(), which
+ *   parks the CPU until the timer (CPU 0 only) or another CPU's wakeup
+ *   interrupt restarts it in schedule().  The kernel lock is never
+ *   contended, since each kernel entry finishes before the next begins.
+ *
+ *   Time is virtual: each step charges the process's user time, and
+ *   each kernel entry and process switch a fixed cost (see struct
+ *   sim_config).  Timer interrupts arrive TIMER_HZ times a virtual
+ *   second, between steps.
+ *
+ *   Memory is a host mapping at the kernel's own addresses (see
+ *   sim_arena()), so page frames, process stacks and application
+ *   globals are where the kernel expects them.  There are no page
+ *   tables: page_map() just records stack mappings so page_lookup() can
+ *   return them, and no access ever faults.
+ *
+ *****************************************************************************/
+
+#include "kernel.c"
+#include "build/hostsim.h"
+
+typedef char sim_nprocs_matches[NPROCS == SIM_NPROCS ? 1 : -1];
+
+#define TICK_NS			(1000000000 / TIMER_HZ)
+
+// The code segment of a process's registers: interrupt() looks at its low
+// bits to tell an interrupted process from the interrupted kernel.
+#define SIM_USER_CS		(0x18 | 3)
+
+// Applications' globals are the first SIM_GLOBALS bytes of their slot;
+// their heaps start after that.
+#define SIM_GLOBALS		0x10000
+
+uint16_t *cursorpos;
+uint32_t hostsim_esp, hostsim_cr2;
+
+cpu_t cpus[NCPU];
+int ncpus = 1;
+
+static const struct sim_config *cfg;
+static struct sim_stats *st;
+
+typedef enum simstate {
+	SC_RUN,				// running c_current
+	SC_SCHEDULE,			// about to call schedule()
+	SC_IDLE				// halted in idle()
+} simstate_t;
+
+static struct simcpu {
+	uint64_t sc_now;		// this CPU's clock
+	simstate_t sc_state;
+	process_t *sc_last;		// process it last ran
+	uint64_t sc_idle_since;
+} simcpus[NCPU];
+
+static int simcpu;			// CPU the kernel is running on
+static uint64_t next_tick;
+static int sim_halted;
+
+// When each runnable process that is not running became runnable.
+static int ready[NPROCS];
+static uint64_t ready_since[NPROCS];
+
+// Each process's last system call, to retry if the kernel asks.
+static int last_intno[NPROCS];
+
+static uintptr_t program_brk[MAXPROGRAMS];
+
+// __builtin_setjmp() buffers: run() and idle() leave the kernel through
+// 'exit_jb', and halt() and shutdown() end the simulation through
+// 'done_jb'.
+static void *exit_jb[5];
+static void *done_jb[5];
+
+
+static void
+sim_cpu(int i)
+{
+	simcpu = i;
+	hostsim_esp = KERNEL_STACK_TOP - 1 - i * KERNEL_STACK_SLOT;
+}
+
+// Note the runnable processes that have just started waiting for a CPU.
+// Called whenever the kernel finishes with an event.
+static void
+sim_scan(uint64_t now)
+{
+	pid_t pid;
+	int i;
+
+	for (pid = 1; pid < NPROCS; pid++) {
+		process_t *p = proc_array[pid];
+		if (!p || p->p_state != P_RUNNABLE) {
+			ready[pid] = 0;
+			continue;
+		}
+		if (ready[pid])
+			continue;
+		for (i = 0; i < ncpus && cpus[i].c_current != p; i++)
+			/* find a CPU running it */;
+		if (i == ncpus) {
+			ready[pid] = 1;
+			ready_since[pid] = now;
+		}
+	}
+}
+
+static void
+sim_wait_done(pid_t pid, uint64_t wait)
+{
+	int bucket = 0;
+
+	st->waits[pid]++;
+	st->wait_ns[pid] += wait;
+	if (wait > st->max_wait_ns)
+		st->max_wait_ns = wait;
+	while (wait > 0 && bucket < SIM_HISTBITS - 1) {
+		wait >>= 1;
+		bucket++;
+	}
+	st->wait_hist[bucket]++;
+}
+
+// Run the kernel on CPU 'i' until it leaves through run() or idle():
+// 'fn' if it is not NULL, and otherwise interrupt(reg).
+static void
+sim_enter(int i, void (*fn)(void), registers_t *reg)
+{
+	sim_cpu(i);
+	st->entries++;
+	if (__builtin_setjmp(exit_jb) == 0) {
+		if (fn)
+			fn();
+		else
+			interrupt(reg);
+	}
+}
+
+// Wake idle CPU 'i' at time 'now'.
+static void
+sim_wake(int i, uint64_t now)
+{
+	struct simcpu *sc = &simcpus[i];
+
+	if (now < sc->sc_idle_since)
+		now = sc->sc_idle_since;
+	st->idle_ns += now - sc->sc_idle_since;
+	sc->sc_now = now;
+	sc->sc_state = SC_SCHEDULE;
+}
+
+// The timer interrupts idle CPU 0.
+static void
+sim_tick_idle(void)
+{
+	registers_t reg;
+
+	sim_wake(0, next_tick);
+	next_tick += TICK_NS;
+	st->ticks++;
+	st->entries++;
+	memset(&reg, 0, sizeof(reg));
+	reg.reg_intno = INT_IRQ0 + IRQ_TIMER;	// reg_cs 0: in the kernel
+	sim_cpu(0);
+	interrupt(&reg);
+	sim_scan(simcpus[0].sc_now);
+}
+
+// Advance running CPU 'i': its process runs to its next system call, or
+// the timer interrupts it.
+static void
+sim_step_cpu(int i)
+{
+	struct simcpu *sc = &simcpus[i];
+	process_t *proc = cpus[i].c_current;
+	registers_t reg = proc->p_registers;
+	pid_t pid = proc->p_pid;
+
+	if (i == 0 && sc->sc_now >= next_tick) {
+		reg.reg_intno = INT_IRQ0 + IRQ_TIMER;
+		next_tick += TICK_NS;
+		st->ticks++;
+	} else if (reg.reg_eip % 4 == 0) {
+		// The kernel moved the process back to retry its last call.
+		reg.reg_intno = last_intno[pid];
+		reg.reg_eip += 2;
+		st->syscalls++;
+	} else {
+		struct sim_proc p;
+		unsigned long work;
+
+		p.pid = pid;
+		p.program = proc->p_program;
+		p.globals = (char *) (APP_REGION_START
+				      + proc->p_program * APP_SLOT_SIZE);
+		p.eax = reg.reg_eax;
+		p.ebx = reg.reg_ebx;
+		p.ecx = reg.reg_ecx;
+		p.edx = reg.reg_edx;
+		p.esi = reg.reg_esi;
+		p.edi = reg.reg_edi;
+		p.ebp = reg.reg_ebp;
+		p.esp = reg.reg_esp;
+		p.eip = reg.reg_eip;
+		reg.reg_intno = last_intno[pid] = sim_step(&p, &work);
+		reg.reg_eax = p.eax;
+		reg.reg_ebx = p.ebx;
+		reg.reg_ecx = p.ecx;
+		reg.reg_edx = p.edx;
+		reg.reg_esi = p.esi;
+		reg.reg_edi = p.edi;
+		reg.reg_ebp = p.ebp;
+		reg.reg_esp = p.esp;
+		reg.reg_eip = p.eip;
+		sc->sc_now += work;
+		st->cpu_ns[pid] += work;
+		st->syscalls++;
+	}
+	sc->sc_now += cfg->syscall_ns;
+	sim_enter(i, NULL, &reg);
+}
+
+void
+sim_arena(unsigned long *start, unsigned long *end)
+{
+	*start = PAGEFRAMES_START;
+	*end = MEMSIZE_VIRTUAL;
+}
+
+int
+sim_run(const struct sim_config *config, struct sim_stats *stats)
+{
+	int i, next;
+
+	cfg = config;
+	st = stats;
+	memset(st, 0, sizeof(*st));
+	next_tick = TICK_NS;
+
+	if (__builtin_setjmp(done_jb) == 0) {
+		sim_enter(0, start, NULL);
+		while (1) {
+			next = -1;
+			for (i = 0; i < ncpus; i++)
+				if (simcpus[i].sc_state != SC_IDLE
+				    && (next < 0 || simcpus[i].sc_now
+					< simcpus[next].sc_now))
+					next = i;
+			if (simcpus[0].sc_state == SC_IDLE
+			    && (next < 0 || next_tick <= simcpus[next].sc_now)) {
+				if (next_tick > cfg->max_ns)
+					break;
+				sim_tick_idle();
+			} else if (simcpus[next].sc_now > cfg->max_ns)
+				break;
+			else if (simcpus[next].sc_state == SC_SCHEDULE) {
+				cpus[next].c_idle = 0;
+				sim_enter(next, schedule, NULL);
+			} else
+				sim_step_cpu(next);
+		}
+	}
+
+	// CPUs still idle at the end were idle until then.
+	for (i = 0; i < ncpus; i++)
+		if (simcpus[i].sc_now > st->end_ns)
+			st->end_ns = simcpus[i].sc_now;
+	for (i = 0; i < ncpus; i++)
+		if (simcpus[i].sc_state == SC_IDLE)
+			st->idle_ns += st->end_ns - simcpus[i].sc_idle_since;
+	return sim_halted ? -1 : 0;
+}
+
+
+
+/*****************************************************************************
+ * The mock hardware interface: x86.c
+ *
+ *****************************************************************************/
+
+// The kernel leaves by running a process: back to the loop in sim_run().
+void
+run(process_t *proc)
+{
+	cpu_t *c = this_cpu();
+	struct simcpu *sc = &simcpus[c->c_id];
+
+	current = proc;
+	if (c->c_locked)
+		kernel_unlock();
+	// A CPU whose clock is behind can find a process that another CPU
+	// made runnable later; it cannot run it before then.
+	if (ready[proc->p_pid] && sc->sc_now < ready_since[proc->p_pid])
+		sc->sc_now = ready_since[proc->p_pid];
+	if (proc != sc->sc_last) {
+		st->switches++;
+		sc->sc_now += cfg->switch_ns;
+		sc->sc_last = proc;
+		if (!ready[proc->p_pid])
+			sim_wait_done(proc->p_pid, 0);
+	}
+	if (ready[proc->p_pid]) {
+		sim_wait_done(proc->p_pid,
+			      sc->sc_now - ready_since[proc->p_pid]);
+		ready[proc->p_pid] = 0;
+	}
+	sc->sc_state = SC_RUN;
+	sim_scan(sc->sc_now);
+	__builtin_longjmp(exit_jb, 1);
+}
+
+void
+idle(void)
+{
+	struct simcpu *sc = &simcpus[simcpu];
+
+	sc->sc_state = SC_IDLE;
+	sc->sc_idle_since = sc->sc_now;
+	sim_scan(sc->sc_now);
+	__builtin_longjmp(exit_jb, 1);
+}
+
+void
+halt(void)
+{
+	sim_halted = 1;
+	__builtin_longjmp(done_jb, 1);
+}
+
+// Called only by stall(), when no process can ever run again: normally
+// because they have all exited.
+void
+shutdown(void)
+{
+	pid_t pid;
+
+	for (pid = 1; pid < NPROCS; pid++)
+		if (proc_array[pid] && proc_array[pid]->p_state != P_ZOMBIE)
+			st->stalled = 1;
+	__builtin_longjmp(done_jb, 1);
+}
+
+void
+lapic_ipi(int apicid, int vector)
+{
+	st->ipis++;
+	if (simcpus[apicid].sc_state == SC_IDLE)
+		sim_wake(apicid, simcpus[simcpu].sc_now + cfg->ipi_ns);
+}
+
+void
+special_registers_init(process_t *proc)
+{
+	memset(&proc->p_registers, 0, sizeof(registers_t));
+	proc->p_registers.reg_eflags = EFLAGS_IF;
+	proc->p_registers.reg_cs = SIM_USER_CS;
+}
+
+// Only process stacks are ever mapped.
+#define SIM_STACK_PAGES	((MEMSIZE_VIRTUAL - STACK_REGION_START) / PAGESIZE)
+static physaddr_t stack_ptes[SIM_STACK_PAGES];
+
+void
+page_map(uintptr_t va, physaddr_t pa, int perm)
+{
+	if (va >= STACK_REGION_START && va < MEMSIZE_VIRTUAL)
+		stack_ptes[(va - STACK_REGION_START) / PAGESIZE] =
+			perm & PTE_P ? pa | (perm & 0xFFF) : 0;
+}
+
+physaddr_t
+page_lookup(uintptr_t va)
+{
+	if (va < STACK_REGION_START || va >= MEMSIZE_VIRTUAL)
+		return 0;
+	return ROUNDDOWN(stack_ptes[(va - STACK_REGION_START) / PAGESIZE],
+			 PAGESIZE);
+}
+
+int
+page_perm(uintptr_t va)
+{
+	// simulated programs' memory is all loaded and writable
+	if (va >= APP_REGION_START && va < APP_REGION_END)
+		return PTE_P | PTE_W | PTE_U;
+	if (va < STACK_REGION_START || va >= MEMSIZE_VIRTUAL)
+		return 0;
+	return stack_ptes[(va - STACK_REGION_START) / PAGESIZE] & 0xFFF;
+}
+
+int
+console_read_key(void)
+{
+	return menu_key(cfg->program);
+}
+
+void segments_init(int cpu) { }
+void paging_init(void) { }
+void interrupt_controller_init(void) { }
+void irq_eoi(int irq) { }
+void lapic_eoi(void) { }
+void tsc_calibrate(void) { }
+void timer_init(int hz) { }
+void console_clear(void) { }
+void profile_sample(registers_t *reg) { }
+void profile_dump(void) { }
+
+
+
+/*****************************************************************************
+ * The mock hardware interface: k-disk.c
+ *
+ *   There is no disk: every read fails at once, so there is no filesystem
+ *   either.
+ *
+ *****************************************************************************/
+
+void disk_init(void) { }
+void disk_intr(void) { }
+void disk_plug(void) { }
+void disk_unplug(void) { }
+
+int
+disk_read(void *dst, uint32_t sect, uint32_t nsect)
+{
+	return -1;
+}
+
+void
+disk_submit(diskreq_t *req)
+{
+	req->dr_status = -1;
+}
+
+void
+disk_stats(kstats_t *ks)
+{
+	ks->ks_disk_sectors = ks->ks_disk_reads = ks->ks_disk_commands = 0;
+}
+
+
+
+/*****************************************************************************
+ * The mock hardware interface: k-smp.c
+ *
+ *****************************************************************************/
+
+static spinlock_t kernel_spinlock = SPINLOCK_INIT;
+
+void
+kernel_lock(void)
+{
+	spin_lock(&kernel_spinlock);
+	this_cpu()->c_locked = 1;
+}
+
+void
+kernel_unlock(void)
+{
+	this_cpu()->c_locked = 0;
+	spin_unlock(&kernel_spinlock);
+}
+
+// The other CPUs start out in schedule(), as they would after ap_start().
+void
+smp_init(void)
+{
+	int i;
+
+	ncpus = MIN(MAX(cfg->ncpus, 1), NCPU);
+	for (i = 1; i < ncpus; i++) {
+		cpus[i].c_id = cpus[i].c_apicid = i;
+		cpus[i].c_started = 1;
+		simcpus[i].sc_state = SC_SCHEDULE;
+	}
+}
+
+
+
+/*****************************************************************************
+ * The mock hardware interface: k-loader.c
+ *
+ *   Programs are the simulated applications in hostsim-apps.c.  They
+ *   start at SIM_LABEL(0), and their code never faults.
+ *
+ *****************************************************************************/
+
+int
+programs_init(void)
+{
+	return MIN(sim_nprograms(), MAXPROGRAMS);
+}
+
+const char *
+program_name(int programnumber)
+{
+	return sim_program_name(programnumber);
+}
+
+int
+program_loader(int programnumber, uint32_t *entry_point)
+{
+	if (programnumber < 0 || programnumber >= programs_init())
+		return -1;
+	*entry_point = SIM_LABEL(0);
+	return 0;
+}
+
+void
+program_reset(int programnumber)
+{
+	memset((void *) (APP_REGION_START + programnumber * APP_SLOT_SIZE),
+	       0, SIM_GLOBALS);
+	program_brk[programnumber] = 0;
+}
+
+int
+program_fault(uintptr_t va, uint32_t err)
+{
+	// simulated programs' pages are all loaded already
+	return va >= APP_REGION_START && va < APP_REGION_END;
+}
+
+uintptr_t
+program_sbrk(int programnumber, intptr_t increment)
+{
+	uintptr_t slot = APP_REGION_START + programnumber * APP_SLOT_SIZE;
+	uintptr_t old = program_brk[programnumber];
+
+	if (!old)
+		old = slot + SIM_GLOBALS;
+	if (old + increment < slot + SIM_GLOBALS
+	    || old + increment > slot + APP_SLOT_SIZE)
+		return (uintptr_t) -1;
+	program_brk[programnumber] = old + increment;
+	return old;
+}
@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "build/hostsim.h"
+
+/* This program runs the kernel on the host, as an ordinary process, with
+ * simulated CPUs and applications in place of the hardware and real
+ * programs (see hostsim-x86.c and hostsim-apps.c).  It is for scheduling
+ * and process-lifecycle experiments that would take minutes under QEMU:
+ * the simulated kernel makes millions of entries a second, and reports
+ * how long runnable processes waited for a CPU and how fairly CPU time was
+ * shared.
+ *
+ * 'make hostsim' builds it as obj/hostsim.  Usage:
+ *
+ *	obj/hostsim [-c CPUS] [-n PROCS] [-i ITERS] [-w WORKNS] [-k SYSCALLNS]
+ *		    [-x SWITCHNS] [-p IPINS] [-t MAXMS] [-v] PROGRAM
+ *
+ * PROGRAM is a name or number: fanout (p-procos-app2's fork test), yield,
+ * pipe, sleep, or handoff or handoff-yield (p-bench-switch's handoff
+ * test, with sys_yield_to() or sys_yield()).  -n and -i size it; -n
+ * counts producer-consumer pairs for pipe and children for fanout, and
+ * -i round trips for handoff.  The times are virtual nanoseconds:
+ * user time between system calls, kernel time per entry, the extra cost
+ * of a process switch, and wakeup-interrupt latency.  -t stops the
+ * simulation after MAXMS virtual milliseconds.  -v prints the console and
+ * per-process statistics.
+ *
+ * Each run simulates one boot: the kernel's state is not reset between
+ * runs, so there is one run per host process.
+ */
+
+static struct sim_config config = {
+	.ncpus = 1,
+	.work_ns = 1000,
+	.syscall_ns = 300,
+	.switch_ns = 500,
+	.ipi_ns = 2000,
+	.max_ns = 10000000000ULL
+};
+
+static struct sim_stats stats;
+
+
+
+void
+usage(void)
+{
+	int i;
+
+	fprintf(stderr, "Usage: hostsim [-c CPUS] [-n PROCS] [-i ITERS] [-w WORKNS] [-k SYSCALLNS]\n"
+		"               [-x SWITCHNS] [-p IPINS] [-t MAXMS] [-v] PROGRAM\n"
+		"Programs:");
+	for (i = 0; i < sim_nprograms(); i++)
+		fprintf(stderr, " %d %s%s", i, sim_program_name(i),
+			i + 1 < sim_nprograms() ? "," : "\n");
+	exit(1);
+}
+
+// The kernel's console.  Only errors, in color, are printed unless -v was
+// given.  Takes the kernel's escapes, including %C to change the color.
+uint16_t *
+console_printf(uint16_t *cursor, int color, const char *format, ...)
+{
+	char spec[32];
+	va_list val;
+	int n;
+
+	if (!config.verbose && color == 0x0700)
+		return cursor;
+	va_start(val, format);
+	for (; *format; format++) {
+		if (*format != '%') {
+			fputc(*format, stderr);
+			continue;
+		}
+		n = strspn(format + 1, "-+ #0123456789.");
+		if (n + 3 > (int) sizeof(spec) || !format[n + 1])
+			break;
+		memcpy(spec, format, n + 2);
+		spec[n + 2] = 0;
+		format += n + 1;
+		switch (*format) {
+		case 'd':
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'c':
+			fprintf(stderr, spec, va_arg(val, int));
+			break;
+		case 's':
+			fprintf(stderr, spec, va_arg(val, const char *));
+			break;
+		case 'C':
+			color = va_arg(val, int);
+			break;
+		default:
+			fputc(*format, stderr);
+			break;
+		}
+	}
+	va_end(val);
+	return cursor;
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The smallest power of 2 that at least 'frac' of the waits were shorter
+// than.
+static unsigned long long
+wait_percentile(double frac)
+{
+	unsigned long long total = 0, sum = 0;
+	int i;
+
+	for (i = 0; i < SIM_HISTBITS; i++)
+		total += stats.wait_hist[i];
+	for (i = 0; i < SIM_HISTBITS; i++) {
+		sum += stats.wait_hist[i];
+		if (sum > 0 && sum >= frac * total)
+			return 1ULL << i;
+	}
+	return 0;
+}
+
+static void
+report(double host_sec)
+{
+	unsigned long long waits = 0, wait_ns = 0, cpu_ns = 0;
+	double sum = 0, sumsq = 0;
+	int pid, n = 0;
+
+	for (pid = 1; pid < SIM_NPROCS; pid++) {
+		waits += stats.waits[pid];
+		wait_ns += stats.wait_ns[pid];
+		cpu_ns += stats.cpu_ns[pid];
+		if (pid > 1 && stats.cpu_ns[pid]) {
+			sum += stats.cpu_ns[pid];
+			sumsq += (double) stats.cpu_ns[pid] * stats.cpu_ns[pid];
+			n++;
+		}
+	}
+
+	printf("%s on %d CPU%s: %.3f virtual ms%s, %.3f host s\n",
+	       sim_program_name(config.program), config.ncpus,
+	       config.ncpus == 1 ? "" : "s", stats.end_ns / 1e6,
+	       stats.stalled ? " (stalled)"
+	       : stats.end_ns > config.max_ns ? " (time limit)" : "",
+	       host_sec);
+	printf("kernel entries:  %llu (%.2f M/host s)\n", stats.entries,
+	       stats.entries / host_sec / 1e6);
+	printf("system calls:    %llu\n", stats.syscalls);
+	printf("switches:        %llu\n", stats.switches);
+	printf("timer ticks:     %llu\n", stats.ticks);
+	printf("wakeup IPIs:     %llu\n", stats.ipis);
+	printf("CPU utilization: %.1f%% user, %.1f%% idle\n",
+	       stats.end_ns ? 100.0 * cpu_ns / stats.end_ns / config.ncpus : 0,
+	       stats.end_ns ? 100.0 * stats.idle_ns / stats.end_ns / config.ncpus : 0);
+	printf("wait for CPU:    %llu waits, mean %.0f ns, p50 < %llu ns, "
+	       "p99 < %llu ns, max %llu ns\n", waits,
+	       waits ? (double) wait_ns / waits : 0, wait_percentile(0.5),
+	       wait_percentile(0.99), stats.max_wait_ns);
+	// Jain's index: 1 when every process got the same CPU time, 1/n when
+	// one got all of it.  The first process, which starts the others and
+	// then polls sys_wait(), is left out.
+	printf("fairness:        %.4f over %d children\n",
+	       n ? sum * sum / (n * sumsq) : 0, n);
+
+	if (config.verbose) {
+		printf("\n%4s %12s %10s %14s\n", "pid", "cpu ns", "waits",
+		       "mean wait ns");
+		for (pid = 1; pid < SIM_NPROCS; pid++)
+			if (stats.cpu_ns[pid] || stats.waits[pid])
+				printf("%4d %12llu %10llu %14.0f\n", pid,
+				       stats.cpu_ns[pid], stats.waits[pid],
+				       stats.waits[pid] ? (double) stats.wait_ns[pid]
+				       / stats.waits[pid] : 0);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long start, end;
+	double host_start;
+	void *arena;
+	char *rest;
+	int opt, r;
+
+	while ((opt = getopt(argc, argv, "c:n:i:w:k:x:p:t:v")) != -1)
+		switch (opt) {
+		case 'c':
+			config.ncpus = atoi(optarg);
+			break;
+		case 'n':
+			config.nprocs = atoi(optarg);
+			break;
+		case 'i':
+			config.iters = atoi(optarg);
+			break;
+		case 'w':
+			config.work_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			config.syscall_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			config.switch_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			config.ipi_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			config.max_ns = strtoull(optarg, NULL, 0) * 1000000;
+			break;
+		case 'v':
+			config.verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	if (optind + 1 != argc)
+		usage();
+	config.program = strtol(argv[optind], &rest, 10);
+	if (rest == argv[optind] || *rest) {
+		for (config.program = 0; config.program < sim_nprograms();
+		     config.program++)
+			if (strcmp(sim_program_name(config.program),
+				   argv[optind]) == 0)
+				break;
+	}
+	if (config.program < 0 || config.program >= sim_nprograms()
+	    || config.ncpus < 1)
+		usage();
+
+	// The simulated kernel's memory, at its own addresses.
+	sim_arena(&start, &end);
+	arena = mmap((void *) start, end - start, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE
+		     | MAP_NORESERVE, -1, 0);
+	if (arena != (void *) start) {
+		fprintf(stderr, "hostsim: cannot map %#lx-%#lx: %s\n",
+			start, end, arena == MAP_FAILED ? strerror(errno)
+			: "address in use");
+		exit(1);
+	}
+
+	sim_cfg = &config;
+	host_start = now_sec();
+	r = sim_run(&config, &stats);
+	report(now_sec() - host_start);
+	if (r < 0)
+		fprintf(stderr, "hostsim: the kernel halted\n");
+	return r < 0;
+}
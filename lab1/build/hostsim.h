@@ -0,0 +1,83 @@
+#ifndef WEENSYOS_HOSTSIM_H
+#define WEENSYOS_HOSTSIM_H
+
+/*****************************************************************************
+ * hostsim.h
+ *
+ *   The interface between the parts of the host simulator.  hostsim.c is
+ *   an ordinary host program, built with the host's headers; hostsim-x86.c
+ *   (the kernel and its mock hardware) and hostsim-apps.c (the simulated
+ *   applications) are built with the kernel's.  So this header uses only
+ *   plain C types.
+ *
+ *****************************************************************************/
+
+#define SIM_NPROCS		64	// NPROCS, checked in hostsim-x86.c
+#define SIM_HISTBITS		48	// wait-time histogram buckets
+
+// Simulation parameters.  Times are in virtual nanoseconds.
+struct sim_config {
+	int ncpus;			// simulated CPUs
+	int program;			// program the first process runs
+	int nprocs;			// processes the program should use
+	int iters;			// its iterations per process
+	unsigned long work_ns;		// user time between system calls
+	unsigned long syscall_ns;	// kernel time per entry
+	unsigned long switch_ns;	// extra time to switch processes
+	unsigned long ipi_ns;		// wakeup interrupt latency
+	unsigned long long max_ns;	// stop after this much virtual time
+	int verbose;			// print the console
+};
+
+// What happened.  Per-process counts are by process ID, over every
+// process that used that ID.
+struct sim_stats {
+	unsigned long long end_ns;	// virtual time at the end
+	int stalled;			// processes blocked forever
+	unsigned long long entries;	// kernel entries of any kind
+	unsigned long long syscalls;
+	unsigned long long switches;	// dispatches of a different process
+	unsigned long long ticks;	// timer interrupts
+	unsigned long long ipis;	// wakeup interrupts sent
+	unsigned long long idle_ns;	// summed over CPUs
+	unsigned long long cpu_ns[SIM_NPROCS];	// user time
+	unsigned long long waits[SIM_NPROCS];	// runnable-to-running delays
+	unsigned long long wait_ns[SIM_NPROCS];	// and their total
+	unsigned long long max_wait_ns;
+	// wait_hist[i] counts delays of less than 2^i ns (and at least
+	// 2^(i-1) ns)
+	unsigned long long wait_hist[SIM_HISTBITS];
+};
+
+// A simulated process, as its program sees it.  'eip' says where the
+// program is: hostsim-apps.c gives each point in a program where a system
+// call returns a label, SIM_LABEL(n).  An 'int' instruction is 2 bytes
+// long, so SIM_LABEL(n) - 2 is the system call itself; the kernel moves a
+// process back there to retry a call (see wait_block() in kernel.c).
+struct sim_proc {
+	int pid;
+	int program;
+	char *globals;			// the program's globals, shared by
+					// every process running it
+	unsigned long eax, ebx, ecx, edx, esi, edi, ebp, esp, eip;
+};
+
+#define SIM_LABEL(n)		(4 * (n) + 2)
+
+// hostsim-x86.c: run the simulation.  Returns 0, or -1 if the simulated
+// kernel halted on an error.
+int sim_run(const struct sim_config *cfg, struct sim_stats *st);
+// The addresses the simulated kernel uses, which the host must map.
+void sim_arena(unsigned long *start, unsigned long *end);
+
+// hostsim-apps.c: the programs.
+extern const struct sim_config *sim_cfg;
+int sim_nprograms(void);
+const char *sim_program_name(int program);
+// Run 'p' from p->eip to its next system call, which it leaves in its
+// registers as a real program would.  Sets p->eip to the call's return
+// label and '*work_ns' to the user time spent; returns the call's
+// interrupt number.
+int sim_step(struct sim_proc *p, unsigned long *work_ns);
+
+#endif
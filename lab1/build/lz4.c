@@ -0,0 +1,94 @@
+#include <string.h>
+#include <stdint.h>
+#include "lz4.h"
+
+/* LZ4 compression for mkbootdisk, which uses it to write LZ4 images
+ * (see lz4.h).
+ *
+ * lz4_compress(src, n, dst) compresses the 'n' bytes at 'src' into a
+ * single LZ4 block at 'dst', and returns the block's size.  'dst' must
+ * have room for LZ4_COMPRESS_BOUND(n) bytes.
+ *
+ * The compressor is a simple greedy one: it hashes each 4-byte sequence,
+ * and takes the most recent earlier occurrence within 64 KB as a match.
+ * That is enough for the process binaries, which are mostly zero padding
+ * and small code.
+ */
+
+#define HASH_LOG	16
+#define MINMATCH	4
+#define MFLIMIT		12	// last match must start this far from the end
+#define LASTLITERALS	5	// last bytes are always literals
+#define MAXOFFSET	65535
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint8_t *
+write_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static uint8_t *
+write_sequence(uint8_t *op, const uint8_t *lit, size_t litlen,
+	       size_t offset, size_t matchlen)
+{
+	uint8_t *token = op++;
+	*token = (litlen < 15 ? litlen : 15) << 4;
+	if (litlen >= 15)
+		op = write_length(op, litlen - 15);
+	memcpy(op, lit, litlen);
+	op += litlen;
+
+	if (matchlen) {
+		*op++ = offset;
+		*op++ = offset >> 8;
+		matchlen -= MINMATCH;
+		*token |= (matchlen < 15 ? matchlen : 15);
+		if (matchlen >= 15)
+			op = write_length(op, matchlen - 15);
+	}
+	return op;
+}
+
+size_t
+lz4_compress(const uint8_t *src, size_t n, uint8_t *dst)
+{
+	static uint32_t table[1 << HASH_LOG];	// position + 1, or 0
+	size_t pos = 0, anchor = 0;
+	uint8_t *op = dst;
+
+	memset(table, 0, sizeof(table));
+	while (n > MFLIMIT && pos < n - MFLIMIT) {
+		uint32_t seq = read32(src + pos);
+		uint32_t h = (seq * 2654435761U) >> (32 - HASH_LOG);
+		size_t cand = table[h], len;
+		table[h] = pos + 1;
+
+		if (cand == 0 || pos - (cand - 1) > MAXOFFSET
+		    || read32(src + cand - 1) != seq) {
+			pos++;
+			continue;
+		}
+
+		cand--;
+		for (len = MINMATCH;
+		     pos + len < n - LASTLITERALS && src[cand + len] == src[pos + len];
+		     len++)
+			/* extend match */;
+
+		op = write_sequence(op, src + anchor, pos - anchor,
+				    pos - cand, len);
+		pos += len;
+		anchor = pos;
+	}
+
+	return write_sequence(op, src + anchor, n - anchor, 0, 0) - dst;
+}
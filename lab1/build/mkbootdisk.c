@@ -4,10 +4,14 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #if defined(_MSDOS) || defined(_WIN32)
 # include <fcntl.h>
 # include <io.h>
 #endif
+#include "lz4.h"
+#include "appdir.h"
+#include "fs.h"
 
 /* This program makes a boot image.
  * It takes at least one argument, the boot sector file.
@@ -16,19 +20,30 @@
  * Before jumping to the boot sector, the BIOS checks that the last
  * two bytes in the sector equal 0x55 and 0xAA.
  * This code makes sure the code intended for the boot sector is at most
- * 512 - 2 = 510 bytes long, then appends the 0x55-0xAA signature.
+ * 512 - 10 = 502 bytes long, then appends the 0x55-0xAA signature.
+ * (The eight bytes in between locate the filesystem and the application
+ * directory.)
+ *
+ * Arguments after '-a' are application binaries.  They are written after
+ * everything else, preceded by an application directory (see appdir.h).
+ * With '-a -z', each application is stored as an LZ4 image (see lz4.h).
+ * Arguments after '-f' are files for the read-only filesystem (see fs.h),
+ * which is written last of all.  The output must be a regular file when
+ * '-a' or '-f' is used.
  */
 
 int diskfd;
 off_t maxoff = 0;
 off_t curoff = 0;
 
+size_t lz4_compress(const uint8_t *src, size_t n, uint8_t *dst);
+
 
 
 void
 usage(void)
 {
-	fprintf(stderr, "Usage: mkbootdisk BOOTSECTORFILE [FILE | @SECNUM]...\n");
+	fprintf(stderr, "Usage: mkbootdisk BOOTSECTORFILE [FILE | @SECNUM]... [-a [-z] APPFILE...] [-f FSFILE...]\n");
 	exit(1);
 }
 
@@ -67,6 +82,212 @@ diskwrite(const void *data, size_t amt)
 	}
 }
 
+void
+put32(unsigned char *p, uint32_t x)
+{
+	p[0] = x & 0xFF;
+	p[1] = (x >> 8) & 0xFF;
+	p[2] = (x >> 16) & 0xFF;
+	p[3] = (x >> 24) & 0xFF;
+}
+
+uint32_t
+get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Read all of file 'name' into memory.
+unsigned char *
+readfile(const char *name, size_t *size)
+{
+	FILE *f = fopencheck(name);
+	size_t cap = 65536, n = 0, r;
+	unsigned char *data = malloc(cap);
+
+	while (data && (r = fread(data + n, 1, cap - n, f)) > 0)
+		if ((n += r) == cap)
+			data = realloc(data, cap *= 2);
+	fclose(f);
+	if (!data) {
+		fprintf(stderr, "%s: out of memory\n", name);
+		usage();
+	}
+	*size = n;
+	return data;
+}
+
+// Write 'n' bytes, then pad to a sector boundary.  Returns sectors written.
+size_t
+sectorwrite(const void *data, size_t n)
+{
+	static const char zerobuf[512];
+	diskwrite(data, n);
+	if (n % 512 != 0)
+		diskwrite(zerobuf, 512 - n % 512);
+	return (n + 511) / 512;
+}
+
+// Write 'n' bytes, then pad to a filesystem block boundary.  Returns
+// sectors written.
+size_t
+blockwrite(const void *data, size_t n)
+{
+	static const char zerobuf[512];
+	size_t nsect = sectorwrite(data, n);
+	for (; nsect % FS_BLOCKSECT != 0; nsect++)
+		diskwrite(zerobuf, 512);
+	return nsect;
+}
+
+// Store 'sector' at byte 'offset' of the boot sector, to locate 'what'.
+void
+bootrecord(off_t offset, uint32_t sector, const char *what)
+{
+	unsigned char ptr[4];
+
+	put32(ptr, sector);
+	if (lseek(diskfd, offset, SEEK_SET) == (off_t) -1
+	    || write(diskfd, ptr, 4) != 4
+	    || lseek(diskfd, curoff, SEEK_SET) == (off_t) -1) {
+		fprintf(stderr, "mkbootdisk: recording %s: %s\n", what,
+			strerror(errno));
+		usage();
+	}
+}
+
+// Write the application directory and then the applications named in
+// 'apps', starting at sector 'nsectors'.  Returns the new sector count.
+size_t
+writeapps(size_t nsectors, char **apps, int napps, int compress)
+{
+	unsigned char **data = calloc(napps + 1, sizeof(*data));
+	size_t *size = calloc(napps + 1, sizeof(*size));
+	size_t dirsize = sizeof(struct appdir_header)
+		+ napps * sizeof(struct appdir_entry);
+	struct appdir_header *hdr = calloc(1, dirsize);
+	struct appdir_entry *ent = (struct appdir_entry *) (hdr + 1);
+	size_t dirsector = nsectors, sector;
+	int i;
+
+	if (!data || !size || !hdr) {
+		fprintf(stderr, "mkbootdisk: out of memory\n");
+		usage();
+	}
+
+	hdr->ad_magic = APPDIR_MAGIC;
+	hdr->ad_napps = napps;
+	sector = nsectors + (dirsize + 511) / 512;
+	for (i = 0; i < napps; i++) {
+		const char *base = strrchr(apps[i], '/');
+		char *dot;
+		base = (base ? base + 1 : apps[i]);
+		if (strncmp(base, "p-", 2) == 0)
+			base += 2;
+		strncpy(ent[i].ade_name, base, APPDIR_NAMELEN - 1);
+		if ((dot = strchr(ent[i].ade_name, '.')))
+			memset(dot, 0, ent[i].ade_name + APPDIR_NAMELEN - dot);
+
+		data[i] = readfile(apps[i], &size[i]);
+		if (size[i] >= 28 && get32(data[i]) == 0x464C457FU)
+			ent[i].ade_entry = get32(data[i] + 24);
+
+		if (compress) {
+			unsigned char *z = malloc(LZ4IMAGE_HDRSIZE
+						  + LZ4_COMPRESS_BOUND(size[i]));
+			if (!z) {
+				fprintf(stderr, "%s: out of memory\n", apps[i]);
+				usage();
+			}
+			put32(z, LZ4IMAGE_MAGIC);
+			put32(z + 4, size[i]);
+			size[i] = LZ4IMAGE_HDRSIZE
+				+ lz4_compress(data[i], size[i], z + LZ4IMAGE_HDRSIZE);
+			free(data[i]);
+			data[i] = z;
+		}
+
+		ent[i].ade_sector = sector;
+		ent[i].ade_length = size[i];
+		sector += (size[i] + 511) / 512;
+	}
+
+	nsectors += sectorwrite(hdr, dirsize);
+	for (i = 0; i < napps; i++) {
+		nsectors += sectorwrite(data[i], size[i]);
+		free(data[i]);
+	}
+
+	// Record the directory's location in the boot sector.
+	bootrecord(APPDIR_SECTOR_OFFSET, dirsector, "application directory");
+
+	free(hdr);
+	free(size);
+	free(data);
+	return nsectors;
+}
+
+// Write a filesystem holding the files named in 'files', starting at the
+// first block boundary at or after sector 'nsectors' (see fs.h).  Each
+// file is stored as one extent.  Returns the new sector count.
+size_t
+writefs(size_t nsectors, char **files, int nfiles)
+{
+	static const char zerobuf[512];
+	unsigned char **data = calloc(nfiles + 1, sizeof(*data));
+	size_t dirsize = (nfiles + 1) * sizeof(struct fs_dirent);
+	struct fs_dirent *ent = calloc(nfiles + 1, sizeof(*ent));
+	struct fs_superblock *sb = (struct fs_superblock *) ent;
+	size_t fssector, size;
+	uint32_t block;
+	int i;
+
+	if (!data || !ent) {
+		fprintf(stderr, "mkbootdisk: out of memory\n");
+		usage();
+	}
+
+	for (; nsectors % FS_BLOCKSECT != 0; nsectors++)
+		diskwrite(zerobuf, 512);
+	fssector = nsectors;
+
+	block = (dirsize + FS_BLOCKSIZE - 1) / FS_BLOCKSIZE;
+	for (i = 0; i < nfiles; i++) {
+		struct fs_dirent *e = &ent[i + 1];
+		const char *base = strrchr(files[i], '/');
+		base = (base ? base + 1 : files[i]);
+		if (strlen(base) >= FS_NAMELEN) {
+			fprintf(stderr, "%s: name too long for the filesystem (max %d)\n", files[i], FS_NAMELEN - 1);
+			usage();
+		}
+		strcpy(e->fd_name, base);
+
+		data[i] = readfile(files[i], &size);
+		e->fd_size = size;
+		if (size > 0) {
+			e->fd_extents[0].fe_block = block;
+			e->fd_extents[0].fe_nblocks = (size + FS_BLOCKSIZE - 1) / FS_BLOCKSIZE;
+			block += e->fd_extents[0].fe_nblocks;
+		}
+	}
+	sb->fs_magic = FS_MAGIC;
+	sb->fs_nfiles = nfiles;
+	sb->fs_nblocks = block;
+
+	nsectors += blockwrite(ent, dirsize);
+	for (i = 0; i < nfiles; i++) {
+		nsectors += blockwrite(data[i], ent[i + 1].fd_size);
+		free(data[i]);
+	}
+
+	// Record the filesystem's location in the boot sector.
+	bootrecord(FS_SECTOR_OFFSET, fssector, "filesystem");
+
+	free(ent);
+	free(data);
+	return nsectors;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -75,7 +296,7 @@ main(int argc, char *argv[])
 	FILE *f;
 	size_t n;
 	size_t nsectors;
-	int i;
+	int i, fsarg;
 	int bootsector_special = 1;
 
 #if defined(_MSDOS) || defined(_WIN32)
@@ -94,8 +315,8 @@ main(int argc, char *argv[])
 	if (bootsector_special) {
 		f = fopencheck(argv[1]);
 		n = fread(buf, 1, 4096, f);
-		if (n > 510) {
-			fprintf(stderr, "%s: boot block too large: %s%u bytes (max 510)\n", argv[1], (n == 4096 ? ">= " : ""), (unsigned) n);
+		if (n > FS_SECTOR_OFFSET) {
+			fprintf(stderr, "%s: boot block too large: %s%u bytes (max %u)\n", argv[1], (n == 4096 ? ">= " : ""), (unsigned) n, FS_SECTOR_OFFSET);
 			usage();
 		}
 		fclose(f);
@@ -112,13 +333,25 @@ main(int argc, char *argv[])
 	} else
 		nsectors = 0;
 
+	// "-f" means the rest of the arguments are filesystem files.
+	for (fsarg = 1; fsarg < argc && strcmp(argv[fsarg], "-f") != 0; fsarg++)
+		/* do nothing */;
+
 	// Read any succeeding files, then write them out
 	memset(zerobuf, 0, 512);
-	for (i = 1; i < argc; i++) {
+	for (i = 1; i < fsarg; i++) {
 		size_t pos;
 		char *str;
 		unsigned long skipto_sector;
 
+		// "-a" means the rest of the arguments are applications.
+		if (strcmp(argv[i], "-a") == 0) {
+			int compress = (i + 1 < fsarg && strcmp(argv[i + 1], "-z") == 0);
+			i += 1 + compress;
+			nsectors = writeapps(nsectors, argv + i, fsarg - i, compress);
+			break;
+		}
+
 		// An argument like "@X" means "skip to sector X".
 		if (argv[i][0] == '@' && isdigit(argv[i][1])
 		    && ((skipto_sector = strtoul(argv[i] + 1, &str, 0)), *str == 0)) {
@@ -148,6 +381,9 @@ main(int argc, char *argv[])
 		fclose(f);
 	}
 
+	if (fsarg < argc)
+		nsectors = writefs(nsectors, argv + fsarg + 1, argc - fsarg - 1);
+
 	// Fill out to 1024 sectors with 0 blocks
 	while (nsectors < 1024) {
 		diskwrite(zerobuf, 512);
@@ -49,6 +49,9 @@ CFLAGS	:= $(CFLAGS) $(DEFS) $(LABDEFS) -Os -ffreestanding -fomit-frame-pointer -
 CFLAGS	+= $(shell $(CC) -fno-stack-protector -E -x c /dev/null >/dev/null 2>&1 && echo -fno-stack-protector)
 # Include -m32 if the option exists (x86_64).
 CFLAGS	+= $(shell $(CC) -m32 -E -x c /dev/null >/dev/null 2>&1 && echo -m32)
+# Include --param=min-pagesize=0 if the option exists: the kernel reads
+# the BIOS data area, near address 0, which newer GCCs otherwise reject.
+CFLAGS	+= $(shell $(CC) --param=min-pagesize=0 -E -x c /dev/null >/dev/null 2>&1 && echo --param=min-pagesize=0)
 ifdef SOL
 CFLAGS	+= -DSOL=$(SOL)
 endif
@@ -83,7 +86,10 @@ QEMU_PATH = $(shell if which $(QEMU) 2>/dev/null | grep ^/ >/dev/null 2>&1; \
 
 GDBPORT = 20000
 
-QEMUOPT	= -net none -parallel file:log.txt -k en-us
+# Number of CPUs to emulate: 'make run CPUS=4'
+CPUS ?= 1
+
+QEMUOPT	= -net none -parallel file:log.txt -k en-us -smp $(CPUS)
 
 QEMU_PRELOAD_LIBRARY = $(OBJDIR)/libqemu-nograb.so.1
 
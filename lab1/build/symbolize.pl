@@ -0,0 +1,99 @@
+#!/usr/bin/perl
+#
+# Usage: symbolize.pl [-f] [-o objdir] [log.txt]
+#
+# Reads the profile samples that a 'make PROFILE=1' kernel writes to
+# log.txt at shutdown (see k-profile.c), looks up every address in
+# obj/kernel.sym and obj/p-*.sym, and prints a flat profile: samples per
+# function, most first, for all CPUs together.  Each sample counts as many
+# times as its CPU's stride, the timer ticks it stands for.  Application
+# functions are named <program>:<function>.
+#
+# With -f, prints folded stacks instead, one line per distinct stack,
+# callers first, then the number of samples:
+#
+#	p-sync:pmain;p-sync:produce;p-sync:mutex_lock 12
+#
+# which is the input format of flamegraph.pl.
+#
+
+use strict;
+
+my $folded = 0;
+my $objdir = "obj";
+while (@ARGV && $ARGV[0] =~ /^-/) {
+	my $opt = shift @ARGV;
+	if ($opt eq "-f") {
+		$folded = 1;
+	} elsif ($opt eq "-o" && @ARGV) {
+		$objdir = shift @ARGV;
+	} else {
+		die "Usage: symbolize.pl [-f] [-o objdir] [log.txt]\n";
+	}
+}
+
+# Text symbols from every .sym file, sorted by address.
+my @syms;
+foreach my $file (glob("$objdir/kernel.sym $objdir/p-*.sym")) {
+	my ($prefix) = $file =~ m|([^/]*)\.sym$|;
+	$prefix = $prefix eq "kernel" ? "" : "$prefix:";
+	open(SYM, $file) or die "$file: $!\n";
+	while (<SYM>) {
+		my ($addr, $type, $name) = split;
+		push @syms, [hex($addr), $prefix . $name]
+			if defined($name) && $type =~ /^[tTwW]$/;
+	}
+	close(SYM);
+}
+die "No symbols in $objdir; run 'make PROFILE=1' first.\n" if !@syms;
+@syms = sort { $a->[0] <=> $b->[0] } @syms;
+
+# The name of the last symbol at or below 'addr'.
+sub lookup {
+	my $addr = shift;
+	my ($lo, $hi) = (0, scalar(@syms));
+	while ($hi - $lo > 1) {
+		my $mid = int(($lo + $hi) / 2);
+		if ($syms[$mid]->[0] <= $addr) {
+			$lo = $mid;
+		} else {
+			$hi = $mid;
+		}
+	}
+	return $syms[$lo]->[0] <= $addr ? $syms[$lo]->[1]
+		: sprintf("0x%x", $addr);
+}
+
+my (%counts, %stride, $total, $inprofile);
+while (<>) {
+	s/\r?\n$//;
+	if ($_ eq "PROFILE BEGIN") {
+		$inprofile = 1;
+	} elsif ($_ eq "PROFILE END") {
+		$inprofile = 0;
+	} elsif ($inprofile && /^STRIDE (\S+) (\S+)$/) {
+		$stride{hex($1)} = hex($2);
+	} elsif ($inprofile && /^P /) {
+		my (undef, $cpu, $pid, $mode, $eip, @stack) = split;
+		my @frames = (lookup(hex($eip)));
+		# return addresses point just past their call instructions
+		push @frames, lookup(hex($_) - 1) foreach @stack;
+		my $key = $folded ? join(";", reverse @frames) : $frames[0];
+		my $weight = $stride{hex($cpu)} || 1;
+		$counts{$key} += $weight;
+		$total += $weight;
+	}
+}
+die "No profile samples found.\n" if !$total;
+
+if ($folded) {
+	print "$_ $counts{$_}\n" foreach sort keys %counts;
+} else {
+	printf "%d samples\n", $total;
+	printf "%8s %6s  %s\n", "samples", "%", "function";
+	foreach my $name (sort { $counts{$b} <=> $counts{$a} || $a cmp $b }
+			  keys %counts) {
+		printf "%8d %5.1f%%  %s\n", $counts{$name},
+			100 * $counts{$name} / $total, $name;
+	}
+}
@@ -10,29 +10,87 @@
 #define INT_SYS_YIELD		50
 #define INT_SYS_EXIT		51
 #define INT_SYS_WAIT		52
+#define INT_SYS_EXEC		53
+#define INT_SYS_KSTATS		54
+#define INT_SYS_SBRK		55
+#define INT_SYS_PIPE		56
+#define INT_SYS_READ		57
+#define INT_SYS_WRITE		58
+#define INT_SYS_CLOSE		59
+#define INT_SYS_FUTEX_WAIT	60
+#define INT_SYS_FUTEX_WAKE	61
+#define INT_SYS_SLEEP		62
+#define INT_SYS_DISK_READ	63
+#define INT_SYS_OPEN		64
+#define INT_SYS_YIELD_TO	65
 
-// These system call numbers currently do nothing; feel free to define them
-// as you like.
 
-#define INT_SYS_USER1		53
-#define INT_SYS_USER2		54
-#define INT_SYS_USER3		55
-#define INT_SYS_USER4		56
-#define INT_SYS_USER5		57
+// Disk sector size, and the most sectors sys_disk_read() reads at once:
+// one page.
+
+#define SECTORSIZE		512
+#define DISK_READ_MAX		8
+
+
+// Value returned by sys_wait() to indicate that the caller should try again.
+
+#define WAIT_TRYAGAIN		(-2)
 
 
 // The maximum number of processes in the system.
 
-#define NPROCS			16
+#define NPROCS			64
 
 
-// Value returned by sys_wait() to indicate that the caller should try again.
+// Process stacks live above physical memory, one PROC_STACK_SIZE slot of
+// virtual addresses per process ID, with process P's stack growing down
+// from PROC_STACK_TOP(P).  Only the pages a stack actually uses are backed
+// by page frames (see kernel.c).
 
-#define WAIT_TRYAGAIN		(-2)
+#define STACK_REGION_START	0x2000000
+#define PROC_STACK_SIZE		0x40000
+#define PROC_STACK_TOP(pid)	(STACK_REGION_START + (pid) * PROC_STACK_SIZE)
+
+
+// Kernel memory usage, as reported by sys_kstats(): free page frames; for
+// each slab cache, its object size, the pages it owns, and how many of its
+// objects are in use and free; and the stack pages each process has
+// committed (0 for empty process slots).  Also the disk's size in sectors,
+// and how many read requests the disk driver has had, and how many disk
+// commands it took to serve them.  Finally, for the buffer cache, how many
+// block lookups found the block there, and how many blocks it read from
+// disk because a process needed them or in advance.
+
+#define KSTATS_NCACHES		5
+
+typedef struct kstats {
+	uint32_t ks_pages_total;
+	uint32_t ks_pages_free;
+	struct {
+		uint32_t kc_size;
+		uint32_t kc_slabs;
+		uint32_t kc_inuse;
+		uint32_t kc_free;
+	} ks_caches[KSTATS_NCACHES];
+	uint32_t ks_stack_pages[NPROCS];
+	uint32_t ks_disk_sectors;
+	uint32_t ks_disk_reads;
+	uint32_t ks_disk_commands;
+	uint32_t ks_bcache_hits;
+	uint32_t ks_bcache_misses;
+	uint32_t ks_bcache_readaheads;
+} kstats_t;
 
 
 // The current screen cursor position (stored at memory location 0x190000).
 
 extern uint16_t *cursorpos;
 
+
+// How many thousand times per second the processor's cycle counter
+// (read_cycle_counter() in x86.h) ticks, as measured by the kernel at boot.
+// Stored at memory location 0x60004, next to 'cursorpos'.
+
+extern uint32_t tsc_khz;
+
 #endif
@@ -0,0 +1,53 @@
+#ifndef WEENSYOS_FS_H
+#define WEENSYOS_FS_H
+
+/*****************************************************************************
+ * fs.h
+ *
+ *   Layout of the read-only filesystem that build/mkbootdisk.c writes to
+ *   the boot disk after the applications, and that k-fs.c reads.
+ *
+ *   The filesystem is made of FS_BLOCKSIZE-byte blocks, and starts on a
+ *   block boundary of the disk.  Its first sector number is stored, little
+ *   endian, at byte FS_SECTOR_OFFSET of the boot sector (just before the
+ *   application directory's); 0 means there is no filesystem.  Block
+ *   numbers count from the filesystem's first block.
+ *
+ *   The first block starts with a 'fs_superblock', in a slot the size of
+ *   a directory entry.  The directory follows it: 'fs_nfiles'
+ *   'fs_dirent' structures, so entry I is in slot I + 1, possibly in a
+ *   later block.  Each file's data is stored in up to FS_NEXTENTS extents,
+ *   runs of consecutive blocks, in order.
+ *
+ *   Include types.h (in the kernel) or <stdint.h> (on the host) first.
+ *
+ *****************************************************************************/
+
+#define FS_MAGIC		0x53464F52U	/* "ROFS" in little endian */
+#define FS_SECTOR_OFFSET	502
+#define FS_BLOCKSIZE		4096
+#define FS_BLOCKSECT		(FS_BLOCKSIZE / 512)
+#define FS_NAMELEN		28
+#define FS_NEXTENTS		4
+
+struct fs_superblock {
+	uint32_t fs_magic;		// must equal FS_MAGIC
+	uint32_t fs_nfiles;		// number of directory entries
+	uint32_t fs_nblocks;		// blocks in the filesystem
+};
+
+struct fs_extent {
+	uint32_t fe_block;		// first block
+	uint32_t fe_nblocks;		// number of blocks
+};
+
+struct fs_dirent {
+	char fd_name[FS_NAMELEN];	// null-terminated name
+	uint32_t fd_size;		// length in bytes
+	struct fs_extent fd_extents[FS_NEXTENTS]; // unused ones are 0
+};
+
+// Directory entries per block, counting the superblock's slot.
+#define FS_DIRENTS_PER_BLOCK	(FS_BLOCKSIZE / sizeof(struct fs_dirent))
+
+#endif /* !WEENSYOS_FS_H */
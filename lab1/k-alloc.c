@@ -0,0 +1,175 @@
+#include "x86.h"
+#include "lib.h"
+#include "kernel.h"
+
+/*****************************************************************************
+ * k-alloc.c
+ *
+ *   The kernel's memory allocators.
+ *
+ *   page_alloc() and page_free() hand out 4 KB physical page frames from
+ *   the memory no one else uses: above the last process stack, below the
+ *   application region, minus the program image area.  Free frames are
+ *   kept on a list threaded through the frames themselves.  (Virtual
+ *   addresses equal physical addresses, so a frame's address is also a
+ *   pointer to it.)
+ *
+ *   kmalloc() and kfree() carve small kernel objects out of those frames.
+ *   There is one slab cache per size class.  Each slab is one page: a
+ *   cache-line-sized header that points back at the cache, then as many
+ *   objects as fit.  Objects are rounded up to whole cache lines, so no two
+ *   objects share a line.  Free objects are kept on the cache's free list;
+ *   a cache grows by a slab when that list is empty, and slabs are never
+ *   given back.
+ *
+ *****************************************************************************/
+
+// Free page frames.
+struct freepage {
+	struct freepage *next;
+};
+
+static struct freepage *free_pages;
+static uint32_t npages_total;
+static uint32_t npages_free;
+
+// Slab caches, smallest first.  Object sizes are multiples of CACHELINE.
+struct freeobj {
+	struct freeobj *next;
+};
+
+struct slab_cache {
+	size_t size;			// object size
+	struct freeobj *free;		// free objects, in any slab
+	uint32_t nslabs;		// pages owned by this cache
+	uint32_t ninuse;		// objects handed out
+	uint32_t nfree;			// objects on 'free'
+};
+
+static struct slab_cache caches[KSTATS_NCACHES];
+
+static void
+page_range_free(uintptr_t start, uintptr_t end)
+{
+	for (; start + PAGESIZE <= end; start += PAGESIZE) {
+		page_free((void *) start);
+		npages_total++;
+	}
+}
+
+void
+kalloc_init(void)
+{
+	int i;
+
+	free_pages = NULL;
+	npages_total = npages_free = 0;
+	page_range_free(PAGEFRAMES_START, APP_IMAGE_START);
+	page_range_free(APP_IMAGE_END, APP_REGION_START);
+
+	for (i = 0; i < KSTATS_NCACHES; i++) {
+		caches[i].size = CACHELINE << i;
+		caches[i].free = NULL;
+		caches[i].nslabs = caches[i].ninuse = caches[i].nfree = 0;
+	}
+}
+
+// Allocate one zero-filled page frame.  Returns NULL if memory is
+// exhausted.
+void *
+page_alloc(void)
+{
+	struct freepage *page = free_pages;
+	if (!page)
+		return NULL;
+	free_pages = page->next;
+	npages_free--;
+	memset(page, 0, PAGESIZE);
+	return page;
+}
+
+void
+page_free(void *page)
+{
+	struct freepage *fp = (struct freepage *) page;
+	fp->next = free_pages;
+	free_pages = fp;
+	npages_free++;
+}
+
+// Add a slab to 'cache'.  Returns 0 on success, -1 if there is no memory.
+static int
+slab_grow(struct slab_cache *cache)
+{
+	uint8_t *page = (uint8_t *) page_alloc();
+	uint8_t *obj;
+
+	if (!page)
+		return -1;
+	*(struct slab_cache **) page = cache;
+	for (obj = page + CACHELINE; obj + cache->size <= page + PAGESIZE;
+	     obj += cache->size) {
+		((struct freeobj *) obj)->next = cache->free;
+		cache->free = (struct freeobj *) obj;
+		cache->nfree++;
+	}
+	cache->nslabs++;
+	return 0;
+}
+
+// Allocate a zero-filled, cache-line-aligned object of at least 'size'
+// bytes.  Returns NULL if 'size' is larger than KMALLOC_MAX or memory is
+// exhausted.
+void *
+kmalloc(size_t size)
+{
+	struct slab_cache *cache;
+	struct freeobj *obj;
+
+	for (cache = caches; cache < caches + KSTATS_NCACHES; cache++)
+		if (size <= cache->size)
+			break;
+	if (cache == caches + KSTATS_NCACHES
+	    || (!cache->free && slab_grow(cache) < 0))
+		return NULL;
+
+	obj = cache->free;
+	cache->free = obj->next;
+	cache->nfree--;
+	cache->ninuse++;
+	memset(obj, 0, cache->size);
+	return obj;
+}
+
+// Free an object returned by kmalloc().  The slab's header says which
+// cache it came from.
+void
+kfree(void *ptr)
+{
+	struct slab_cache *cache;
+	struct freeobj *obj = (struct freeobj *) ptr;
+
+	if (!ptr)
+		return;
+	cache = *(struct slab_cache **) ((uintptr_t) ptr & ~(PAGESIZE - 1));
+	obj->next = cache->free;
+	cache->free = obj;
+	cache->nfree++;
+	cache->ninuse--;
+}
+
+// Fill in '*ks' with the allocators' current usage.
+void
+kalloc_stats(kstats_t *ks)
+{
+	int i;
+
+	ks->ks_pages_total = npages_total;
+	ks->ks_pages_free = npages_free;
+	for (i = 0; i < KSTATS_NCACHES; i++) {
+		ks->ks_caches[i].kc_size = caches[i].size;
+		ks->ks_caches[i].kc_slabs = caches[i].nslabs;
+		ks->ks_caches[i].kc_inuse = caches[i].ninuse;
+		ks->ks_caches[i].kc_free = caches[i].nfree;
+	}
+}
@@ -0,0 +1,160 @@
+#include "kernel.h"
+#include "lib.h"
+#include "fs.h"
+
+/*****************************************************************************
+ * k-bcache.c
+ *
+ *   The buffer cache keeps recently read disk blocks, FS_BLOCKSIZE bytes
+ *   each, in up to BCACHE_NBUF page frames, so a block read again comes
+ *   from memory.  Cached blocks are found through a hash table on the
+ *   block number.  Buffers are also kept on an LRU list, most recently
+ *   used first; a block that is not cached takes the least recently used
+ *   buffer that is not waiting for the disk, and its page is allocated
+ *   the first time the buffer is used.
+ *
+ *   bcache_read() returns a block's buffer at once, starting the block's
+ *   disk read if it is not cached.  The caller waits on the buffer's
+ *   'b_req.dr_wait' while the read is pending, as for any disk request,
+ *   and passes the buffer back when it asks again.  A buffer whose read
+ *   failed is read again only for a caller that was not waiting for it,
+ *   so the caller that was sees the error instead of waiting again.
+ *   bcache_readahead() starts reading a block no one is waiting for yet.
+ *   Read-ahead never ties up more than BCACHE_NBUF - NPROCS buffers, so
+ *   every process can always have a block of its own on the way.
+ *
+ *****************************************************************************/
+
+#define BCACHE_NBUF		128
+#define BCACHE_NHASH		64
+#define BCACHE_NOBLOCK		0xFFFFFFFFU	// 'b_block' of an unused buffer
+
+static buf_t bufs[BCACHE_NBUF];
+static buf_t *bcache_hash[BCACHE_NHASH];
+static buf_t *lru_head;			// most recently used buffer
+static buf_t *lru_tail;			// least recently used buffer
+
+static uint32_t bcache_nhits;		// lookups that found the block
+static uint32_t bcache_nmisses;		// blocks read on demand
+static uint32_t bcache_nreadaheads;	// blocks read ahead
+
+void
+bcache_init(void)
+{
+	int i;
+
+	for (i = 0; i < BCACHE_NBUF; i++) {
+		bufs[i].b_block = BCACHE_NOBLOCK;
+		bufs[i].b_lru_prev = (i > 0 ? &bufs[i - 1] : NULL);
+		bufs[i].b_lru_next = (i + 1 < BCACHE_NBUF ? &bufs[i + 1] : NULL);
+	}
+	lru_head = &bufs[0];
+	lru_tail = &bufs[BCACHE_NBUF - 1];
+}
+
+static buf_t *
+bcache_lookup(uint32_t block)
+{
+	buf_t *b = bcache_hash[block % BCACHE_NHASH];
+	while (b && b->b_block != block)
+		b = b->b_hash_next;
+	return b;
+}
+
+// Move 'b' to the front of the LRU list.
+static void
+bcache_touch(buf_t *b)
+{
+	if (b == lru_head)
+		return;
+	b->b_lru_prev->b_lru_next = b->b_lru_next;
+	if (b->b_lru_next)
+		b->b_lru_next->b_lru_prev = b->b_lru_prev;
+	else
+		lru_tail = b->b_lru_prev;
+	b->b_lru_prev = NULL;
+	b->b_lru_next = lru_head;
+	lru_head->b_lru_prev = b;
+	lru_head = b;
+}
+
+// Start reading 'block' into 'b', its buffer if it has one (whose last
+// read failed), or else the least recently used buffer not waiting for
+// the disk.  Returns the buffer, or NULL if there is none.
+static buf_t *
+bcache_start(uint32_t block, buf_t *b)
+{
+	buf_t **pp;
+
+	if (!b) {
+		for (b = lru_tail; b && b->b_req.dr_status == DISK_PENDING;
+		     b = b->b_lru_prev)
+			/* do nothing */;
+		if (!b || (!b->b_req.dr_buf
+			   && !(b->b_req.dr_buf = (uint8_t *) page_alloc())))
+			return NULL;
+		if (b->b_block != BCACHE_NOBLOCK) {
+			for (pp = &bcache_hash[b->b_block % BCACHE_NHASH];
+			     *pp != b; pp = &(*pp)->b_hash_next)
+				/* do nothing */;
+			*pp = b->b_hash_next;
+		}
+		b->b_block = block;
+		b->b_hash_next = bcache_hash[block % BCACHE_NHASH];
+		bcache_hash[block % BCACHE_NHASH] = b;
+	}
+	bcache_touch(b);
+	b->b_req.dr_sect = block * FS_BLOCKSECT;
+	b->b_req.dr_nsect = FS_BLOCKSECT;
+	disk_submit(&b->b_req);
+	return b;
+}
+
+// Return the buffer for 'block', starting its read if it is not cached;
+// NULL if no buffer is free.  'waited' is the buffer the caller last
+// waited for, if any.  Finding the block cached, or on its way, counts as
+// a hit unless it is in 'waited'; if 'waited''s read failed, it is
+// returned as it is.
+buf_t *
+bcache_read(uint32_t block, buf_t *waited)
+{
+	buf_t *b = bcache_lookup(block);
+
+	if (b && (b->b_req.dr_status >= 0 || b == waited)) {
+		bcache_touch(b);
+		if (b != waited)
+			bcache_nhits++;
+		return b;
+	}
+	if ((b = bcache_start(block, b)))
+		bcache_nmisses++;
+	return b;
+}
+
+// Start reading 'block' before anyone needs it, unless it is cached or on
+// its way.  Returns 0, or -1 if read-ahead has all the buffers it may use.
+int
+bcache_readahead(uint32_t block)
+{
+	buf_t *b = bcache_lookup(block);
+	int i, npending = 0;
+
+	if (b && b->b_req.dr_status >= 0)
+		return 0;
+	for (i = 0; i < BCACHE_NBUF; i++)
+		if (bufs[i].b_req.dr_status == DISK_PENDING)
+			npending++;
+	if (npending >= BCACHE_NBUF - NPROCS || !bcache_start(block, b))
+		return -1;
+	bcache_nreadaheads++;
+	return 0;
+}
+
+// Report the cache's hits and disk reads, for sys_kstats().
+void
+bcache_stats(kstats_t *ks)
+{
+	ks->ks_bcache_hits = bcache_nhits;
+	ks->ks_bcache_misses = bcache_nmisses;
+	ks->ks_bcache_readaheads = bcache_nreadaheads;
+}
@@ -0,0 +1,268 @@
+#include "kernel.h"
+#include "x86.h"
+#include "lib.h"
+
+/*****************************************************************************
+ * k-disk.c
+ *
+ *   Read sectors from the first IDE hard disk, the one we booted from.
+ *
+ *   disk_read() is the same polled PIO method the boot loader uses (see
+ *   boot.c): one READ SECTORS command per 256 sectors, then one 512-byte
+ *   transfer per sector as the disk makes each one ready.  The kernel
+ *   runs with interrupts disabled, so it simply waits.  The loader uses it
+ *   at boot, and when a process first runs a program.
+ *
+ *   Everything else goes through the request queue, and the disk
+ *   interrupts (on IRQ_DISK) as each sector becomes ready, so processes
+ *   keep running while it works.  disk_submit() queues a request; the
+ *   caller blocks on the request's wait queue until disk_intr() finishes
+ *   it.  The queue is kept in sector order and served by a C-LOOK
+ *   elevator: the next command starts at the first request at or after
+ *   where the last one ended, wrapping round to the lowest sector when
+ *   there is none, so the head sweeps one way across the disk.  Requests
+ *   for adjacent sectors are merged into one command of up to 256
+ *   sectors.  A caller about to submit several requests can plug the queue
+ *   with disk_plug() first, so the disk does not start on the first
+ *   before the rest arrive to merge with it; disk_unplug() lets it go.
+ *
+ *****************************************************************************/
+
+#define IDE_DATA	0x1F0
+#define IDE_STATUS	0x1F7
+#define IDE_CTRL	0x3F6
+#define IDE_BSY		0x80
+#define IDE_DRDY	0x40
+#define IDE_DF		0x20
+#define IDE_DRQ		0x08
+#define IDE_ERR		0x01
+#define IDE_NIEN	0x02		// in IDE_CTRL: no interrupts
+
+#define IDE_CMD_READ	0x20
+#define IDE_CMD_IDENTIFY 0xEC
+
+#define DISK_MAXCMD	256		// sectors per command
+
+static diskreq_t *disk_queue;		// waiting requests, by sector
+static diskreq_t *disk_active;		// unfinished requests in the command
+					// running; the first is being
+					// transferred
+static uint32_t disk_active_done;	// its sectors transferred so far
+static uint32_t disk_head;		// sector after the last command
+static int disk_plugged;		// nonzero: hold commands back
+
+static uint32_t disk_nsectors;		// disk size, from IDENTIFY
+static uint32_t disk_nreads;		// requests submitted
+static uint32_t disk_ncommands;		// commands they took
+
+static int
+disk_wait(void)
+{
+	uint8_t status;
+	while (((status = inb(IDE_STATUS)) & (IDE_BSY | IDE_DRDY)) != IDE_DRDY)
+		/* do nothing */;
+	return (status & (IDE_DF | IDE_ERR)) ? -1 : 0;
+}
+
+static void
+disk_command(uint32_t sect, uint32_t nsect, int cmd)
+{
+	outb(0x1F2, nsect);		// count = nsect (0 means 256)
+	outb(0x1F3, sect);
+	outb(0x1F4, sect >> 8);
+	outb(0x1F5, sect >> 16);
+	outb(0x1F6, (sect >> 24) | 0xE0);
+	outb(IDE_STATUS, cmd);
+}
+
+static void disk_drain(void);
+
+// Read 'nsect' sectors starting at sector 'sect' into 'dst'.
+// Returns 0 on success, -1 on a disk error.
+int
+disk_read(void *dst, uint32_t sect, uint32_t nsect)
+{
+	int r = 0;
+
+	// finish queued requests first, and keep the disk quiet meanwhile
+	disk_drain();
+	outb(IDE_CTRL, IDE_NIEN);
+
+	while (nsect > 0 && r == 0) {
+		uint32_t n = (nsect > DISK_MAXCMD ? DISK_MAXCMD : nsect);
+
+		if (disk_wait() < 0) {
+			r = -1;
+			break;
+		}
+		disk_command(sect, n, IDE_CMD_READ);
+
+		sect += n;
+		nsect -= n;
+		for (; n > 0; n--) {
+			if (disk_wait() < 0) {
+				r = -1;
+				break;
+			}
+			insl(IDE_DATA, dst, SECTORSIZE / 4);
+			dst = (uint8_t *) dst + SECTORSIZE;
+		}
+	}
+
+	outb(IDE_CTRL, 0);
+	return r;
+}
+
+// Find the disk's size, and let it interrupt.
+void
+disk_init(void)
+{
+	uint16_t id[SECTORSIZE / 2];
+
+	outb(IDE_CTRL, IDE_NIEN);
+	if (disk_wait() == 0) {
+		disk_command(0, 0, IDE_CMD_IDENTIFY);
+		if (disk_wait() == 0) {
+			insl(IDE_DATA, id, SECTORSIZE / 4);
+			// words 60-61: sectors addressable with 28-bit LBA
+			disk_nsectors = id[60] | ((uint32_t) id[61] << 16);
+		}
+	}
+	outb(IDE_CTRL, 0);
+	irq_enable(IRQ_DISK);
+}
+
+// Start a command for the next requests, if the disk is free.
+static void
+disk_start(void)
+{
+	diskreq_t **pp, *req;
+	uint32_t nsect;
+
+	if (disk_active || !disk_queue || disk_plugged)
+		return;
+
+	// C-LOOK: the first request at or after the head, else the first
+	for (pp = &disk_queue; *pp && (*pp)->dr_sect < disk_head;
+	     pp = &(*pp)->dr_next)
+		/* do nothing */;
+	if (!*pp)
+		pp = &disk_queue;
+
+	// take it, and the requests for the sectors right after it
+	disk_active = req = *pp;
+	nsect = req->dr_nsect;
+	while (req->dr_next
+	       && req->dr_next->dr_sect == req->dr_sect + req->dr_nsect
+	       && nsect + req->dr_next->dr_nsect <= DISK_MAXCMD) {
+		req = req->dr_next;
+		nsect += req->dr_nsect;
+	}
+	*pp = req->dr_next;
+	req->dr_next = NULL;
+
+	disk_active_done = 0;
+	disk_head = disk_active->dr_sect + nsect;
+	disk_ncommands++;
+	disk_command(disk_active->dr_sect, nsect, IDE_CMD_READ);
+}
+
+static void
+disk_finish(diskreq_t *req, int status)
+{
+	req->dr_status = status;
+	irq_waiters -= wait_wake(&req->dr_wait, -1);
+}
+
+// Queue 'req'.  The caller waits on 'req->dr_wait' while 'req->dr_status'
+// is DISK_PENDING.  Requests past the end of the disk fail at once.
+void
+disk_submit(diskreq_t *req)
+{
+	diskreq_t **pp;
+
+	disk_nreads++;
+	req->dr_wait.wq_head = req->dr_wait.wq_tail = NULL;
+	if (req->dr_nsect == 0 || req->dr_nsect > DISK_MAXCMD
+	    || req->dr_sect + req->dr_nsect > disk_nsectors
+	    || req->dr_sect + req->dr_nsect < req->dr_sect) {
+		req->dr_status = -1;
+		return;
+	}
+	req->dr_status = DISK_PENDING;
+	for (pp = &disk_queue; *pp && (*pp)->dr_sect <= req->dr_sect;
+	     pp = &(*pp)->dr_next)
+		/* do nothing */;
+	req->dr_next = *pp;
+	*pp = req;
+	disk_start();
+}
+
+// Hold submitted requests in the queue until disk_unplug().
+void
+disk_plug(void)
+{
+	disk_plugged++;
+}
+
+void
+disk_unplug(void)
+{
+	if (--disk_plugged == 0)
+		disk_start();
+}
+
+// Transfer a sector if one is ready, finishing requests as they complete.
+// Called on IRQ_DISK, with the kernel lock held.
+void
+disk_intr(void)
+{
+	uint8_t status = inb(IDE_STATUS);	// also acknowledges the disk
+	diskreq_t *req;
+
+	if (!disk_active || (status & IDE_BSY))
+		return;
+	if (status & (IDE_DF | IDE_ERR)) {
+		// fail the whole command
+		while ((req = disk_active)) {
+			disk_active = req->dr_next;
+			disk_finish(req, -1);
+		}
+		disk_start();
+		return;
+	}
+	if (!(status & IDE_DRQ))
+		return;
+
+	req = disk_active;
+	insl(IDE_DATA, req->dr_buf + disk_active_done * SECTORSIZE,
+	     SECTORSIZE / 4);
+	if (++disk_active_done < req->dr_nsect)
+		return;
+
+	disk_active = req->dr_next;
+	disk_active_done = 0;
+	disk_finish(req, 0);
+	disk_start();
+}
+
+// Finish every queued request by polling, so the loader can use the disk.
+static void
+disk_drain(void)
+{
+	while (disk_active) {
+		while (inb(IDE_STATUS) & IDE_BSY)
+			/* do nothing */;
+		disk_intr();
+	}
+}
+
+// Report the disk's size, and how many requests and commands there have
+// been, for sys_kstats().
+void
+disk_stats(kstats_t *ks)
+{
+	ks->ks_disk_sectors = disk_nsectors;
+	ks->ks_disk_reads = disk_nreads;
+	ks->ks_disk_commands = disk_ncommands;
+}
@@ -0,0 +1,218 @@
+#include "kernel.h"
+#include "lib.h"
+#include "fs.h"
+
+/*****************************************************************************
+ * k-fs.c
+ *
+ *   The read-only filesystem that build/mkbootdisk.c writes after the
+ *   applications (see fs.h).  fs_init() finds its superblock at boot;
+ *   after that every block, of the directory or of a file, is read
+ *   through the buffer cache (k-bcache.c).
+ *
+ *   A call that needs a block that is still on its way from the disk
+ *   blocks the process on the block's request, counting towards
+ *   'irq_waiters', and the process makes the call again when the disk
+ *   interrupt wakes it.  The buffer it waited for is kept in 'p_fswait',
+ *   so if the read failed the call fails, rather than read it again.
+ *   sys_read() returns what it has copied so far rather than wait partway.
+ *
+ *   There is no seek, so files are always read in order, and the blocks
+ *   after the one being read are read ahead.  Whenever fewer than
+ *   FS_READAHEAD / 2 blocks past it have been requested, the next batch
+ *   is, up to FS_READAHEAD blocks from the one being read.  The batch
+ *   goes to the disk with the queue plugged, so the driver merges it into
+ *   one command: a large file takes a few multi-block reads, not one per
+ *   block, and a process reading it steadily seldom waits.
+ *
+ *****************************************************************************/
+
+#define FS_READAHEAD		32	// blocks: 256 sectors, one disk command
+
+// An open file.
+struct fsfile {
+	struct fs_dirent ff_ent;	// its directory entry
+	uint32_t ff_pos;		// read position
+	uint32_t ff_ahead;		// first block not read ahead yet
+};
+
+static uint32_t fs_start;		// first disk block; 0 if no filesystem
+static uint32_t fs_nfiles;
+static uint32_t fs_nblocks;
+
+// Find the filesystem, if the boot disk has one.
+void
+fs_init(void)
+{
+	uint8_t sector[SECTORSIZE];
+	struct fs_superblock *sb = (struct fs_superblock *) sector;
+	uint32_t fssector;
+
+	if (disk_read(sector, 0, 1) < 0)
+		return;
+	fssector = *(uint32_t *) (sector + FS_SECTOR_OFFSET);
+	if (fssector == 0 || fssector % FS_BLOCKSECT != 0
+	    || disk_read(sector, fssector, 1) < 0 || sb->fs_magic != FS_MAGIC)
+		return;
+	fs_start = fssector / FS_BLOCKSECT;
+	fs_nfiles = sb->fs_nfiles;
+	fs_nblocks = sb->fs_nblocks;
+	bcache_init();
+}
+
+// Block the current process until 'b' has been read.
+static void
+fs_wait(buf_t *b)
+{
+	wait_block(&b->b_req.dr_wait, current, 1);
+	irq_waiters++;
+	current->p_fswait = b;
+}
+
+// Return the buffer the current process waited for, if this call is being
+// made again after fs_wait(), and forget it.
+static buf_t *
+fs_waited(void)
+{
+	buf_t *b = current->p_fswait;
+	current->p_fswait = NULL;
+	return b;
+}
+
+// Return 1 if 'e''s extents lie in the filesystem and hold 'fd_size' bytes.
+static int
+fs_dirent_ok(const struct fs_dirent *e)
+{
+	uint64_t nblocks = 0;
+	int i;
+
+	for (i = 0; i < FS_NEXTENTS; i++) {
+		const struct fs_extent *x = &e->fd_extents[i];
+		if (x->fe_block > fs_nblocks
+		    || x->fe_nblocks > fs_nblocks - x->fe_block)
+			return 0;
+		nblocks += x->fe_nblocks;
+	}
+	return e->fd_size <= nblocks * FS_BLOCKSIZE;
+}
+
+// The disk block holding block 'fblock' of the file 'e'.
+static uint32_t
+fs_bmap(const struct fs_dirent *e, uint32_t fblock)
+{
+	int i;
+
+	for (i = 0; fblock >= e->fd_extents[i].fe_nblocks; i++)
+		fblock -= e->fd_extents[i].fe_nblocks;
+	return fs_start + e->fd_extents[i].fe_block + fblock;
+}
+
+// Open the file called 'name', storing a new file_t in '*fp'.  Returns 0,
+// or -1 if there is no such file.  If the directory must be read first,
+// returns 0 with '*fp' NULL and the current process blocked.
+int
+fs_open(const char *name, file_t **fp)
+{
+	size_t namelen = strlen(name);
+	const struct fs_dirent *e = NULL;
+	struct fsfile *ff;
+	buf_t *b = NULL, *waited = fs_waited();
+	uint32_t slot;
+
+	*fp = NULL;
+	if (fs_start == 0 || namelen >= FS_NAMELEN)
+		return -1;
+
+	// entry I is in slot I + 1, after the superblock
+	for (slot = 1; slot <= fs_nfiles; slot++) {
+		if (!b || slot % FS_DIRENTS_PER_BLOCK == 0) {
+			b = bcache_read(fs_start + slot / FS_DIRENTS_PER_BLOCK,
+					waited);
+			if (!b || b->b_req.dr_status < 0)
+				return -1;
+			else if (b->b_req.dr_status == DISK_PENDING) {
+				fs_wait(b);
+				return 0;
+			}
+		}
+		e = (const struct fs_dirent *) b->b_req.dr_buf
+			+ slot % FS_DIRENTS_PER_BLOCK;
+		if (memcmp(e->fd_name, name, namelen + 1) == 0)
+			break;
+	}
+	if (slot > fs_nfiles || !fs_dirent_ok(e))
+		return -1;
+
+	if (!(ff = (struct fsfile *) kmalloc(sizeof(struct fsfile)))
+	    || !(*fp = (file_t *) kmalloc(sizeof(file_t)))) {
+		kfree(ff);
+		return -1;
+	}
+	ff->ff_ent = *e;
+	(*fp)->f_type = F_FILE;
+	(*fp)->f_refcount = 1;
+	(*fp)->f_fsfile = ff;
+	return 0;
+}
+
+// Request the blocks ahead of block 'fblock' of 'ff', which is being read,
+// if too few are on their way.
+static void
+fs_readahead(struct fsfile *ff, uint32_t fblock)
+{
+	uint32_t nblocks = (ff->ff_ent.fd_size + FS_BLOCKSIZE - 1) / FS_BLOCKSIZE;
+	uint32_t end = MIN(fblock + FS_READAHEAD, nblocks);
+
+	if (ff->ff_ahead <= fblock)
+		ff->ff_ahead = fblock + 1;
+	if (ff->ff_ahead - fblock > FS_READAHEAD / 2)
+		return;
+	for (; ff->ff_ahead < end; ff->ff_ahead++)
+		if (bcache_readahead(fs_bmap(&ff->ff_ent, ff->ff_ahead)) < 0)
+			break;
+}
+
+// Read up to 'n' bytes from 'f' into 'buf'.  Returns the number of bytes
+// read, 0 at the end of the file, or -1 on a disk error.  If the first
+// block needed is not in memory yet, returns 0 with the current process
+// blocked.
+ssize_t
+fs_read(file_t *f, uint8_t *buf, size_t n)
+{
+	struct fsfile *ff = f->f_fsfile;
+	uint32_t size = ff->ff_ent.fd_size;
+	buf_t *waited = fs_waited();
+	size_t done = 0;
+
+	while (done < n && ff->ff_pos < size) {
+		uint32_t fblock = ff->ff_pos / FS_BLOCKSIZE;
+		uint32_t off = ff->ff_pos % FS_BLOCKSIZE;
+		size_t m = MIN(MIN(FS_BLOCKSIZE - off, size - ff->ff_pos),
+			       n - done);
+		buf_t *b;
+
+		disk_plug();
+		b = bcache_read(fs_bmap(&ff->ff_ent, fblock), waited);
+		fs_readahead(ff, fblock);
+		disk_unplug();
+		waited = NULL;
+
+		if (!b || b->b_req.dr_status < 0)
+			return done ? (ssize_t) done : -1;
+		else if (b->b_req.dr_status == DISK_PENDING) {
+			if (done == 0)
+				fs_wait(b);
+			break;
+		}
+		memcpy(buf + done, b->b_req.dr_buf + off, m);
+		done += m;
+		ff->ff_pos += m;
+	}
+	return done;
+}
+
+void
+fs_close(file_t *f)
+{
+	kfree(f->f_fsfile);
+}
@@ -2,88 +2,348 @@
 #include "elf.h"
 #include "lib.h"
 #include "kernel.h"
+#include "lz4.h"
+#include "appdir.h"
 
 /*****************************************************************************
  * k-loader.c
  *
- *   Load a miniprocos application in from a RAM image.
+ *   Load a miniprocos application from the boot disk.
+ *   build/mkbootdisk.c writes the applications after the kernel, along with
+ *   a directory of their names and locations (see appdir.h).  The kernel
+ *   reads only the directory at boot, and reads an application's sectors
+ *   the first time a process runs it.
+ *   The image is either an ELF binary or an LZ4 image of one (see lz4.h).
+ *   Either way it is unpacked into the program image area.
+ *   Loading only records where each segment is.  Pages are mapped from the
+ *   image when the application first touches them (see program_fault).
+ *   Each application is linked at its own address, so up to MAXPROGRAMS of
+ *   them can be resident at once.
+ *   The rest of an application's slot, after its BSS, is its heap, which
+ *   grows and shrinks with sys_sbrk (see program_sbrk).
  *
  *   Don't worry about understanding this loader!
  *
  *****************************************************************************/
 
-#define SECTORSIZE		512
-#define PAGESIZE		4096
-
-extern uint8_t _binary_obj_p_procos_app_start[];
-extern uint8_t _binary_obj_p_procos_app_end[];
-extern uint8_t _binary_obj_p_procos_app2_start[];
-extern uint8_t _binary_obj_p_procos_app2_end[];
-extern uint8_t _binary_obj_p_procos_app3_start[];
-extern uint8_t _binary_obj_p_procos_app3_end[];
-
-struct ramimage {
-	void *begin;
-	void *end;
-} ramimages[] = {
-	{ _binary_obj_p_procos_app_start, _binary_obj_p_procos_app_end },
-	{ _binary_obj_p_procos_app2_start, _binary_obj_p_procos_app2_end },
-	{ _binary_obj_p_procos_app3_start, _binary_obj_p_procos_app3_end }
+// The application directory, read from disk by programs_init().
+static struct appdir_entry appdir[MAXPROGRAMS];
+static int nprograms;
+
+// Disk reads land here first.
+static uint8_t disk_buffer[APP_IMAGE_SIZE];
+
+// Each resident program's segments.  Their pages are mapped on demand by
+// program_fault(), straight out of the program's image.
+#define MAXSEGS			8
+
+struct loadseg {
+	uintptr_t va;		// first virtual address
+	uint32_t filesz;	// bytes from the image
+	uint32_t memsz;		// total bytes; the rest are zero (BSS)
+	const uint8_t *src;	// image data for 'va'
+	int writable;
 };
 
-static void copyseg(void *dst, const uint8_t *src,
-		    uint32_t filesz, uint32_t memsz);
+struct program {
+	int resident;		// set once the segments below are valid
+	uint32_t entry;
+	struct loadseg segs[MAXSEGS];
+	int nsegs;
+	uintptr_t heap_start;	// first heap address, just past the BSS
+	uintptr_t brk;		// end of the heap
+	uintptr_t slot_end;	// end of the program's slot; the heap's limit
+} programs[MAXPROGRAMS];
+
+static void lz4_decompress(uint8_t *dst, const uint8_t *src,
+			   const uint8_t *end);
 static void loader_panic(void);
 
-void
+// Read the application directory from disk.  Returns the number of
+// programs.
+int
+programs_init(void)
+{
+	struct appdir_header *hdr = (struct appdir_header *) disk_buffer;
+	uint32_t dirsector, dirsize;
+
+	nprograms = 0;
+	if (disk_read(disk_buffer, 0, 1) < 0)
+		loader_panic();
+	dirsector = *(uint32_t *) (disk_buffer + APPDIR_SECTOR_OFFSET);
+	if (dirsector == 0)
+		return 0;
+
+	if (disk_read(disk_buffer, dirsector, 1) < 0
+	    || hdr->ad_magic != APPDIR_MAGIC)
+		loader_panic();
+	nprograms = MIN(hdr->ad_napps, (uint32_t) MAXPROGRAMS);
+	dirsize = sizeof(*hdr) + nprograms * sizeof(struct appdir_entry);
+	if (disk_read(disk_buffer, dirsector,
+		      (dirsize + SECTORSIZE - 1) / SECTORSIZE) < 0)
+		loader_panic();
+	memcpy(appdir, hdr + 1, nprograms * sizeof(struct appdir_entry));
+	return nprograms;
+}
+
+// Return the name of program 'program_id', or NULL if there is none.
+const char *
+program_name(int program_id)
+{
+	if (program_id < 0 || program_id >= nprograms)
+		return NULL;
+	return appdir[program_id].ade_name;
+}
+
+// Make program 'program_id' resident, if it is not already, and store its
+// entry point in '*entry_point'.  Returns 0 on success, or -1 if there is
+// no such program.
+int
 program_loader(int program_id, uint32_t *entry_point)
 {
 	struct Proghdr *ph, *eph;
 	struct Elf *elf_header;
-	int nprograms = sizeof(ramimages) / sizeof(ramimages[0]);
+	struct appdir_entry *ent;
+	struct program *prog;
+	uint8_t *image;
+	int i;
 
 	if (program_id < 0 || program_id >= nprograms)
+		return -1;
+	prog = &programs[program_id];
+	if (prog->resident) {
+		*entry_point = prog->entry;
+		return 0;
+	}
+
+	// read the program's sectors
+	ent = &appdir[program_id];
+	if (ent->ade_length > APP_IMAGE_SIZE
+	    || disk_read(disk_buffer, ent->ade_sector,
+			 (ent->ade_length + SECTORSIZE - 1) / SECTORSIZE) < 0)
 		loader_panic();
 
+	// unpack it into the program's image area
+	image = (uint8_t *) APP_IMAGE_START + program_id * APP_IMAGE_SIZE;
+	if (*(uint32_t *) disk_buffer == LZ4IMAGE_MAGIC) {
+		if (*(uint32_t *) (disk_buffer + 4) > APP_IMAGE_SIZE)
+			loader_panic();
+		lz4_decompress(image, disk_buffer + LZ4IMAGE_HDRSIZE,
+			       disk_buffer + ent->ade_length);
+	} else
+		memcpy(image, disk_buffer, ent->ade_length);
+	elf_header = (struct Elf *) image;
+
 	// is this a valid ELF?
-	elf_header = (struct Elf *) ramimages[program_id].begin;
-	if (elf_header->e_magic != ELF_MAGIC)
+	if (elf_header->e_magic != ELF_MAGIC
+	    || (ent->ade_entry && ent->ade_entry != elf_header->e_entry))
 		loader_panic();
 
-	// load each program segment (ignores ph flags)
+	// record each program segment; nothing is copied yet
+	prog->nsegs = 0;
 	ph = (struct Proghdr*) ((const uint8_t *) elf_header + elf_header->e_phoff);
 	eph = ph + elf_header->e_phnum;
 	for (; ph < eph; ph++)
-		if (ph->p_type == ELF_PROG_LOAD)
-			copyseg((void *) ph->p_va,
-				(const uint8_t *) elf_header + ph->p_offset,
-				ph->p_filesz, ph->p_memsz);
+		if (ph->p_type == ELF_PROG_LOAD && ph->p_memsz > 0) {
+			struct loadseg *seg = &prog->segs[prog->nsegs++];
+			if (prog->nsegs > MAXSEGS
+			    || ph->p_va < APP_REGION_START
+			    || ph->p_va + ph->p_memsz > APP_REGION_END)
+				loader_panic();
+			seg->va = ph->p_va;
+			seg->filesz = ph->p_filesz;
+			seg->memsz = ph->p_memsz;
+			seg->src = (const uint8_t *) elf_header + ph->p_offset;
+			seg->writable = (ph->p_flags & ELF_PROG_FLAG_WRITE) != 0;
+		}
+
+	// the heap starts on the page after the last segment, and may grow
+	// to the end of the program's slot
+	if (prog->nsegs == 0)
+		loader_panic();
+	prog->slot_end = ROUNDDOWN(prog->segs[0].va, APP_SLOT_SIZE)
+		+ APP_SLOT_SIZE;
+	prog->heap_start = 0;
+	for (i = 0; i < prog->nsegs; i++)
+		prog->heap_start = MAX(prog->heap_start,
+			ROUNDUP(prog->segs[i].va + prog->segs[i].memsz, PAGESIZE));
+	if (prog->heap_start > prog->slot_end)
+		loader_panic();
+	prog->brk = prog->heap_start;
 
 	// store the entry point from the ELF header
-	*entry_point = elf_header->e_entry;
+	prog->entry = *entry_point = elf_header->e_entry;
+	prog->resident = 1;
+	return 0;
+}
+
+// Unmap every page of program 'program_id', so its globals start over
+// from the image, with an empty heap, the next time it runs.
+void
+program_reset(int program_id)
+{
+	struct program *prog;
+	uintptr_t va;
+	int i;
+
+	if (program_id < 0 || program_id >= nprograms)
+		return;
+	prog = &programs[program_id];
+	for (i = 0; prog->resident && i < prog->nsegs; i++)
+		for (va = prog->segs[i].va & ~(PAGESIZE - 1);
+		     va < prog->segs[i].va + prog->segs[i].memsz;
+		     va += PAGESIZE)
+			page_map(va, 0, 0);
+	if (prog->resident) {
+		for (va = prog->heap_start; va < prog->brk; va += PAGESIZE)
+			page_map(va, 0, 0);
+		prog->brk = prog->heap_start;
+	}
+}
+
+// Move the end of program 'program_id''s heap by 'increment' bytes.
+// Returns the old end, or -1 if the heap would shrink below its start or
+// grow past the end of the program's slot.  Heap pages are mapped, zero-
+// filled, when first touched; pages the heap shrinks away from are
+// unmapped.
+uintptr_t
+program_sbrk(int program_id, intptr_t increment)
+{
+	struct program *prog;
+	uintptr_t oldbrk, newbrk, va;
+
+	if (program_id < 0 || program_id >= nprograms
+	    || !programs[program_id].resident)
+		return (uintptr_t) -1;
+	prog = &programs[program_id];
+	oldbrk = prog->brk;
+	newbrk = oldbrk + increment;
+	if (increment >= 0 ? newbrk < oldbrk || newbrk > prog->slot_end
+	    : newbrk > oldbrk || newbrk < prog->heap_start)
+		return (uintptr_t) -1;
+
+	for (va = ROUNDUP(newbrk, PAGESIZE); va < oldbrk; va += PAGESIZE)
+		page_map(va, 0, 0);
+	prog->brk = newbrk;
+	return oldbrk;
+}
+
+// Handle a page fault at virtual address 'va' with error code 'err' by
+// mapping the page of whichever resident program covers 'va'.  Returns 1
+// if the page was mapped, 0 if the fault was a real error.
+//
+// A read-only page that comes wholly from one segment, whose image data
+// is page-aligned, is mapped in place: the page table points straight at
+// the image.  Any other page gets its own frame (the identity-mapped frame
+// at 'va'), which is zero-filled and then receives whatever image data
+// overlaps it.  So BSS pages cost nothing until they are touched.  Heap
+// pages are the same, but with no image data.
+//
+// Processes on other CPUs share these pages, so a page is filled through a
+// kernel-only mapping, and only then made accessible to applications.
+// Two CPUs can fault on the same page: the second finds it already mapped
+// once it gets the kernel lock, and just retries the access.
+int
+program_fault(uintptr_t va, uint32_t err)
+{
+	uintptr_t page = va & ~(PAGESIZE - 1);
+	struct program *prog;
+	struct loadseg *seg, *only = NULL;
+	int i, nseg = 0, writable = 0, perm;
+
+	if (page < APP_REGION_START || page >= APP_REGION_END)
+		return 0;
+	// (A fault on a stale TLB entry removes that entry, so a retry sees
+	// the current mapping.)
+	perm = page_perm(page);
+	if ((perm & PTE_U) && (!(err & PFERR_WRITE) || (perm & PTE_W)))
+		return 1;
+	if (err & PFERR_PRESENT)
+		return 0;
+
+	for (prog = programs; prog < programs + nprograms; prog++) {
+		for (i = 0; prog->resident && i < prog->nsegs; i++) {
+			seg = &prog->segs[i];
+			if (seg->va < page + PAGESIZE
+			    && seg->va + seg->memsz > page) {
+				only = seg;
+				nseg++;
+				writable |= seg->writable;
+			}
+		}
+		if (nseg > 0)
+			break;
+		if (prog->resident && page >= prog->heap_start
+		    && page < prog->brk) {
+			page_map(page, page, PTE_P | PTE_W);
+			memset((void *) page, 0, PAGESIZE);
+			page_map(page, page, PTE_P | PTE_W | PTE_U);
+			return 1;
+		}
+	}
+	if (nseg == 0)
+		return 0;
+
+	if (nseg == 1 && !writable
+	    && ((uintptr_t) only->src - only->va) % PAGESIZE == 0
+	    && only->va + only->filesz >= MIN(only->va + only->memsz,
+					       page + PAGESIZE)) {
+		page_map(page, (uintptr_t) only->src + (page - only->va),
+			 PTE_P | PTE_U);
+		return 1;
+	}
+
+	page_map(page, page, PTE_P | PTE_W);
+	memset((void *) page, 0, PAGESIZE);
+	for (i = 0; i < prog->nsegs; i++) {
+		uintptr_t start, end;
+		seg = &prog->segs[i];
+		start = MAX(seg->va, page);
+		end = MIN(seg->va + seg->filesz, page + PAGESIZE);
+		if (start < end)
+			memcpy((void *) start, seg->src + (start - seg->va),
+			       end - start);
+	}
+	page_map(page, page, PTE_P | PTE_U | (writable ? PTE_W : 0));
+	return 1;
 }
 
-// Copy 'filesz' bytes starting at address 'data' into virtual address 'dst',
-// then clear the memory from 'va+filesz' up to 'va+memsz' (set it to 0).
+// Decompress the LZ4 block that runs from 'src' to 'end' into 'dst'.
 static void
-copyseg(void *dst, const uint8_t *src, uint32_t filesz, uint32_t memsz)
+lz4_decompress(uint8_t *dst, const uint8_t *src, const uint8_t *end)
 {
-	uint32_t va = (uint32_t) dst;
-	uint32_t end_va = va + filesz;
-	memsz += va;
-	va &= ~(PAGESIZE - 1);		// round to page boundary
+	while (1) {
+		uint32_t token = *src++;
+		uint32_t len = token >> 4;
+		const uint8_t *match;
 
-	// copy data
-	memcpy((uint8_t *) va, src, end_va - va);
+		// literals
+		if (len == 15)
+			do {
+				len += *src;
+			} while (*src++ == 255);
+		memcpy(dst, src, len);
+		dst += len;
+		src += len;
+		if (src >= end)
+			return;
 
-	// clear bss segment
-	while (end_va < memsz)
-		*((uint8_t *) end_va++) = 0;
+		// match; may overlap the bytes it produces, so copy forward
+		match = dst - (src[0] | (src[1] << 8));
+		src += 2;
+		len = token & 15;
+		if (len == 15)
+			do {
+				len += *src;
+			} while (*src++ == 255);
+		for (len += 4; len > 0; len--)
+			*dst++ = *match++;
+	}
 }
 
 static void
 loader_panic(void)
 {
 	*((uint16_t *) 0xB8000) = '!' | 0x700;
-    loop: goto loop;
+	halt();
 }
@@ -0,0 +1,155 @@
+#include "x86.h"
+#include "lib.h"
+#include "kernel.h"
+
+/*****************************************************************************
+ * k-pipe.c
+ *
+ *   Pipes.  A pipe is a PIPE_SIZE-byte ring buffer, made of page frames
+ *   from page_alloc(), with one open file for each end.  'rpos' and 'wpos'
+ *   count every byte ever read and written, so the pipe holds
+ *   'wpos - rpos' bytes, starting at offset 'rpos % PIPE_SIZE'.
+ *
+ *   A read copies out as many bytes as are there, up to the amount asked
+ *   for; a write copies in as many as fit.  Reading an empty pipe, or
+ *   writing a full one, blocks the process on the pipe's wait queue until
+ *   the other end makes progress.  Then the system call starts over.
+ *   Reading an empty pipe whose write end is closed returns 0 (end of
+ *   file), and writing a pipe whose read end is closed returns -1.
+ *
+ *****************************************************************************/
+
+#define PIPE_PAGES		4
+#define PIPE_SIZE		(PIPE_PAGES * PAGESIZE)
+
+struct pipe {
+	uint8_t *pages[PIPE_PAGES];
+	uint32_t rpos;			// bytes read so far
+	uint32_t wpos;			// bytes written so far
+	int rclosed;			// set when the read end closes
+	int wclosed;			// set when the write end closes
+	waitqueue_t readq;		// readers waiting for data
+	waitqueue_t writeq;		// writers waiting for space
+};
+
+static void
+pipe_free(struct pipe *p)
+{
+	int i;
+	for (i = 0; i < PIPE_PAGES; i++)
+		if (p->pages[i])
+			page_free(p->pages[i]);
+	kfree(p);
+}
+
+// Create a pipe, and store its read and write ends in '*readf' and
+// '*writef'.  Returns 0 on success, -1 if the kernel is out of memory.
+int
+pipe_open(file_t **readf, file_t **writef)
+{
+	struct pipe *p = (struct pipe *) kmalloc(sizeof(struct pipe));
+	int i;
+
+	*readf = *writef = NULL;
+	if (!p)
+		return -1;
+	for (i = 0; i < PIPE_PAGES; i++)
+		if (!(p->pages[i] = (uint8_t *) page_alloc()))
+			goto fail;
+	if (!(*readf = (file_t *) kmalloc(sizeof(file_t)))
+	    || !(*writef = (file_t *) kmalloc(sizeof(file_t))))
+		goto fail;
+
+	(*readf)->f_type = F_PIPE_READ;
+	(*writef)->f_type = F_PIPE_WRITE;
+	(*readf)->f_refcount = (*writef)->f_refcount = 1;
+	(*readf)->f_pipe = (*writef)->f_pipe = p;
+	return 0;
+
+ fail:
+	kfree(*readf);
+	*readf = NULL;
+	pipe_free(p);
+	return -1;
+}
+
+// Copy 'n' bytes between 'buf' and the ring buffer at position 'pos', a
+// page at a time.
+static void
+pipe_copy(struct pipe *p, uint32_t pos, uint8_t *buf, size_t n, int in)
+{
+	while (n > 0) {
+		uint32_t off = pos % PIPE_SIZE;
+		uint8_t *data = p->pages[off / PAGESIZE] + off % PAGESIZE;
+		size_t chunk = MIN(n, PAGESIZE - off % PAGESIZE);
+		if (in)
+			memcpy(data, buf, chunk);
+		else
+			memcpy(buf, data, chunk);
+		pos += chunk;
+		buf += chunk;
+		n -= chunk;
+	}
+}
+
+ssize_t
+pipe_read(file_t *f, uint8_t *buf, size_t n)
+{
+	struct pipe *p = f->f_pipe;
+	size_t avail = p->wpos - p->rpos;
+
+	if (n == 0)
+		return 0;
+	if (avail == 0) {
+		if (!p->wclosed)
+			wait_block(&p->readq, current, 1);
+		return 0;
+	}
+
+	n = MIN(n, avail);
+	pipe_copy(p, p->rpos, buf, n, 0);
+	p->rpos += n;
+	wait_wake(&p->writeq, -1);
+	return n;
+}
+
+ssize_t
+pipe_write(file_t *f, const uint8_t *buf, size_t n)
+{
+	struct pipe *p = f->f_pipe;
+	size_t space = PIPE_SIZE - (p->wpos - p->rpos);
+
+	if (p->rclosed)
+		return -1;
+	if (n == 0)
+		return 0;
+	if (space == 0) {
+		wait_block(&p->writeq, current, 1);
+		return 0;
+	}
+
+	n = MIN(n, space);
+	pipe_copy(p, p->wpos, (uint8_t *) buf, n, 1);
+	p->wpos += n;
+	wait_wake(&p->readq, -1);
+	return n;
+}
+
+// Close one end of a pipe, once no file descriptor refers to it.  Blocked
+// processes at the other end wake up to see end of file (or an error).
+// The pipe is freed when both ends are closed.
+void
+pipe_close(file_t *f)
+{
+	struct pipe *p = f->f_pipe;
+
+	if (f->f_type == F_PIPE_READ) {
+		p->rclosed = 1;
+		wait_wake(&p->writeq, -1);
+	} else {
+		p->wclosed = 1;
+		wait_wake(&p->readq, -1);
+	}
+	if (p->rclosed && p->wclosed)
+		pipe_free(p);
+}
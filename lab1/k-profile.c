@@ -0,0 +1,187 @@
+#include "x86.h"
+#include "lib.h"
+#include "kernel.h"
+
+/*****************************************************************************
+ * k-profile.c
+ *
+ *   A sampling profiler, built in with 'make PROFILE=1'.  TIMER_HZ times a
+ *   second, every CPU records where it was interrupted: the instruction
+ *   pointer, the process, whether it was in the kernel or an application,
+ *   and up to PROFILE_DEPTH return addresses found by following the saved
+ *   %ebp chain (profiled builds keep frame pointers).  The boot CPU samples
+ *   on the interval timer's interrupt; the others program their local
+ *   APIC timers to send INT_PROFILE.
+ *
+ *   Each CPU has its own sample buffer, so sampling takes no lock.  The
+ *   buffer holds PROFILE_NSAMPLES samples, about 2 seconds' worth, but a
+ *   run can last much longer.  So when it fills, every other sample is
+ *   dropped, and from then on the CPU keeps only every other tick's
+ *   sample: its stride doubles.  The buffer always covers the whole run,
+ *   evenly, with each sample standing for 'stride' ticks.  When the
+ *   system shuts down or halts, even on a kernel fault, profile_dump()
+ *   writes the samples to log.txt, once, one per line, after a line
+ *   giving each CPU's stride:
+ *
+ *	STRIDE <cpu> <ticks per sample>
+ *	P <cpu> <pid> <k|u> <eip> <return address>...
+ *
+ *   with numbers in hex, between "PROFILE BEGIN" and "PROFILE END" lines.
+ *   build/symbolize.pl turns that into a flat profile or folded stacks
+ *   (see 'make profile'), weighting each sample by its CPU's stride.
+ *
+ *   The kernel runs with interrupts off except while idle, so kernel
+ *   samples show idle time; a system call's time is charged to the
+ *   application instruction after it.
+ *
+ *****************************************************************************/
+
+#ifdef PROFILE
+
+#define PROFILE_NSAMPLES	2048	// per CPU
+#define PROFILE_DEPTH		6
+
+typedef struct profile_sample {
+	uint32_t ps_eip;
+	uint16_t ps_pid;		// 0 if no process was running
+	uint8_t ps_kernel;		// 1 if the kernel was interrupted
+	uint8_t ps_depth;		// return addresses in 'ps_stack'
+	uint32_t ps_stack[PROFILE_DEPTH];
+} profile_sample_t;
+
+static profile_sample_t profile_samples[NCPU][PROFILE_NSAMPLES];
+static uint32_t profile_nsamples[NCPU];
+static uint32_t profile_ticks[NCPU];	// sampling interrupts so far
+static uint32_t profile_shift[NCPU];	// log2 of the stride
+
+// Follow the frame pointer chain from 'ebp', which must stay within the
+// stack from 'lo' to 'hi' and move up it, and collect return addresses.
+static int
+profile_backtrace(uintptr_t ebp, uintptr_t lo, uintptr_t hi,
+		  uint32_t *stack)
+{
+	int n = 0;
+	while (n < PROFILE_DEPTH && ebp >= lo && ebp + 8 <= hi
+	       && (ebp & 3) == 0) {
+		uint32_t *frame = (uint32_t *) ebp;
+		stack[n++] = frame[1];
+		if (frame[0] <= ebp)
+			break;
+		ebp = frame[0];
+	}
+	return n;
+}
+
+#endif
+
+// Start sampling on this CPU.  Called once by every CPU but the boot CPU,
+// which samples on the interval timer.
+void
+profile_init(void)
+{
+#ifdef PROFILE
+	lapic_timer_start(TIMER_HZ, INT_PROFILE);
+#endif
+}
+
+// Record a sample for the interrupted registers 'reg'.
+void
+profile_sample(registers_t *reg)
+{
+#ifdef PROFILE
+	cpu_t *c = this_cpu();
+	process_t *proc = c->c_current;
+	profile_sample_t *samples = profile_samples[c->c_id];
+	profile_sample_t *ps;
+	uintptr_t top;
+	uint32_t i;
+
+	if (profile_ticks[c->c_id]++ & ((1U << profile_shift[c->c_id]) - 1))
+		return;
+	if (profile_nsamples[c->c_id] == PROFILE_NSAMPLES) {
+		// Keep the samples from ticks that are multiples of the new
+		// stride.  This tick is one too, since the buffer size is even.
+		for (i = 0; i < PROFILE_NSAMPLES / 2; i++)
+			samples[i] = samples[2 * i];
+		profile_nsamples[c->c_id] = PROFILE_NSAMPLES / 2;
+		profile_shift[c->c_id]++;
+	}
+	ps = &samples[profile_nsamples[c->c_id]++];
+	ps->ps_eip = reg->reg_eip;
+	ps->ps_kernel = (reg->reg_cs & 3) == 0;
+	ps->ps_pid = proc ? proc->p_pid : 0;
+	if (ps->ps_kernel) {
+		top = KERNEL_STACK_TOP - c->c_id * KERNEL_STACK_SLOT;
+		ps->ps_depth = profile_backtrace(reg->reg_ebp,
+			top - KERNEL_STACK_SIZE, top, ps->ps_stack);
+	} else {
+		top = PROC_STACK_TOP(proc->p_pid);
+		ps->ps_depth = profile_backtrace(reg->reg_ebp,
+			top - proc->p_stack_pages * PAGESIZE, top,
+			ps->ps_stack);
+	}
+#endif
+}
+
+#ifdef PROFILE
+
+static char *
+profile_hex(char *buf, uint32_t x)
+{
+	int shift;
+	*buf++ = ' ';
+	for (shift = 28; shift > 0 && !(x >> shift); shift -= 4)
+		/* skip leading zeros */;
+	for (; shift >= 0; shift -= 4)
+		*buf++ = "0123456789abcdef"[(x >> shift) & 15];
+	return buf;
+}
+
+static void
+profile_puts(const char *s)
+{
+	log_write(s, strlen(s));
+}
+
+#endif
+
+// Write every CPU's samples to log.txt, the first time it is called.
+// Called by shutdown() and halt().
+void
+profile_dump(void)
+{
+#ifdef PROFILE
+	static volatile int dumped;
+	char line[16 + 9 * (PROFILE_DEPTH + 4)], *p;
+	uint32_t i;
+	int cpu, j;
+
+	// shutdown() calls halt(), and a CPU can halt while another dumps
+	if (atomic_xchg(&dumped, 1))
+		return;
+	profile_puts("PROFILE BEGIN\n");
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		p = line;
+		memcpy(p, "STRIDE", 6);
+		p = profile_hex(p + 6, cpu);
+		p = profile_hex(p, 1U << profile_shift[cpu]);
+		*p++ = '\n';
+		log_write(line, p - line);
+		for (i = 0; i < profile_nsamples[cpu]; i++) {
+			profile_sample_t *ps = &profile_samples[cpu][i];
+			p = line;
+			*p++ = 'P';
+			p = profile_hex(p, cpu);
+			p = profile_hex(p, ps->ps_pid);
+			*p++ = ' ';
+			*p++ = ps->ps_kernel ? 'k' : 'u';
+			p = profile_hex(p, ps->ps_eip);
+			for (j = 0; j < ps->ps_depth; j++)
+				p = profile_hex(p, ps->ps_stack[j]);
+			*p++ = '\n';
+			log_write(line, p - line);
+		}
+	}
+	profile_puts("PROFILE END\n");
+#endif
+}
@@ -0,0 +1,233 @@
+#include "x86.h"
+#include "lib.h"
+#include "kernel.h"
+
+/*****************************************************************************
+ * k-smp.c
+ *
+ *   Multiprocessor support.  At boot, smp_init() finds the machine's CPUs
+ *   in the BIOS's MultiProcessor Specification tables, and starts every
+ *   CPU but the boot CPU.  Each CPU gets its own cpu_t (see kernel.h): its
+ *   own kernel stack, segment table and task state, current process, and
+ *   run queue.  CPUs that run out of work steal it from the others (see
+ *   schedule() in kernel.c).
+ *
+ *   Applications run in parallel, but most of the kernel runs on one CPU
+ *   at a time: entries to the kernel take the kernel lock, and run()
+ *   releases it.  The scheduler's run queues have their own locks, and
+ *   the process table has 'proc_lock' (see kernel.c), so a CPU can pick
+ *   its next process and switch to it without the kernel lock, and the
+ *   system calls that need nothing else (sys_getpid, sys_yield and
+ *   sys_yield_to) never take it.  An idle CPU halts until another CPU
+ *   sends it INT_IPI_WAKEUP to say there is work to steal.
+ *
+ *   If there are no MP tables, the kernel runs on the boot CPU alone.  It
+ *   does not read ACPI's MADT, which lists the same CPUs; the BIOSes it
+ *   runs under (QEMU's SeaBIOS, Bochs) provide both.
+ *
+ *****************************************************************************/
+
+cpu_t cpus[NCPU];
+int ncpus = 1;
+
+static spinlock_t kernel_spinlock = SPINLOCK_INIT;
+
+void
+kernel_lock(void)
+{
+	spin_lock(&kernel_spinlock);
+	this_cpu()->c_locked = 1;
+}
+
+void
+kernel_unlock(void)
+{
+	this_cpu()->c_locked = 0;
+	spin_unlock(&kernel_spinlock);
+}
+
+
+// MP floating pointer structure: where the BIOS says its configuration
+// table is.
+struct mp_fptr {
+	char mf_signature[4];		// "_MP_"
+	uint32_t mf_config;		// configuration table address
+	uint8_t mf_length;		// in 16-byte units
+	uint8_t mf_specrev;
+	uint8_t mf_checksum;		// all bytes add up to 0
+	uint8_t mf_type;		// nonzero for a default configuration
+	uint8_t mf_features[4];
+};
+
+// MP configuration table header, followed by its entries
+struct mp_config {
+	char mc_signature[4];		// "PCMP"
+	uint16_t mc_length;
+	uint8_t mc_specrev;
+	uint8_t mc_checksum;		// all bytes add up to 0
+	char mc_product[20];
+	uint32_t mc_oemtable;
+	uint16_t mc_oemlength;
+	uint16_t mc_nentries;
+	uint32_t mc_lapic;		// local APIC address
+	uint16_t mc_xlength;
+	uint8_t mc_xchecksum;
+	uint8_t mc_reserved;
+};
+
+// Processor entry; every other kind of entry is 8 bytes long
+#define MP_PROC			0
+struct mp_proc {
+	uint8_t mp_type;		// MP_PROC
+	uint8_t mp_apicid;
+	uint8_t mp_version;
+	uint8_t mp_flags;
+#define MP_PROC_ENABLED		0x01
+#define MP_PROC_BSP		0x02
+	uint8_t mp_signature[4];
+	uint32_t mp_features;
+	uint8_t mp_reserved[8];
+};
+
+static uint8_t
+mp_sum(const void *addr, size_t len)
+{
+	const uint8_t *p = (const uint8_t *) addr;
+	uint8_t sum = 0;
+	while (len-- > 0)
+		sum += *p++;
+	return sum;
+}
+
+static struct mp_fptr *
+mp_search_range(uintptr_t addr, size_t len)
+{
+	struct mp_fptr *mf;
+	for (mf = (struct mp_fptr *) addr;
+	     (uintptr_t) (mf + 1) <= addr + len; mf++)
+		if (memcmp(mf->mf_signature, "_MP_", 4) == 0
+		    && mp_sum(mf, sizeof(*mf)) == 0)
+			return mf;
+	return NULL;
+}
+
+// Find the MP configuration table.  The floating pointer is in the first
+// KB of the extended BIOS data area, or the last KB of base memory, or the
+// BIOS ROM.
+static struct mp_config *
+mp_config(void)
+{
+	uint16_t ebda = *(uint16_t *) 0x40E;
+	uint16_t basekb = *(uint16_t *) 0x413;
+	struct mp_fptr *mf = NULL;
+	struct mp_config *mc;
+
+	if (ebda)
+		mf = mp_search_range(ebda << 4, 1024);
+	if (!mf && basekb)
+		mf = mp_search_range(basekb * 1024 - 1024, 1024);
+	if (!mf)
+		mf = mp_search_range(0xF0000, 0x10000);
+	if (!mf || mf->mf_config == 0 || mf->mf_type != 0)
+		return NULL;
+
+	mc = (struct mp_config *) mf->mf_config;
+	if (memcmp(mc->mc_signature, "PCMP", 4) != 0
+	    || (mc->mc_specrev != 1 && mc->mc_specrev != 4)
+	    || mp_sum(mc, mc->mc_length) != 0)
+		return NULL;
+	return mc;
+}
+
+
+/*****************************************************************************
+ * smp_init
+ *
+ *   Find the other CPUs and start them.  The boot CPU calls this once,
+ *   holding the kernel lock, when the first process is ready to run: the
+ *   other CPUs go straight to the scheduler, which must have something
+ *   to find.
+ *
+ *****************************************************************************/
+
+extern uint8_t ap_boot_start[], ap_boot_end[];
+extern uint32_t ap_boot_cr3, ap_boot_esp, ap_boot_entry;
+static void ap_start(void) __attribute__((noreturn));
+
+// The AP boot code's parameter words, in its copy at AP_BOOT_ADDR
+#define AP_BOOT_PARAM(sym) \
+	(*(uint32_t *) (AP_BOOT_ADDR + ((uint8_t *) &(sym) - ap_boot_start)))
+
+void
+smp_init(void)
+{
+	struct mp_config *mc = mp_config();
+	uint8_t *entry, *end;
+	int i, bsp_apicid;
+	uint64_t deadline;
+
+	if (!mc)
+		return;
+	lapic_map(mc->mc_lapic);
+	lapic_init(1);
+	bsp_apicid = lapic_id();
+	cpus[0].c_apicid = bsp_apicid;
+
+	// The boot CPU is always CPU 0, since it is already running on
+	// CPU 0's kernel stack.  Number the others in table order.
+	entry = (uint8_t *) (mc + 1);
+	end = (uint8_t *) mc + mc->mc_length;
+	while (entry < end) {
+		struct mp_proc *mp = (struct mp_proc *) entry;
+		if (mp->mp_type != MP_PROC) {
+			entry += 8;
+			continue;
+		}
+		if ((mp->mp_flags & MP_PROC_ENABLED)
+		    && mp->mp_apicid != bsp_apicid && ncpus < NCPU) {
+			cpus[ncpus].c_id = ncpus;
+			cpus[ncpus].c_apicid = mp->mp_apicid;
+			ncpus++;
+		}
+		entry += sizeof(struct mp_proc);
+	}
+
+	// Start the others one at a time, since they share the boot code's
+	// parameters.  If a CPU does not come up within 100 ms, it and the
+	// rest are left out.
+	memcpy((void *) AP_BOOT_ADDR, ap_boot_start,
+	       ap_boot_end - ap_boot_start);
+	for (i = 1; i < ncpus; i++) {
+		AP_BOOT_PARAM(ap_boot_cr3) = (uint32_t) rcr3();
+		AP_BOOT_PARAM(ap_boot_esp) = KERNEL_STACK_TOP
+			- i * KERNEL_STACK_SLOT;
+		AP_BOOT_PARAM(ap_boot_entry) = (uint32_t) ap_start;
+		lapic_start_ap(cpus[i].c_apicid, AP_BOOT_ADDR);
+		deadline = read_cycle_counter() + (uint64_t) tsc_khz * 100;
+		while (!cpus[i].c_started
+		       && read_cycle_counter() < deadline)
+			asm volatile("pause");
+		if (!cpus[i].c_started) {
+			cursorpos = console_printf(cursorpos, 0x0C00,
+				"CPU %d (APIC %d) did not start!\n",
+				i, cpus[i].c_apicid);
+			ncpus = i;
+			break;
+		}
+	}
+}
+
+// Each AP starts here, on its own kernel stack, with paging on and
+// interrupts off.  It sets up its own segments and local APIC, then looks
+// for work.
+static void
+ap_start(void)
+{
+	cpu_t *c = this_cpu();
+
+	segments_init(c->c_id);
+	lapic_init(0);
+	profile_init();
+	c->c_started = 1;
+	schedule();
+}
@@ -0,0 +1,103 @@
+#include "x86.h"
+#include "lib.h"
+#include "kernel.h"
+
+/*****************************************************************************
+ * k-timer.c
+ *
+ *   Sleeping.  The interval timer interrupts TIMER_HZ times a second, and
+ *   'timer_ticks' counts the interrupts.  A process that calls sys_sleep
+ *   blocks until a given tick, on a hierarchical timer wheel: TIMER_LEVELS
+ *   wheels of TIMER_SLOTS slots each, every slot a wait queue.
+ *
+ *   Wheel 0 holds processes that wake within TIMER_SLOTS ticks, one slot
+ *   per tick.  Each slot of wheel 1 covers TIMER_SLOTS ticks, each slot of
+ *   wheel 2 covers TIMER_SLOTS^2 ticks, and so on.  Inserting a sleeper
+ *   picks its wheel from how far off its wakeup is, and its slot from the
+ *   wakeup tick's bits for that wheel: constant time.  Every tick wakes the
+ *   whole current slot of wheel 0.  Whenever wheel 0 comes round to slot
+ *   0, the next slot of wheel 1 is "cascaded": its sleepers are re-inserted,
+ *   now landing on wheel 0; wheel 1 coming round cascades wheel 2, and so
+ *   on.  Each sleeper is moved at most once per wheel, so a tick costs a
+ *   constant amount of work on average however many processes sleep, and a
+ *   timer tick with no sleepers due touches one empty slot.
+ *
+ *   Sleepers block until a hardware interrupt wakes them, so they count
+ *   towards 'irq_waiters'.
+ *
+ *****************************************************************************/
+
+#define TIMER_BITS		6
+#define TIMER_SLOTS		(1 << TIMER_BITS)
+#define TIMER_LEVELS		4
+// Sleeps longer than this many ticks (about 4.6 hours) are cut short.
+#define TIMER_MAXDELAY		((1U << (TIMER_BITS * TIMER_LEVELS)) - 1)
+
+uint32_t timer_ticks;			// next tick to process
+
+static waitqueue_t timer_wheel[TIMER_LEVELS][TIMER_SLOTS];
+
+// The slot of wheel 'level' that tick 't' falls into.
+#define TIMER_SLOT(t, level) \
+	(((t) >> (TIMER_BITS * (level))) & (TIMER_SLOTS - 1))
+
+static void
+timer_insert(process_t *proc)
+{
+	uint32_t delay = proc->p_wakeup - timer_ticks;
+	int level;
+
+	// A wakeup that is already due goes in the slot processed next.
+	if ((int32_t) delay < 0) {
+		wait_block(&timer_wheel[0][TIMER_SLOT(timer_ticks, 0)],
+			   proc, 0);
+		return;
+	}
+	for (level = 0; level < TIMER_LEVELS - 1; level++)
+		if (delay < (1U << (TIMER_BITS * (level + 1))))
+			break;
+	wait_block(&timer_wheel[level][TIMER_SLOT(proc->p_wakeup, level)],
+		   proc, 0);
+}
+
+// Re-insert every sleeper in slot 'slot' of wheel 'level'.  Returns 'slot',
+// so the caller knows whether this wheel has come round too.
+static int
+timer_cascade(int level, int slot)
+{
+	waitqueue_t *wq = &timer_wheel[level][slot];
+	process_t *proc = wq->wq_head;
+
+	wq->wq_head = wq->wq_tail = NULL;
+	while (proc) {
+		process_t *next = proc->p_wait_next;
+		timer_insert(proc);
+		proc = next;
+	}
+	return slot;
+}
+
+// Block 'proc' for 'ticks' timer ticks.  It wakes on the first interrupt
+// at least 'ticks' full ticks from now.
+void
+timer_sleep(process_t *proc, uint32_t ticks)
+{
+	proc->p_wakeup = timer_ticks + MIN(ticks, TIMER_MAXDELAY);
+	timer_insert(proc);
+	irq_waiters++;
+}
+
+// Called on every timer interrupt.
+void
+timer_tick(void)
+{
+	int level, slot = TIMER_SLOT(timer_ticks, 0);
+
+	if (slot == 0)
+		for (level = 1; level < TIMER_LEVELS; level++)
+			if (timer_cascade(level, TIMER_SLOT(timer_ticks, level)))
+				break;
+
+	irq_waiters -= wait_wake(&timer_wheel[0][slot], -1);
+	timer_ticks++;
+}
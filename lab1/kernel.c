@@ -1,6 +1,7 @@
 #include "kernel.h"
 #include "x86.h"
 #include "lib.h"
+#include "fs.h"
 
 /*****************************************************************************
  * kernel
@@ -12,14 +13,23 @@
  *****************************************************************************/
 
 // The kernel is loaded starting at 0x100000.
-// The miniprocos applications are also available in RAM in packed form.
-// The kernel loads one of those applications into memory starting at 0x200000.
-// It also allocates 1/4 MB for each possible miniprocess's stack, starting at
-// 0x280000.
-// Each process's stack grows down from the top of its stack space.
-
-#define PROC1_STACK_ADDR	0x280000
-#define PROC_STACK_SIZE		0x040000
+// The miniprocos applications are on the boot disk, after the kernel.
+// Each application is linked at its own address, one APP_SLOT_SIZE (1 MB)
+// slot per application starting at APP_REGION_START (0x1000000), so several
+// applications can be resident at once.  The kernel reads an application
+// from disk and unpacks it into the program image area (starting at
+// 0x800000) the first time a process runs it.  (Paging is on, but virtual
+// addresses equal physical addresses.  An application's pages are mapped
+// one by one, from its unpacked image, when it first touches them.)
+// Each possible miniprocess has a 1/4 MB slot of virtual addresses for its
+// stack, starting at STACK_REGION_START (0x2000000), just past physical
+// memory.  A stack starts out with one page of memory and grows down from
+// the top of its slot, a page at a time, as the process touches the
+// unmapped guard page below it -- up to the process's stack limit, which
+// its parent chooses at fork time (see sys_fork_stack).
+// The rest of memory below the application region, apart from the program
+// images, holds page frames for the kernel's allocators (see k-alloc.c),
+// including the pages that back process stacks.
 
 // MINIPROCOS MEMORY MAP
 //
@@ -29,30 +39,51 @@
 // +--------------------------+--------------+----------------------------+-/
 // 0                       0xA0000       0x100000                     0x200000
 //
-//         /-+----------------+------------+------------+------------+---/
-//           |   Application  | Miniproc 1 | Miniproc 2 | Miniproc 3 |
-//           | Code + Globals |      Stack |      Stack |      Stack |
-//         /-+----------------+------------+------------+------------+---/
-//       0x200000         0x280000     0x2C0000     0x300000     0x340000
-//                            |            |            |
-//                    PROC1_STACK_ADDR     |     PROC1_STACK_ADDR
-//                                         |    + 2*PROC_STACK_SIZE
-//                                         |
-//                                  PROC1_STACK_ADDR
-//                                 + PROC_STACK_SIZE
+//       /-+-------------+-------------+-------------+-------------+---/
+//         | Page frames |   Program   | Page frames | Application |
+//         |             |   Images    |             |   slots     |
+//       /-+-------------+-------------+-------------+-------------+---/
+//     0x200000      0x800000      0xA00000     0x1000000     0x2000000
+//                                                  |
+//                                           APP_REGION_START
+//
+//    /-+------------+------------+---/   /---+-------------+----------+
+//      | Miniproc 1 | Miniproc 2 |   ...     | Miniproc 63 | (unused) |
+//      |      Stack |      Stack |           |       Stack |          |
+//    /-+------------+------------+---/   /---+-------------+----------+
+//   0x2000000    0x2040000    0x2080000              0x2FC0000    0x3000000
+//      |            |            |                       |            |
+//      |    PROC_STACK_TOP(1)    |             PROC_STACK_TOP(63)     |
+// STACK_REGION_START      PROC_STACK_TOP(2)                   MEMSIZE_VIRTUAL
+//
+// Each CPU has an 8 KB kernel stack, all in base memory just below
+// KERNEL_STACK_TOP (0x80000): the boot CPU's on top, then CPU 1's, and so
+// on, with an unmapped guard page below each one.  Other CPUs start
+// running at AP_BOOT_ADDR (0x7000), where the boot CPU copies their
+// real-mode startup code (see k-smp.c).
 //
 // There is also a shared 'cursorpos' variable, located at 0x60000 in the
 // kernel's data area.  (This is used by 'app_printf' in process.h.)
 
 
-// A process descriptor for each possible miniprocess.
+// A process descriptor pointer for each possible miniprocess.
+// Descriptors are allocated from the kernel's slab allocator (k-alloc.c)
+// when a process is created, and freed when it is reaped; empty slots are
+// NULL.
 // Note that proc_array[0] is never used.
 // The main application process descriptor is proc_array[1].
-static process_t proc_array[NPROCS];
+// Slots are filled and emptied with both the kernel lock and 'proc_lock'
+// held, so holding either one is enough to look a process up.  System
+// calls that run without the kernel lock (see interrupt()) take
+// 'proc_lock'.
+static process_t *proc_array[NPROCS];
+static spinlock_t proc_lock = SPINLOCK_INIT;
 
-// A pointer to the currently running process.
+// Each CPU's currently running process is 'current' (see kernel.h).
 // This is kept up to date by the run() function, in x86.c.
-process_t *current;
+
+// The number of blocked processes waiting on a hardware interrupt.
+int irq_waiters;
 
 
 
@@ -64,52 +95,92 @@ process_t *current;
  *
  *****************************************************************************/
 
+static process_t *proc_new(pid_t pid);
+static int stack_commit(process_t *proc, uint32_t npages);
+
+// The key that picks program 'i' from the boot menu.
+static int
+menu_key(int i)
+{
+	if (i < 10)
+		return '0' + (i + 1) % 10;
+	return 'a' + i - 10;
+}
+
 void
 start(void)
 {
-	const char *s;
-	int whichprocess;
-	pid_t i;
+	int whichprocess, nprograms, key, i;
+
+	// The boot CPU is CPU 0.  It holds the kernel lock until it first
+	// runs a process.
+	kernel_lock();
+	cpus[0].c_started = 1;
 
-	// Initialize process descriptors as empty
+	// Set up the kernel's memory allocators, and initialize process
+	// descriptors as empty.
+	kalloc_init();
 	memset(proc_array, 0, sizeof(proc_array));
-	for (i = 0; i < NPROCS; i++) {
-		proc_array[i].p_pid = i;
-		proc_array[i].p_state = P_EMPTY;
-	}
 
 	// The first process has process ID 1.
-	current = &proc_array[1];
+	current = proc_new(1);
 
 	// Set up x86 hardware, and initialize the first process's
 	// special registers.  This only needs to be done once, at boot time.
 	// All other processes' special registers can be copied from the
 	// first process.
-	segments_init();
+	segments_init(0);
+	paging_init();
+	interrupt_controller_init();
+	tsc_calibrate();
+	timer_init(TIMER_HZ);
+	disk_init();
+	fs_init();
 	special_registers_init(current);
 
 	// Erase the console, and initialize the cursor-position shared
 	// variable to point to its upper left.
 	console_clear();
 
-	// Figure out which program to run.
-	cursorpos = console_printf(cursorpos, 0x0700, "Type '1' to run procos-app,'2' for procos-app2, '3' for procos-app3.");
+	// Figure out which program to run.  The programs are listed in the
+	// application directory on disk; digit '1' picks the first, '0' the
+	// tenth, and letters 'a', 'b', ... any more.
+	nprograms = programs_init();
+	if (nprograms == 0) {
+		cursorpos = console_printf(cursorpos, 0x0C00, "No programs on disk!\n");
+		halt();
+	}
+	cursorpos = console_printf(cursorpos, 0x0700, "Type a key to run a program:\n");
+	for (i = 0; i < nprograms; i++)
+		cursorpos = console_printf(cursorpos, 0x0700, "  '%c' %s\n",
+					   menu_key(i), program_name(i));
 	do {
-		whichprocess = console_read_digit();
-	} while (whichprocess != 1 && whichprocess != 2 && whichprocess != 3);
+		key = console_read_key();
+		for (whichprocess = 0; whichprocess < nprograms; whichprocess++)
+			if (menu_key(whichprocess) == key)
+				break;
+	} while (whichprocess == nprograms);
 	console_clear();
 
 	// Load the process application code and data into memory.
 	// Store its entry point into the first process's EIP
 	// (instruction pointer).
-	program_loader(whichprocess - 1, &current->p_registers.reg_eip);
+	current->p_program = whichprocess;
+	program_loader(current->p_program, &current->p_registers.reg_eip);
 
-	// Set the main process's stack pointer, ESP.
-	current->p_registers.reg_esp = PROC1_STACK_ADDR + PROC_STACK_SIZE;
+	// Give the main process a one-page stack that can grow to
+	// PROC_STACK_SIZE, and set its stack pointer, ESP.
+	current->p_stack_limit = PROC_STACK_SIZE;
+	stack_commit(current, 1);
+	current->p_registers.reg_esp = PROC_STACK_TOP(current->p_pid);
 
 	// Mark the process as runnable!
 	current->p_state = P_RUNNABLE;
 
+	// Start the other CPUs.  They look for work in schedule(), and
+	// find some once the main process forks.
+	smp_init();
+
 	// Switch to the main process using run().
 	run(current);
 }
@@ -124,19 +195,89 @@ start(void)
  *
  *****************************************************************************/
 
-static pid_t do_fork(process_t *parent);
+static pid_t do_fork(process_t *parent, size_t stack_limit);
+static int do_exec(process_t *proc, int program_id);
+static int runq_remove(process_t *proc);
+static int user_buffer_ok(process_t *proc, uintptr_t addr, size_t len,
+			  int write);
+static int stack_fault(process_t *proc, uintptr_t va);
+static void proc_free(process_t *proc);
+static void proc_cleanup(process_t *proc);
+static void stack_release(process_t *proc);
+static int do_pipe(process_t *proc, uintptr_t fds_addr);
+static int do_open(process_t *proc, uintptr_t name_addr);
+static ssize_t do_readwrite(process_t *proc, int fd, uintptr_t addr,
+			    size_t n, int write);
+static int do_close(process_t *proc, int fd);
+static int futex_wait(process_t *proc, uintptr_t addr, int expected);
+static int futex_wake(uintptr_t addr, int n);
+static int do_disk_read(process_t *proc, uintptr_t addr, uint32_t sect,
+			uint32_t nsect);
 
 void
 interrupt(registers_t *reg)
 {
+	// Profiler samples come first, and need no lock: each CPU has its
+	// own sample buffer.
+	if (reg->reg_intno == INT_PROFILE) {
+		profile_sample(reg);
+		lapic_eoi();
+		if ((reg->reg_cs & 3) == 0)
+			return;
+		current->p_registers = *reg;
+		run(current);
+	}
+
+	// A hardware interrupt can arrive while the kernel is idle in
+	// schedule(), waiting for something to become runnable, and the
+	// kernel itself can fault on a not-yet-loaded application page, or
+	// on the guard page of the current process's stack while copying
+	// out system call results.
+	// Then there are no application registers to save: handle the
+	// interrupt and return to the interrupted kernel code.  An idle CPU
+	// does not hold the kernel lock, so it takes the lock for the timer
+	// and the disk; a faulting CPU already holds it.
+	if ((reg->reg_cs & 3) == 0) {
+		if (reg->reg_intno >= INT_IRQ0
+		    && reg->reg_intno < INT_IRQ0 + NIRQS) {
+			if (reg->reg_intno == INT_IRQ0 + IRQ_TIMER) {
+				profile_sample(reg);
+				kernel_lock();
+				timer_tick();
+				kernel_unlock();
+			} else if (reg->reg_intno == INT_IRQ0 + IRQ_DISK) {
+				kernel_lock();
+				disk_intr();
+				kernel_unlock();
+			}
+			irq_eoi(reg->reg_intno - INT_IRQ0);
+		} else if (reg->reg_intno == INT_IPI_WAKEUP)
+			lapic_eoi();
+		else if (reg->reg_intno != INT_SPURIOUS
+			 && (reg->reg_intno != INT_PAGEFAULT
+			     || !(program_fault(rcr2(), reg->reg_err)
+				  || stack_fault(current, rcr2())))) {
+			cursorpos = console_printf(cursorpos, 0x0C00,
+				"\nKernel fault %d at %x (address %x)!\n",
+				reg->reg_intno, reg->reg_eip, rcr2());
+			halt();
+		}
+		return;
+	}
+
 	// The processor responds to a system call interrupt by saving some of
 	// the application's state on the kernel's stack, then jumping to
 	// kernel assembly code (in k-int.S, for your information).
 	// That code saves more registers on the kernel's stack, then calls
 	// interrupt().  The first thing we must do, then, is copy the saved
-	// registers into the 'current' process descriptor.
+	// registers into the 'current' process descriptor.  Only this CPU
+	// touches the descriptor of the process it is running, so this takes
+	// no lock.
 	current->p_registers = *reg;
 
+	// System calls that use only the current process and the run queues,
+	// which have locks of their own, run without the kernel lock, in
+	// parallel with other CPUs' kernel code.
 	switch (reg->reg_intno) {
 
 	case INT_SYS_GETPID:
@@ -148,12 +289,6 @@ interrupt(registers_t *reg)
 		current->p_registers.reg_eax = current->p_pid;
 		run(current);
 
-	case INT_SYS_FORK:
-		// The 'sys_fork' system call should create a new process.
-		// You will have to complete the do_fork() function!
-		current->p_registers.reg_eax = do_fork(current);
-		run(current);
-
 	case INT_SYS_YIELD:
 		// The 'sys_yield' system call asks the kernel to schedule a
 		// different process.  (MiniprocOS is cooperatively
@@ -161,6 +296,39 @@ interrupt(registers_t *reg)
 		// The schedule() function picks another process and runs it.
 		schedule();
 
+	case INT_SYS_YIELD_TO: {
+		// 'sys_yield_to' runs process %eax next, if it is waiting
+		// for a CPU, and otherwise acts like 'sys_yield'.  Once it is
+		// out of its run queue, it cannot exit, so 'proc_lock' need
+		// only be held while taking it.
+		pid_t pid = current->p_registers.reg_eax;
+		process_t *proc = NULL;
+
+		spin_lock(&proc_lock);
+		if (pid > 0 && pid < NPROCS && proc_array[pid]
+		    && proc_array[pid] != current
+		    && runq_remove(proc_array[pid]))
+			proc = proc_array[pid];
+		spin_unlock(&proc_lock);
+		schedule_to(proc);
+	}
+	}
+
+	// The rest take the kernel lock, which serializes the kernel across
+	// CPUs.  run() releases it again.
+	kernel_lock();
+
+	switch (reg->reg_intno) {
+
+	case INT_SYS_FORK:
+		// The 'sys_fork' system call should create a new process.
+		// You will have to complete the do_fork() function!
+		// %eax holds the child's stack limit, or 0 to use the
+		// parent's.
+		current->p_registers.reg_eax =
+			do_fork(current, current->p_registers.reg_eax);
+		run(current);
+
 	case INT_SYS_EXIT:
 		// 'sys_exit' exits the current process, which is marked as
 		// non-runnable.
@@ -172,8 +340,17 @@ interrupt(registers_t *reg)
         current->p_state = P_ZOMBIE;
 		current->p_exit_status = current->p_registers.reg_eax;
         //current->p_registers.reg_eax = c;
+		proc_cleanup(current);
         schedule();
 
+	case INT_SYS_EXEC:
+		// 'sys_exec' replaces the current process's program with
+		// another one, starting from its entry point with an empty
+		// stack.  It returns only on error.
+		if (do_exec(current, current->p_registers.reg_eax) < 0)
+			current->p_registers.reg_eax = -1;
+		run(current);
+
 	case INT_SYS_WAIT: {
 		// 'sys_wait' is called to retrieve a process's exit status.
 		// It's an error to call sys_wait for:
@@ -186,11 +363,11 @@ interrupt(registers_t *reg)
 
 		pid_t p = current->p_registers.reg_eax;
 		if (p <= 0 || p >= NPROCS || p == current->p_pid
-		    || proc_array[p].p_state == P_EMPTY)
+		    || proc_array[p] == NULL)
 			current->p_registers.reg_eax = -1;
-		else if (proc_array[p].p_state == P_ZOMBIE) {
-			current->p_registers.reg_eax = proc_array[p].p_exit_status;
-            proc_array[p].p_state = P_EMPTY;
+		else if (proc_array[p]->p_state == P_ZOMBIE) {
+			current->p_registers.reg_eax = proc_array[p]->p_exit_status;
+			proc_free(proc_array[p]);
         }
 		else {
             /*
@@ -203,9 +380,173 @@ interrupt(registers_t *reg)
         schedule();
 	}
 
+	case INT_SYS_SBRK:
+		// 'sys_sbrk' moves the end of the heap of the current
+		// process's program, and returns the old end (or -1).  Like
+		// its globals, a program's heap is shared by every process
+		// running it.
+		current->p_registers.reg_eax =
+			program_sbrk(current->p_program,
+				     current->p_registers.reg_eax);
+		run(current);
+
+	case INT_SYS_KSTATS: {
+		// 'sys_kstats' copies the kernel allocators' usage, and each
+		// process's stack size, into a kstats_t in the application's
+		// memory.
+		kstats_t ks;
+		uintptr_t addr = current->p_registers.reg_eax;
+		pid_t p;
+		if (user_buffer_ok(current, addr, sizeof(ks), 1)) {
+			kalloc_stats(&ks);
+			disk_stats(&ks);
+			bcache_stats(&ks);
+			for (p = 0; p < NPROCS; p++)
+				ks.ks_stack_pages[p] = (proc_array[p]
+					? proc_array[p]->p_stack_pages : 0);
+			memcpy((void *) addr, &ks, sizeof(ks));
+			current->p_registers.reg_eax = 0;
+		} else
+			current->p_registers.reg_eax = -1;
+		run(current);
+	}
+
+	case INT_SYS_PIPE:
+		// 'sys_pipe' creates a pipe, and stores file descriptors for
+		// its read and write ends in the application's int[2] array.
+		current->p_registers.reg_eax =
+			do_pipe(current, current->p_registers.reg_eax);
+		run(current);
+
+	case INT_SYS_READ:
+	case INT_SYS_WRITE: {
+		// 'sys_read' and 'sys_write' take a file descriptor in %eax,
+		// a buffer in %ebx and a byte count in %ecx, and return the
+		// number of bytes transferred.  If the call must wait, the
+		// process blocks, and makes the call again when it wakes.
+		ssize_t r = do_readwrite(current, current->p_registers.reg_eax,
+					 current->p_registers.reg_ebx,
+					 current->p_registers.reg_ecx,
+					 reg->reg_intno == INT_SYS_WRITE);
+		if (current->p_state == P_BLOCKED)
+			schedule();
+		current->p_registers.reg_eax = r;
+		run(current);
+	}
+
+	case INT_SYS_CLOSE:
+		current->p_registers.reg_eax =
+			do_close(current, current->p_registers.reg_eax);
+		run(current);
+
+	case INT_SYS_FUTEX_WAIT:
+		// 'sys_futex_wait' blocks the process if the int at address
+		// %eax still holds the value in %ebx.  It returns 0 once
+		// woken, and -1 right away if the value has changed.
+		current->p_registers.reg_eax =
+			futex_wait(current, current->p_registers.reg_eax,
+				   current->p_registers.reg_ebx);
+		if (current->p_state == P_BLOCKED)
+			schedule();
+		run(current);
+
+	case INT_SYS_FUTEX_WAKE:
+		// 'sys_futex_wake' wakes up to %ebx processes waiting on
+		// address %eax (all of them if %ebx is negative), and returns
+		// how many it woke.
+		current->p_registers.reg_eax =
+			futex_wake(current->p_registers.reg_eax,
+				   current->p_registers.reg_ebx);
+		run(current);
+
+	case INT_SYS_SLEEP: {
+		// 'sys_sleep' blocks the process for at least %eax
+		// milliseconds; the timer interrupt wakes it.  Sleeping for 0
+		// milliseconds just yields.
+		uint32_t ms = current->p_registers.reg_eax;
+		current->p_registers.reg_eax = 0;
+		if (ms > 0)
+			timer_sleep(current, ms / 1000 * TIMER_HZ
+				    + (ms % 1000 * TIMER_HZ + 999) / 1000);
+		schedule();
+	}
+
+	case INT_SYS_DISK_READ: {
+		// 'sys_disk_read' reads %ecx sectors, starting at sector
+		// %ebx, into the buffer at %eax, and returns 0 or -1.  The
+		// process blocks while the disk works, and makes the call
+		// again when it wakes, to copy the data out.
+		int r = do_disk_read(current, current->p_registers.reg_eax,
+				     current->p_registers.reg_ebx,
+				     current->p_registers.reg_ecx);
+		if (current->p_state == P_BLOCKED)
+			schedule();
+		current->p_registers.reg_eax = r;
+		run(current);
+	}
+
+	case INT_SYS_OPEN: {
+		// 'sys_open' opens the file named by the string at %eax, and
+		// returns a file descriptor or -1.  If the directory must be
+		// read from disk, the process blocks, and makes the call
+		// again when it wakes.
+		int r = do_open(current, current->p_registers.reg_eax);
+		if (current->p_state == P_BLOCKED)
+			schedule();
+		current->p_registers.reg_eax = r;
+		run(current);
+	}
+
+	case INT_IRQ0 + IRQ_TIMER:
+		// The timer interrupted an application.  Wake any sleepers
+		// that are due, then carry on with the same process:
+		// processes still take turns only when they yield or block.
+		profile_sample(reg);
+		timer_tick();
+		irq_eoi(IRQ_TIMER);
+		run(current);
+
+	case INT_IRQ0 + IRQ_DISK:
+		// The disk has a sector ready, or has failed.  Any process
+		// it wakes waits its turn.
+		disk_intr();
+		irq_eoi(IRQ_DISK);
+		run(current);
+
+	case INT_IPI_WAKEUP:
+		// Another CPU had work for this one, which was idle, but found
+		// work of its own in the meantime.
+		lapic_eoi();
+		run(current);
+
+	case INT_SPURIOUS:
+		run(current);
+
+	case INT_PAGEFAULT:
+		// The first touch of an application page loads it, and a
+		// touch of the stack's guard page grows the stack.  Any other
+		// page fault kills the process.
+		if (program_fault(rcr2(), reg->reg_err)
+		    || stack_fault(current, rcr2()))
+			run(current);
+		cursorpos = console_printf(cursorpos, 0x0C00,
+			"\nProcess %d: page fault at %x (address %x)!\n",
+			current->p_pid, reg->reg_eip, rcr2());
+		current->p_state = P_ZOMBIE;
+		current->p_exit_status = -1;
+		proc_cleanup(current);
+		schedule();
+
 	default:
-		while (1)
-			/* do nothing */;
+		if (reg->reg_intno >= INT_IRQ0
+		    && reg->reg_intno < INT_IRQ0 + NIRQS) {
+			irq_eoi(reg->reg_intno - INT_IRQ0);
+			run(current);
+		}
+		cursorpos = console_printf(cursorpos, 0x0C00,
+			"\nUnexpected interrupt %d in process %d!\n",
+			reg->reg_intno, current->p_pid);
+		halt();
 
 	}
 }
@@ -228,9 +569,10 @@ interrupt(registers_t *reg)
  *****************************************************************************/
 
 static void copy_stack(process_t *dest, process_t *src);
+static uint32_t stack_pages_used(process_t *proc);
 
 static pid_t
-do_fork(process_t *parent)
+do_fork(process_t *parent, size_t stack_limit)
 {
 	// YOUR CODE HERE!
 	// First, find an empty process descriptor.  If there is no empty
@@ -252,21 +594,76 @@ do_fork(process_t *parent)
 
     // find an empty process descriptor
     pid_t i = 1;
+    process_t *child;
+    int fd;
     while (i<NPROCS) {
-        if (proc_array[i].p_state == P_EMPTY) break;
+        if (proc_array[i] == NULL) break;
         i++;
     }
     if (i >= NPROCS) return -1; /* no empty descriptor */
+    if (!(child = proc_new(i))) return -1; /* out of memory */
+    // the child's stack needs room for the parent's current stack
+    if (stack_limit == 0)
+        child->p_stack_limit = parent->p_stack_limit;
+    else
+        child->p_stack_limit = ROUNDUP(MIN(stack_limit, PROC_STACK_SIZE),
+                                       PAGESIZE);
+    if (stack_commit(child, MAX(stack_pages_used(parent), 1)) < 0) {
+        proc_free(child);
+        return -1;
+    }
     // copy parent's register & stack
-    proc_array[i].p_state = P_RUNNABLE; 
-    proc_array[i].p_registers = parent->p_registers; // register
-    copy_stack(&proc_array[i], parent); // stack
-    proc_array[i].p_registers.reg_eax = 0; // child return 0
-    proc_array[i].p_pid = i; // process ID set to i
+    child->p_registers = parent->p_registers; // register
+    copy_stack(child, parent); // stack
+    child->p_registers.reg_eax = 0; // child return 0
+    child->p_program = parent->p_program; // same program
+    for (fd = 0; fd < NFILES; fd++) { // same open files
+        if ((child->p_files[fd] = parent->p_files[fd]))
+            child->p_files[fd]->f_refcount++;
+    }
+    proc_ready(child); // runnable, on this CPU's run queue
 
 	return i;
 }
 
+// Allocate an empty descriptor for process 'pid' and install it in
+// proc_array.  Returns NULL if the kernel is out of memory.
+static process_t *
+proc_new(pid_t pid)
+{
+	process_t *p = (process_t *) kmalloc(sizeof(process_t));
+	if (p) {
+		p->p_pid = pid;
+		p->p_state = P_EMPTY;
+		spin_lock(&proc_lock);
+		proc_array[pid] = p;
+		spin_unlock(&proc_lock);
+	}
+	return p;
+}
+
+// Free process 'proc''s stack and descriptor, emptying its slot.
+static void
+proc_free(process_t *proc)
+{
+	stack_release(proc);
+	spin_lock(&proc_lock);
+	proc_array[proc->p_pid] = NULL;
+	spin_unlock(&proc_lock);
+	kfree(proc);
+}
+
+// Release the resources an exiting process no longer needs: its stack and
+// its open files.  Its descriptor stays until sys_wait reaps it.
+static void
+proc_cleanup(process_t *proc)
+{
+	int fd;
+	stack_release(proc);
+	for (fd = 0; fd < NFILES; fd++)
+		do_close(proc, fd);
+}
+
 static void
 copy_stack(process_t *dest, process_t *src)
 {
@@ -323,36 +720,669 @@ copy_stack(process_t *dest, process_t *src)
 	// YOUR CODE HERE!
 
     // set the corresponding memory address
-	src_stack_top = PROC1_STACK_ADDR + src->p_pid*PROC_STACK_SIZE;
+	src_stack_top = PROC_STACK_TOP(src->p_pid);
 	src_stack_bottom = src->p_registers.reg_esp;
-	dest_stack_top = PROC1_STACK_ADDR + dest->p_pid*PROC_STACK_SIZE;
+	dest_stack_top = PROC_STACK_TOP(dest->p_pid);
 	dest_stack_bottom = dest_stack_top - (src_stack_top - src_stack_bottom);
 	// YOUR CODE HERE: memcpy the stack and set dest->p_registers.reg_esp
     
     // memcpy the stack
-    memcpy((void*)dest_stack_bottom, (void*)src_stack_bottom, sizeof(process_t));
+    memcpy((void*)dest_stack_bottom, (void*)src_stack_bottom,
+           src_stack_top - src_stack_bottom);
     dest->p_registers.reg_esp = dest_stack_bottom;
 
 }
 
 
 
+/*****************************************************************************
+ * do_exec
+ *
+ *   Start running program 'program_id' in process 'proc'.  Applications
+ *   are linked at different addresses, so the new program can be resident
+ *   alongside programs that other processes are running.  Like everything
+ *   else in MiniprocOS, a program's globals are shared by all processes
+ *   running it; they start out fresh only if no other live process is
+ *   running that program.
+ *   Returns 0 on success, -1 if 'program_id' is not a valid program.
+ *
+ *****************************************************************************/
+
+static int
+program_users(int program_id, process_t *except)
+{
+	pid_t pid;
+	int n = 0;
+	for (pid = 1; pid < NPROCS; pid++)
+		if (proc_array[pid] && proc_array[pid] != except
+		    && (proc_array[pid]->p_state == P_RUNNABLE
+			|| proc_array[pid]->p_state == P_BLOCKED)
+		    && proc_array[pid]->p_program == program_id)
+			n++;
+	return n;
+}
+
+static int
+do_exec(process_t *proc, int program_id)
+{
+	uint32_t entry;
+
+	if (program_users(program_id, proc) == 0)
+		program_reset(program_id);
+	if (program_loader(program_id, &entry) < 0)
+		return -1;
+
+	proc->p_program = program_id;
+	special_registers_init(proc);
+	proc->p_registers.reg_eip = entry;
+	// start over with a one-page stack (the pages just freed are
+	// certainly available)
+	stack_release(proc);
+	stack_commit(proc, 1);
+	proc->p_registers.reg_esp = PROC_STACK_TOP(proc->p_pid);
+	return 0;
+}
+
+
+
+/*****************************************************************************
+ * process stacks
+ *
+ *   Process P's stack occupies the top 'p_stack_pages' pages below
+ *   PROC_STACK_TOP(P), each backed by a page frame from page_alloc().
+ *   The page below them is left unmapped as a guard page.  When the
+ *   process touches the guard page, stack_fault() commits it, and the
+ *   guard moves one page down -- until the stack reaches 'p_stack_limit'
+ *   bytes, when a touch of the guard page is a stack overflow and kills
+ *   the process.  A large stack frame can skip past the guard page, so a
+ *   fault anywhere between the stack pointer and the committed pages
+ *   grows the stack too.
+ *
+ *****************************************************************************/
+
+// Commit stack pages for 'proc' until it has 'npages' of them.  Returns 0
+// on success, -1 if that would exceed the stack limit or memory is
+// exhausted.
+static int
+stack_commit(process_t *proc, uint32_t npages)
+{
+	uintptr_t top = PROC_STACK_TOP(proc->p_pid);
+	void *page;
+
+	if (npages * PAGESIZE > proc->p_stack_limit)
+		return -1;
+	while (proc->p_stack_pages < npages) {
+		if (!(page = page_alloc()))
+			return -1;
+		proc->p_stack_pages++;
+		page_map(top - proc->p_stack_pages * PAGESIZE,
+			 (physaddr_t) page, PTE_P | PTE_W | PTE_U);
+	}
+	return 0;
+}
+
+// Unmap and free all of 'proc''s stack pages.
+static void
+stack_release(process_t *proc)
+{
+	uintptr_t top = PROC_STACK_TOP(proc->p_pid);
+	uintptr_t va;
+
+	for (; proc->p_stack_pages > 0; proc->p_stack_pages--) {
+		va = top - proc->p_stack_pages * PAGESIZE;
+		page_free((void *) page_lookup(va));
+		page_map(va, 0, 0);
+	}
+}
+
+// Return the number of stack pages 'proc' is using, from its stack
+// pointer up.
+static uint32_t
+stack_pages_used(process_t *proc)
+{
+	return (PROC_STACK_TOP(proc->p_pid) - proc->p_registers.reg_esp
+		+ PAGESIZE - 1) / PAGESIZE;
+}
+
+// Handle a page fault at 'va' by growing 'proc''s stack, if 'va' is in the
+// stack's guard page or between the stack pointer and the committed pages.
+// Returns 1 if the stack grew, 0 if the fault was a real error.
+static int
+stack_fault(process_t *proc, uintptr_t va)
+{
+	uintptr_t top = PROC_STACK_TOP(proc->p_pid);
+	uintptr_t bottom = top - proc->p_stack_pages * PAGESIZE;
+
+	// 'pushal' writes 32 bytes below the stack pointer
+	if (va >= bottom || va < top - proc->p_stack_limit
+	    || (va < bottom - PAGESIZE && va + 32 < proc->p_registers.reg_esp))
+		return 0;
+	return stack_commit(proc, (top - ROUNDDOWN(va, PAGESIZE)) / PAGESIZE) == 0;
+}
+
+
+
+/*****************************************************************************
+ * user_buffer_ok
+ *
+ *   System calls that take a pointer check it with this function first.
+ *   Returns 1 if the 'len' bytes at 'addr' lie in memory that 'proc' may
+ *   use: its stack, or the code, globals and heap of the program it is
+ *   running.  If the kernel is to 'write' them, they must also be memory
+ *   the process itself may write.
+ *
+ *   The kernel runs without CR0_WP, so the processor would let it write
+ *   pages that are read-only to the process, such as program text mapped
+ *   straight from the program image, which every process running the
+ *   program shares.  So each program page is loaded first (see
+ *   program_fault), and then must be writable.
+ *
+ *****************************************************************************/
+
+static int
+user_buffer_ok(process_t *proc, uintptr_t addr, size_t len, int write)
+{
+	uintptr_t stack_top = PROC_STACK_TOP(proc->p_pid);
+	uintptr_t slot = APP_REGION_START + proc->p_program * APP_SLOT_SIZE;
+	uintptr_t va;
+
+	if (addr + len < addr)
+		return 0;
+	// the kernel may only grow the stack where the process itself could
+	// (see stack_fault)
+	if (addr >= stack_top - proc->p_stack_limit
+	    && addr + 32 >= proc->p_registers.reg_esp
+	    && addr + len <= stack_top)
+		return 1;
+	if (addr < slot || addr + len > program_sbrk(proc->p_program, 0))
+		return 0;
+	for (va = ROUNDDOWN(addr, PAGESIZE); write && va < addr + len;
+	     va += PAGESIZE)
+		if (!program_fault(va, 0) || !(page_perm(va) & PTE_W))
+			return 0;
+	return 1;
+}
+
+
+
+/*****************************************************************************
+ * wait queues
+ *
+ *   A process that must wait for something blocks on that thing's wait
+ *   queue; whoever makes progress on it wakes the queue.  If the process
+ *   was in the middle of a system call that should be retried once it
+ *   wakes, wait_block() moves its saved instruction pointer back over the
+ *   2-byte 'int' instruction, so the call happens again.
+ *
+ *****************************************************************************/
+
+void
+wait_block(waitqueue_t *wq, process_t *proc, int restart)
+{
+	proc->p_state = P_BLOCKED;
+	if (restart)
+		proc->p_registers.reg_eip -= 2;
+	proc->p_wait_next = NULL;
+	if (wq->wq_tail)
+		wq->wq_tail->p_wait_next = proc;
+	else
+		wq->wq_head = proc;
+	wq->wq_tail = proc;
+}
+
+// Wake up to 'n' processes blocked on 'wq', oldest first; all of them if
+// 'n' is negative.  Returns the number woken.
+int
+wait_wake(waitqueue_t *wq, int n)
+{
+	int woken = 0;
+	while (wq->wq_head && woken != n) {
+		process_t *proc = wq->wq_head;
+		wq->wq_head = proc->p_wait_next;
+		proc->p_wait_next = NULL;
+		proc_ready(proc);
+		woken++;
+	}
+	if (!wq->wq_head)
+		wq->wq_tail = NULL;
+	return woken;
+}
+
+
+
+/*****************************************************************************
+ * futexes
+ *
+ *   A futex is any int in application memory that processes wait on.  All
+ *   processes share one address space, so the address alone names the
+ *   futex.  Waiters block on one of FUTEX_HASHSIZE wait queues, chosen by
+ *   hashing the address; the queue can hold waiters for other addresses
+ *   too, so each waiter remembers its address in 'p_futex_addr', and
+ *   futex_wake() only takes waiters whose address matches.
+ *
+ *   The kernel never interprets the int.  Applications build locks on top
+ *   (see sync.h), and only make system calls when they must wait or wake
+ *   a waiter.
+ *
+ *****************************************************************************/
+
+#define FUTEX_HASHBITS		6
+#define FUTEX_HASHSIZE		(1 << FUTEX_HASHBITS)
+
+static waitqueue_t futex_queues[FUTEX_HASHSIZE];
+
+static waitqueue_t *
+futex_queue(uintptr_t addr)
+{
+	// Fibonacci hashing: the top bits of the product mix in every
+	// address bit.
+	return &futex_queues[(uint32_t) (addr * 2654435769U)
+			     >> (32 - FUTEX_HASHBITS)];
+}
+
+// Block 'proc' until woken by futex_wake(addr), unless the int at 'addr'
+// no longer equals 'expected'.  Checking the value and blocking happen
+// together, in the kernel, so a wakeup between them cannot be lost.
+static int
+futex_wait(process_t *proc, uintptr_t addr, int expected)
+{
+	if ((addr & 3) || !user_buffer_ok(proc, addr, sizeof(int), 0)
+	    || *(volatile int *) addr != expected)
+		return -1;
+	proc->p_futex_addr = addr;
+	wait_block(futex_queue(addr), proc, 0);
+	return 0;
+}
+
+// Wake up to 'n' processes waiting on 'addr', oldest first; all of them
+// if 'n' is negative.  Returns the number woken.
+static int
+futex_wake(uintptr_t addr, int n)
+{
+	waitqueue_t *wq = futex_queue(addr);
+	process_t *proc, *prev = NULL, *next;
+	int woken = 0;
+
+	for (proc = wq->wq_head; proc && woken != n; proc = next) {
+		next = proc->p_wait_next;
+		if (proc->p_futex_addr != addr) {
+			prev = proc;
+			continue;
+		}
+		if (prev)
+			prev->p_wait_next = next;
+		else
+			wq->wq_head = next;
+		if (wq->wq_tail == proc)
+			wq->wq_tail = prev;
+		proc->p_wait_next = NULL;
+		proc_ready(proc);
+		woken++;
+	}
+	return woken;
+}
+
+
+
+/*****************************************************************************
+ * files
+ *
+ *   A process's file descriptors index its 'p_files' array.  Forked
+ *   children share their parent's open files, so each file counts the
+ *   descriptors that refer to it, and is closed when the last goes away.
+ *   Files are pipe ends (see k-pipe.c), or files in the boot disk's
+ *   read-only filesystem (see k-fs.c).
+ *
+ *****************************************************************************/
+
+// Install 'f' at 'proc''s lowest free file descriptor.  Returns the
+// descriptor, or -1 if there is none.
+static int
+fd_install(process_t *proc, file_t *f)
+{
+	int fd;
+	for (fd = 0; fd < NFILES; fd++)
+		if (!proc->p_files[fd]) {
+			proc->p_files[fd] = f;
+			return fd;
+		}
+	return -1;
+}
+
+static file_t *
+fd_lookup(process_t *proc, int fd)
+{
+	if (fd < 0 || fd >= NFILES)
+		return NULL;
+	return proc->p_files[fd];
+}
+
+static int
+do_pipe(process_t *proc, uintptr_t fds_addr)
+{
+	int *fds = (int *) fds_addr;
+	file_t *readf, *writef;
+
+	if (!user_buffer_ok(proc, fds_addr, 2 * sizeof(int), 1)
+	    || pipe_open(&readf, &writef) < 0)
+		return -1;
+	if ((fds[0] = fd_install(proc, readf)) < 0
+	    || (fds[1] = fd_install(proc, writef)) < 0) {
+		if (fds[0] >= 0)
+			proc->p_files[fds[0]] = NULL;
+		pipe_close(readf);
+		pipe_close(writef);
+		kfree(readf);
+		kfree(writef);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+do_open(process_t *proc, uintptr_t name_addr)
+{
+	char name[FS_NAMELEN];
+	file_t *f;
+	int i, fd;
+
+	for (i = 0; i < FS_NAMELEN; i++) {
+		if (!user_buffer_ok(proc, name_addr + i, 1, 0))
+			return -1;
+		if ((name[i] = ((const char *) name_addr)[i]) == 0)
+			break;
+	}
+	if (i == FS_NAMELEN || fs_open(name, &f) < 0)
+		return -1;
+	if (!f)			// blocked, reading the directory
+		return 0;
+	if ((fd = fd_install(proc, f)) < 0) {
+		fs_close(f);
+		kfree(f);
+	}
+	return fd;
+}
+
+static ssize_t
+do_readwrite(process_t *proc, int fd, uintptr_t addr, size_t n, int write)
+{
+	file_t *f = fd_lookup(proc, fd);
+
+	if (!f || !user_buffer_ok(proc, addr, n, !write))
+		return -1;
+	if (write && f->f_type == F_PIPE_WRITE)
+		return pipe_write(f, (const uint8_t *) addr, n);
+	else if (!write && f->f_type == F_PIPE_READ)
+		return pipe_read(f, (uint8_t *) addr, n);
+	else if (!write && f->f_type == F_FILE)
+		return fs_read(f, (uint8_t *) addr, n);
+	else
+		return -1;
+}
+
+static int
+do_close(process_t *proc, int fd)
+{
+	file_t *f = fd_lookup(proc, fd);
+
+	if (!f)
+		return -1;
+	proc->p_files[fd] = NULL;
+	if (--f->f_refcount == 0) {
+		if (f->f_type == F_PIPE_READ || f->f_type == F_PIPE_WRITE)
+			pipe_close(f);
+		else if (f->f_type == F_FILE)
+			fs_close(f);
+		kfree(f);
+	}
+	return 0;
+}
+
+
+
+/*****************************************************************************
+ * disk reads
+ *
+ *   sys_disk_read hands the disk driver (k-disk.c) a request with a
+ *   page-sized kernel buffer, and blocks on it, counting towards
+ *   'irq_waiters'.  The disk interrupt fills the buffer and wakes the
+ *   process, which then repeats the call and finds its request done in
+ *   'p_diskreq'.  Copying the data out then, in the process's own system
+ *   call, lets the kernel fault in the buffer's pages as usual.
+ *
+ *****************************************************************************/
+
+static int
+do_disk_read(process_t *proc, uintptr_t addr, uint32_t sect, uint32_t nsect)
+{
+	diskreq_t *req = proc->p_diskreq;
+	int r;
+
+	if (!req) {
+		if (nsect == 0 || nsect > DISK_READ_MAX
+		    || !user_buffer_ok(proc, addr, nsect * SECTORSIZE, 1))
+			return -1;
+		req = (diskreq_t *) kmalloc(sizeof(diskreq_t));
+		if (!req || !(req->dr_buf = (uint8_t *) page_alloc())) {
+			kfree(req);
+			return -1;
+		}
+		req->dr_sect = sect;
+		req->dr_nsect = nsect;
+		proc->p_diskreq = req;
+		disk_submit(req);
+	}
+	if (req->dr_status == DISK_PENDING) {
+		wait_block(&req->dr_wait, proc, 1);
+		irq_waiters++;
+		return 0;
+	}
+
+	r = req->dr_status;
+	if (r == 0 && user_buffer_ok(proc, addr, nsect * SECTORSIZE, 1))
+		memcpy((void *) addr, req->dr_buf, nsect * SECTORSIZE);
+	else
+		r = -1;
+	page_free(req->dr_buf);
+	kfree(req);
+	proc->p_diskreq = NULL;
+	return r;
+}
+
+
+
 /*****************************************************************************
  * schedule
  *
  *   This is the process scheduler.
- *   It picks a runnable process, then context-switches to that process.
- *   If there are no runnable processes, it spins forever.
+ *   Each CPU has a run queue of runnable processes that are not running.
+ *   schedule() puts this CPU's current process at the back of its queue,
+ *   if the process is still runnable, then runs the process at the front.
+ *   A CPU whose queue is empty steals the oldest process from another
+ *   CPU's queue.  schedule_to() skips the queues for a directed yield:
+ *   sys_yield_to takes the process out of whichever queue holds it (see
+ *   runq_remove), and schedule_to() runs it at once.  When there is
+ *   nothing to run anywhere, the CPU halts until an interrupt arrives: a
+ *   hardware interrupt, on the boot CPU, or another CPU's INT_IPI_WAKEUP
+ *   when it makes a process runnable.  If no interrupt could ever make a
+ *   process runnable, the system has stalled: stall() reports the state
+ *   (and stack size) of every process and shuts down.
+ *
+ *   The run queues have their own locks, so schedule() releases the
+ *   kernel lock first, and CPUs switch processes in parallel.
  *
  *****************************************************************************/
 
+static void stall(void) __attribute__((noreturn));
+
+static void
+runq_append(cpu_t *c, process_t *proc)
+{
+	spin_lock(&c->c_runq_lock);
+	proc->p_wait_next = NULL;
+	if (c->c_runq.wq_tail)
+		c->c_runq.wq_tail->p_wait_next = proc;
+	else
+		c->c_runq.wq_head = proc;
+	c->c_runq.wq_tail = proc;
+	spin_unlock(&c->c_runq_lock);
+}
+
+// Take the process at the front of 'c''s run queue, or return NULL.
+static process_t *
+runq_pop(cpu_t *c)
+{
+	process_t *proc;
+
+	// Checking first without the lock keeps idle CPUs from fighting
+	// over the locks of empty queues.
+	if (!c->c_runq.wq_head)
+		return NULL;
+	spin_lock(&c->c_runq_lock);
+	if ((proc = c->c_runq.wq_head)) {
+		c->c_runq.wq_head = proc->p_wait_next;
+		if (!c->c_runq.wq_head)
+			c->c_runq.wq_tail = NULL;
+		proc->p_wait_next = NULL;
+	}
+	spin_unlock(&c->c_runq_lock);
+	return proc;
+}
+
+// Take 'proc' out of whichever run queue holds it.  Returns 0 if it is on
+// none: it is running, or another CPU has just taken it.
+static int
+runq_remove(process_t *proc)
+{
+	process_t **pp, *prev;
+	cpu_t *c;
+
+	for (c = cpus; c < cpus + ncpus; c++) {
+		spin_lock(&c->c_runq_lock);
+		prev = NULL;
+		for (pp = &c->c_runq.wq_head; *pp && *pp != proc;
+		     pp = &(*pp)->p_wait_next)
+			prev = *pp;
+		if (*pp) {
+			*pp = proc->p_wait_next;
+			if (c->c_runq.wq_tail == proc)
+				c->c_runq.wq_tail = prev;
+			proc->p_wait_next = NULL;
+			spin_unlock(&c->c_runq_lock);
+			return 1;
+		}
+		spin_unlock(&c->c_runq_lock);
+	}
+	return 0;
+}
+
+// Mark 'proc' runnable and queue it on this CPU.  If some other CPU is
+// idle, wake it to steal the process.
+void
+proc_ready(process_t *proc)
+{
+	cpu_t *c = this_cpu();
+	int i;
+
+	proc->p_state = P_RUNNABLE;
+	runq_append(c, proc);
+	// Pairs with the idle CPU's fence in schedule(): either it sees the
+	// process, or we see it idle.
+	atomic_fence();
+	for (i = 0; i < ncpus; i++)
+		if (i != c->c_id && cpus[i].c_idle
+		    && atomic_xchg(&cpus[i].c_idle, 0)) {
+			lapic_ipi(cpus[i].c_apicid, INT_IPI_WAKEUP);
+			break;
+		}
+}
+
 void
 schedule(void)
 {
-	pid_t pid = current->p_pid;
+	cpu_t *c = this_cpu();
+	process_t *proc = current;
+	pid_t pid;
+	int i;
+
+	current = NULL;
+	if (proc && proc->p_state == P_RUNNABLE)
+		runq_append(c, proc);
+	if (c->c_locked)
+		kernel_unlock();
+
 	while (1) {
-		pid = (pid + 1) % NPROCS;
-		if (proc_array[pid].p_state == P_RUNNABLE)
-			run(&proc_array[pid]);
+		for (i = 0; i < ncpus; i++)
+			if ((proc = runq_pop(&cpus[(c->c_id + i) % ncpus])))
+				run(proc);
+
+		// Nothing to run.  Say so, then look once more, so that a
+		// process made runnable meanwhile is either found here or
+		// causes a wakeup interrupt.
+		atomic_xchg(&c->c_idle, 1);
+		for (i = 0; i < ncpus; i++)
+			if (cpus[i].c_runq.wq_head)
+				break;
+		if (i < ncpus) {
+			c->c_idle = 0;
+			continue;
+		}
+
+		kernel_lock();
+		if (irq_waiters == 0) {
+			for (pid = 1; pid < NPROCS; pid++)
+				if (proc_array[pid]
+				    && proc_array[pid]->p_state == P_RUNNABLE)
+					break;
+			if (pid == NPROCS)
+				stall();
+		}
+		kernel_unlock();
+
+		idle();
+		c->c_idle = 0;
+	}
+}
+
+// Run 'proc', which the caller has taken out of its run queue, now, and
+// put the current process at the back of this CPU's queue.  If 'proc' is
+// NULL, just schedule().
+void
+schedule_to(process_t *proc)
+{
+	process_t *self = current;
+
+	if (!proc)
+		schedule();
+	current = NULL;
+	runq_append(this_cpu(), self);
+	run(proc);
+}
+
+static void
+stall(void)
+{
+	static const char * const state_names[] = {
+		"-", "RUNNABLE", "BLOCKED", "ZOMBIE"
+	};
+	pid_t pid;
+
+	cursorpos = console_printf(cursorpos, 0x0C00,
+				   "\nNo runnable processes; shutting down.\n");
+	// Empty slots are skipped; live processes show their stack size.
+	for (pid = 0; pid < NPROCS; pid++) {
+		process_t *p = proc_array[pid];
+		if (!p)
+			continue;
+		cursorpos = console_printf(cursorpos, 0x0700, " %d:%s", pid,
+					   state_names[p->p_state]);
+		if (p->p_state == P_ZOMBIE)
+			cursorpos = console_printf(cursorpos, 0x0700, "(%d)",
+						   p->p_exit_status);
+		else
+			cursorpos = console_printf(cursorpos, 0x0700, "[%dK]",
+				p->p_stack_pages * (PAGESIZE / 1024));
 	}
+	cursorpos = console_printf(cursorpos, 0x0700, "\n");
+	shutdown();
 }
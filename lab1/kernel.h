@@ -2,6 +2,7 @@
 #define WEENSYOS_KERNEL_H
 #include "const.h"
 #include "x86.h"
+#include "lib.h"
 
 // Process state type
 typedef enum procstate {
@@ -13,6 +14,34 @@ typedef enum procstate {
 					// has called sys_wait() yet
 } procstate_t;
 
+struct process;
+struct pipe;
+struct fsfile;
+
+// A wait queue holds blocked processes, oldest first, linked through their
+// 'p_wait_next' fields.
+typedef struct waitqueue {
+	struct process *wq_head;
+	struct process *wq_tail;
+} waitqueue_t;
+
+// An open file.  Each process's file descriptors index its 'p_files' array;
+// forked processes share open files, so files are reference counted.
+#define NFILES			8
+
+typedef enum filetype {
+	F_PIPE_READ,			// The read end of a pipe
+	F_PIPE_WRITE,			// The write end of a pipe
+	F_FILE				// A file in the filesystem
+} filetype_t;
+
+typedef struct file {
+	filetype_t f_type;
+	int f_refcount;			// File descriptors referring to this
+	struct pipe *f_pipe;		// Pipe, for F_PIPE_READ/F_PIPE_WRITE
+	struct fsfile *f_fsfile;	// File and position, for F_FILE
+} file_t;
+
 // Process descriptor type
 typedef struct process {
 	pid_t p_pid;			// Process ID
@@ -23,25 +52,235 @@ typedef struct process {
 	procstate_t p_state;		// Process state; see above
 	int p_exit_status;		// Process's exit status (if it has
 					// exited and p_state == P_ZOMBIE)
+	int p_program;			// Program this process is running
+
+	uint32_t p_stack_limit;		// Most bytes the stack may grow to
+	uint32_t p_stack_pages;		// Stack pages currently committed
+
+	file_t *p_files[NFILES];	// Open files, by file descriptor
+	struct process *p_wait_next;	// Next process on a wait queue
+	uintptr_t p_futex_addr;		// Address waited on in sys_futex_wait
+	uint32_t p_wakeup;		// Tick to wake at, in sys_sleep
+	struct diskreq *p_diskreq;	// Read in progress, in sys_disk_read
+	struct buf *p_fswait;		// Buffer blocked on, in sys_open or
+					// sys_read of a file
 } process_t;
 
+// A disk read (see k-disk.c).  Reads of up to 256 sectors go into a
+// kernel buffer; the disk interrupt fills it and wakes 'dr_wait'.
+#define DISK_PENDING		1
+
+typedef struct diskreq {
+	uint32_t dr_sect;		// First sector
+	uint32_t dr_nsect;		// Number of sectors
+	uint8_t *dr_buf;		// Where they go
+	volatile int dr_status;		// DISK_PENDING, then 0, or -1 on error
+	waitqueue_t dr_wait;		// Processes waiting for it
+	struct diskreq *dr_next;	// Next in the disk queue
+} diskreq_t;
+
+// A block in the buffer cache (see k-bcache.c).  Its data is valid once
+// its read is done: when 'b_req.dr_status' is 0.
+typedef struct buf {
+	uint32_t b_block;		// Disk block, of FS_BLOCKSIZE bytes
+	diskreq_t b_req;		// Its read; 'dr_buf' is the data page
+	struct buf *b_hash_next;	// Next in the hash chain
+	struct buf *b_lru_prev;		// Neighbors in the LRU list, most
+	struct buf *b_lru_next;		// recently used first
+} buf_t;
+
 
-// Top of the kernel stack
+// Top of the kernel stacks.  Each CPU has its own KERNEL_STACK_SIZE
+// stack, CPU N's ending N slots of KERNEL_STACK_SLOT bytes below
+// KERNEL_STACK_TOP.  The page below each stack is left unmapped, so a
+// stack that overflows faults instead of running into the next CPU's,
+// where this_cpu() would take it for that CPU.
 #define KERNEL_STACK_TOP	0x80000
+#define KERNEL_STACK_SIZE	0x2000
+#define KERNEL_STACK_SLOT	(KERNEL_STACK_SIZE + PAGESIZE)
+
+// The most CPUs the kernel will use.
+#define NCPU			8
+
+// Per-CPU state (see k-smp.c).  A runnable process that is not running is
+// on exactly one CPU's run queue, linked through 'p_wait_next'.
+typedef struct cpu {
+	int c_id;			// Index in 'cpus'; the boot CPU is 0
+	int c_apicid;			// Local APIC ID
+	volatile int c_started;		// Set once the CPU is up
+	process_t *c_current;		// Process running here, or NULL
+	spinlock_t c_runq_lock;		// Protects 'c_runq'
+	waitqueue_t c_runq;		// Runnable processes, oldest first
+	volatile int c_idle;		// Set while halted, waiting for work
+	int c_locked;			// Set while holding the kernel lock
+	uint32_t c_tlbgen;		// TLB generation at last flush (x86.c)
+} cpu_t;
+
+extern cpu_t cpus[NCPU];
+extern int ncpus;
+
+// Return the CPU this code runs on.  The kernel always runs on the
+// current CPU's kernel stack, so the stack pointer says which CPU it is.
+static inline cpu_t *
+this_cpu(void)
+{
+	return &cpus[(KERNEL_STACK_TOP - 1 - read_esp()) / KERNEL_STACK_SLOT];
+}
+
+// The process running on this CPU.
+#define current			(this_cpu()->c_current)
+
+// Other CPUs start in real mode at this page (see k-int.S).
+#define AP_BOOT_ADDR		0x7000
+
+// Physical memory identity-mapped by the kernel's page tables.
+#define MEMSIZE_PHYSICAL	0x2000000
+
+// Process stacks (see const.h) start where physical memory ends.
+#define MEMSIZE_VIRTUAL		PROC_STACK_TOP(NPROCS)
+
+// Applications are loaded into this region, one page at a time, as they
+// touch it (see k-loader.c).  Each application is linked at its own
+// APP_SLOT_SIZE slot.
+#define APP_REGION_START	0x1000000
+#define APP_SLOT_SIZE		0x100000
+#define APP_REGION_END		0x2000000
+
+// At most this many applications can be resident.
+#define MAXPROGRAMS		((APP_REGION_END - APP_REGION_START) / APP_SLOT_SIZE)
+
+// Unpacked program images live here, APP_IMAGE_SIZE bytes per program.
+#define APP_IMAGE_START		0x800000
+#define APP_IMAGE_SIZE		0x20000
+#define APP_IMAGE_END		0xA00000
+
+// The page-frame allocator owns memory from here, just above the kernel,
+// up to APP_REGION_START, except the program image area.
+#define PAGEFRAMES_START	0x200000
+
+// Slab objects are whole multiples of the cache line size, and kmalloc()
+// serves requests up to KMALLOC_MAX bytes.
+#define CACHELINE		64
+#define KMALLOC_MAX		(CACHELINE << (KSTATS_NCACHES - 1))
+
+// System calls are interrupts INT_SYS_GETPID up to INT_SYS_GETPID +
+// NSYSCALLS - 1.  Each needs a handler in k-int.S.
+#define NSYSCALLS		18
+
+// Hardware interrupts IRQ 0-15 are delivered as interrupts 32-47.
+#define INT_IRQ0		32
+#define NIRQS			16
+
+// Interrupts sent by local APICs: one CPU wakes another, idle one with
+// INT_IPI_WAKEUP; the profiler's timer sends INT_PROFILE; INT_SPURIOUS
+// needs no response.
+#define INT_IPI_WAKEUP		0xF0
+#define INT_PROFILE		0xF1
+#define INT_SPURIOUS		0xFF
+
+// The interval timer interrupts on IRQ_TIMER, TIMER_HZ times a second.
+#define IRQ_TIMER		0
+#define TIMER_HZ		1000
+
+// The first IDE disk interrupts on IRQ_DISK.
+#define IRQ_DISK		14
+
+// Number of blocked processes that only a hardware interrupt can wake up.
+// If nothing is runnable and this is 0, the system has stalled.
+extern int irq_waiters;
 
 // Functions defined in kernel.c
 void interrupt(registers_t *reg);
-void schedule(void);
+void schedule(void) __attribute__((noreturn));
+void schedule_to(process_t *proc) __attribute__((noreturn));
+void proc_ready(process_t *proc);
+void wait_block(waitqueue_t *wq, process_t *proc, int restart);
+int wait_wake(waitqueue_t *wq, int n);
 
 // Functions defined in x86.c
-void segments_init();
+void segments_init(int cpu);
+void paging_init(void);
+void page_map(uintptr_t va, physaddr_t pa, int perm);
+physaddr_t page_lookup(uintptr_t va);
+int page_perm(uintptr_t va);
+void interrupt_controller_init(void);
+void irq_enable(int irq);
+void irq_eoi(int irq);
 void special_registers_init(process_t *proc);
+void tsc_calibrate(void);
+void lapic_map(physaddr_t pa);
+void lapic_init(int bsp);
+int lapic_id(void);
+void lapic_eoi(void);
+void lapic_ipi(int apicid, int vector);
+void lapic_start_ap(int apicid, physaddr_t addr);
+void lapic_timer_start(int hz, int vector);
+void timer_init(int hz);
 void console_clear(void);
-int console_read_digit(void);
-// Function defined in k-loader.c
-void program_loader(int programnumber, uint32_t *entry_point);
+int console_read_key(void);
+void idle(void);
+void log_write(const char *s, size_t n);
+void halt(void) __attribute__((noreturn));
+void shutdown(void) __attribute__((noreturn));
+// Functions defined in k-alloc.c
+void kalloc_init(void);
+void *page_alloc(void);
+void page_free(void *page);
+void *kmalloc(size_t size);
+void kfree(void *ptr);
+void kalloc_stats(kstats_t *ks);
+
+// Functions defined in k-pipe.c
+int pipe_open(file_t **readf, file_t **writef);
+ssize_t pipe_read(file_t *f, uint8_t *buf, size_t n);
+ssize_t pipe_write(file_t *f, const uint8_t *buf, size_t n);
+void pipe_close(file_t *f);
+
+// Functions defined in k-profile.c.  They do nothing unless the kernel
+// is built with 'make PROFILE=1'.
+void profile_init(void);
+void profile_sample(registers_t *reg);
+void profile_dump(void);
+
+// Functions defined in k-smp.c
+void smp_init(void);
+void kernel_lock(void);
+void kernel_unlock(void);
+
+// Functions defined in k-timer.c
+extern uint32_t timer_ticks;
+void timer_sleep(process_t *proc, uint32_t ticks);
+void timer_tick(void);
+
+// Functions defined in k-disk.c
+int disk_read(void *dst, uint32_t sect, uint32_t nsect);
+void disk_init(void);
+void disk_submit(diskreq_t *req);
+void disk_plug(void);
+void disk_unplug(void);
+void disk_intr(void);
+void disk_stats(kstats_t *ks);
+
+// Functions defined in k-bcache.c
+void bcache_init(void);
+buf_t *bcache_read(uint32_t block, buf_t *waited);
+int bcache_readahead(uint32_t block);
+void bcache_stats(kstats_t *ks);
+
+// Functions defined in k-fs.c
+void fs_init(void);
+int fs_open(const char *name, file_t **fp);
+ssize_t fs_read(file_t *f, uint8_t *buf, size_t n);
+void fs_close(file_t *f);
+
+// Functions defined in k-loader.c
+int programs_init(void);
+const char *program_name(int programnumber);
+int program_loader(int programnumber, uint32_t *entry_point);
+void program_reset(int programnumber);
+int program_fault(uintptr_t va, uint32_t err);
+uintptr_t program_sbrk(int programnumber, intptr_t increment);
 
-extern process_t *current;
 void run(process_t *proc) __attribute__((noreturn));
 
 #endif
@@ -47,6 +47,17 @@ memset(void *v, int c, size_t n)
 	return v;
 }
 
+int
+memcmp(const void *a, const void *b, size_t n)
+{
+	const unsigned char *s1 = (const unsigned char *) a;
+	const unsigned char *s2 = (const unsigned char *) b;
+	for (; n > 0; ++s1, ++s2, --n)
+		if (*s1 != *s2)
+			return *s1 - *s2;
+	return 0;
+}
+
 size_t
 strlen(const char *s)
 {
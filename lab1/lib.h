@@ -3,16 +3,103 @@
 #include "types.h"
 
 /*****************************************************************************
- * memcpy, memmove, memset, strlen
+ * memcpy, memmove, memset, memcmp, strlen
  *
  *   Our versions of important C library functions. */
 
 void *memcpy(void *dst, const void *src, size_t n);
 void *memmove(void *dst, const void *src, size_t n);
 void *memset(void *x, int c, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
 size_t strlen(const char *s);
 size_t strnlen(const char *s, size_t maxlen);
 
+/*****************************************************************************
+ * atomic_xadd, atomic_cmpxchg, atomic_xchg
+ *
+ *   Atomic read-modify-write operations on a shared word.  Each is a single
+ *   'lock'-prefixed instruction, so it is atomic even if other processes
+ *   (or processors) touch the word at the same time.
+ *
+ *   atomic_xadd(p, v) adds 'v' to '*p' and returns the old value of '*p'.
+ *   atomic_cmpxchg(p, old, new) sets '*p' to 'new' if it equals 'old', and
+ *   returns the value '*p' had; the exchange happened if that is 'old'.
+ *   atomic_xchg(p, v) sets '*p' to 'v' and returns the old value.
+ *   All three are also full memory barriers, as is atomic_fence(): no load
+ *   or store moves across them, in the compiler or the processor. */
+
+static inline int
+atomic_xadd(volatile int *p, int v)
+{
+	asm volatile("lock; xaddl %0, %1"
+		     : "+r" (v), "+m" (*p) : : "cc", "memory");
+	return v;
+}
+
+static inline int
+atomic_cmpxchg(volatile int *p, int old, int new)
+{
+	int prev;
+	asm volatile("lock; cmpxchgl %2, %1"
+		     : "=a" (prev), "+m" (*p)
+		     : "r" (new), "0" (old)
+		     : "cc", "memory");
+	return prev;
+}
+
+static inline int
+atomic_xchg(volatile int *p, int v)
+{
+	// 'xchg' with memory is always locked.
+	asm volatile("xchgl %0, %1"
+		     : "+r" (v), "+m" (*p) : : "memory");
+	return v;
+}
+
+static inline void
+atomic_fence(void)
+{
+	// any locked instruction is a full barrier
+#ifndef WEENSYOS_HOSTSIM
+	asm volatile("lock; addl $0, (%%esp)" : : : "cc", "memory");
+#else
+	__sync_synchronize();
+#endif
+}
+
+/*****************************************************************************
+ * spinlock_t, spin_lock, spin_unlock
+ *
+ *   A ticket spinlock.  spin_lock() takes the next ticket and spins until
+ *   the lock is serving it, so waiters get the lock in the order they
+ *   arrived.  Only use a spinlock for short critical sections that never
+ *   block or yield: a waiter burns CPU for as long as the holder keeps it.
+ *   Initialize to SPINLOCK_INIT (all zeros). */
+
+typedef struct spinlock {
+	volatile int sl_next;		// next ticket to hand out
+	volatile int sl_owner;		// ticket now holding the lock
+} spinlock_t;
+
+#define SPINLOCK_INIT	{ 0, 0 }
+
+static inline void
+spin_lock(spinlock_t *l)
+{
+	int ticket = atomic_xadd(&l->sl_next, 1);
+	while (l->sl_owner != ticket)
+		asm volatile("pause" : : : "memory");
+}
+
+static inline void
+spin_unlock(spinlock_t *l)
+{
+	// Only the holder writes 'sl_owner'; x86 stores are not reordered
+	// with earlier loads and stores, so a compiler barrier suffices.
+	asm volatile("" : : : "memory");
+	l->sl_owner = l->sl_owner + 1;
+}
+
 /*****************************************************************************
  * va_list, va_start, va_arg, va_end
  *
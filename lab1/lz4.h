@@ -0,0 +1,26 @@
+#ifndef WEENSYOS_LZ4_H
+#define WEENSYOS_LZ4_H
+
+/*****************************************************************************
+ * lz4.h
+ *
+ *   An LZ4 image is a file compressed by build/mkbootdisk.c.  It is:
+ *
+ *     bytes 0-3   LZ4IMAGE_MAGIC
+ *     bytes 4-7   uncompressed size in bytes (little endian)
+ *     bytes 8-    a single LZ4 block holding the whole file
+ *
+ *   The block uses the standard LZ4 block format: a sequence of
+ *   (token, literals, 16-bit match offset, match length) records, the last
+ *   of which has literals only.
+ *
+ *****************************************************************************/
+
+#define LZ4IMAGE_MAGIC		0x345A4C7FU	/* "\x7FLZ4" in little endian */
+#define LZ4IMAGE_HDRSIZE	8
+
+// Worst-case size of an LZ4 block holding 'n' bytes: every byte a literal,
+// plus length bytes and a token.
+#define LZ4_COMPRESS_BOUND(n)	((n) + (n) / 255 + 16)
+
+#endif /* !WEENSYOS_LZ4_H */
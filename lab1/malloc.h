@@ -0,0 +1,376 @@
+#ifndef WEENSYOS_MALLOC_H
+#define WEENSYOS_MALLOC_H
+#include "process.h"
+
+/*****************************************************************************
+ * malloc.h
+ *
+ *   A heap allocator for miniprocos applications, built on sys_sbrk().
+ *   An application that wants a heap includes this file.
+ *
+ *   The heap belongs to the program, not the process: every process running
+ *   the program shares it, just as they share globals.  So the allocator
+ *   has two layers.
+ *
+ *   The back end manages the heap itself.  Every block carries its size and
+ *   an in-use bit in a header word before it and a footer word after it
+ *   ("boundary tags"), so a freed block can be merged with a free neighbor
+ *   on either side in constant time.  Free blocks sit on one doubly linked
+ *   list, searched first-fit.  When nothing fits, the heap grows by at
+ *   least MALLOC_GROW bytes.
+ *
+ *   The front end rounds small requests up to one of MALLOC_NCLASSES size
+ *   classes, and keeps a cache of freed blocks for each process and each
+ *   class.  Most malloc() and free() calls for small blocks just pop or
+ *   push the calling process's cache.  When a cache fills up, half of it is
+ *   handed back to the back end, which coalesces it; when the heap is full,
+ *   every cache is handed back before malloc() gives up.  The calling process
+ *   is found from its stack pointer (see stack_pid), so the front end makes
+ *   no system calls.
+ *
+ *   Processes can run in parallel on several CPUs, so the back end is
+ *   protected by a spinlock, and so is each process's cache: only its own
+ *   process uses it, except to flush it when the heap is full.  A process
+ *   that needs both takes its cache's lock first.  MiniprocOS never
+ *   preempts a process, so a lock holder runs until it lets go, and the
+ *   fast paths cost one uncontended lock.  An application that uses
+ *   malloc() must not call sys_sbrk() itself.
+ *
+ *****************************************************************************/
+
+#define MALLOC_NCLASSES		8	// block sizes 16, 32, ..., 2048
+#define MALLOC_CACHEBYTES	4096	// cached bytes per process per class
+#define MALLOC_GROW		16384	// least heap growth, in bytes
+#define MALLOC_MAXSIZE		0x100000 // no heap outgrows its 1 MB slot
+
+// Heap usage, as reported by malloc_stats().  Byte counts include block
+// headers and footers.
+typedef struct malloc_stats {
+	size_t ms_heap;			// heap size
+	size_t ms_inuse;		// bytes in allocated blocks
+	size_t ms_cached;		// bytes in front-end caches
+	size_t ms_free;			// bytes in free back-end blocks
+	size_t ms_largest;		// largest free back-end block
+	uint32_t ms_nfree;		// number of free back-end blocks
+} malloc_stats_t;
+
+
+// Boundary tags.  A block's size is a multiple of 8 and includes its
+// 4-byte header and footer, so the low bit is free for the in-use flag.
+// Pointers into the back end point at a block's payload, just past the
+// header; payloads are 8-byte aligned.
+#define MB_USED			1
+#define MB_SIZE(tag)		((tag) & ~7)
+#define MB_MINSIZE		16
+#define MB_CLASSSIZE(c)		(MB_MINSIZE << (c))
+
+struct mb_free {
+	struct mb_free *next;
+	struct mb_free *prev;
+};
+
+static spinlock_t mb_lock = SPINLOCK_INIT; // protects the back end
+static struct mb_free mb_freelist;	// circular, with this as sentinel
+static uint32_t *mb_heap;		// first block's payload
+static int mb_initialized;
+
+static spinlock_t mb_cachelock[NPROCS];	// protects each process's cache
+static struct mb_free *mb_cache[NPROCS][MALLOC_NCLASSES];
+static uint16_t mb_ncached[NPROCS][MALLOC_NCLASSES];
+static volatile int mb_cachedbytes;	// updated with atomic_xadd
+
+static inline uint32_t *
+mb_header(void *p)
+{
+	return (uint32_t *) p - 1;
+}
+
+static inline void *
+mb_next(void *p)
+{
+	return (uint8_t *) p + MB_SIZE(*mb_header(p));
+}
+
+static inline void *
+mb_prev(void *p)
+{
+	return (uint8_t *) p - MB_SIZE(*((uint32_t *) p - 2));
+}
+
+static inline void
+mb_settags(void *p, size_t size, int used)
+{
+	*mb_header(p) = size | used;
+	*(uint32_t *) ((uint8_t *) p + size - 8) = size | used;
+}
+
+static inline void
+mb_link(struct mb_free *f)
+{
+	f->next = mb_freelist.next;
+	f->prev = &mb_freelist;
+	f->next->prev = f;
+	mb_freelist.next = f;
+}
+
+static inline void
+mb_unlink(struct mb_free *f)
+{
+	f->prev->next = f->next;
+	f->next->prev = f->prev;
+}
+
+// Return the size class for a block of 'size' bytes: the smallest class
+// at least that big, or -1 if the block is too big for the front end.
+static inline int
+mb_class(size_t size)
+{
+	int c;
+	for (c = 0; c < MALLOC_NCLASSES; c++)
+		if (MB_CLASSSIZE(c) >= size)
+			return c;
+	return -1;
+}
+
+// Set up an empty heap: a used 8-byte "prologue" block and a used 0-byte
+// "epilogue" header, so coalescing never runs off either end.
+static int
+mb_init(void)
+{
+	uintptr_t brk = (uintptr_t) sys_sbrk(0);
+	uint32_t *p;
+
+	// start on an 8-byte boundary, so payloads are 8-byte aligned
+	if (brk == (uintptr_t) -1
+	    || sys_sbrk((-brk & 7) + 16) == (void *) -1)
+		return -1;
+	p = (uint32_t *) (brk + (-brk & 7));
+	p[0] = 0;			// padding
+	p[1] = 8 | MB_USED;		// prologue header
+	p[2] = 8 | MB_USED;		// prologue footer
+	p[3] = 0 | MB_USED;		// epilogue header
+	mb_heap = &p[4];
+	mb_freelist.next = mb_freelist.prev = &mb_freelist;
+	mb_initialized = 1;
+	return 0;
+}
+
+// Merge free block 'p' with its free neighbors, then put the result on the
+// free list.
+static void *
+mb_coalesce(void *p)
+{
+	size_t size = MB_SIZE(*mb_header(p));
+	void *next = mb_next(p);
+
+	if (!(*mb_header(next) & MB_USED)) {
+		mb_unlink((struct mb_free *) next);
+		size += MB_SIZE(*mb_header(next));
+	}
+	if (!(*((uint32_t *) p - 2) & MB_USED)) {
+		p = mb_prev(p);
+		mb_unlink((struct mb_free *) p);
+		size += MB_SIZE(*mb_header(p));
+	}
+	mb_settags(p, size, 0);
+	mb_link((struct mb_free *) p);
+	return p;
+}
+
+// Grow the heap by 'size' bytes, as one free block.
+static void *
+mb_extend(size_t size)
+{
+	void *p = sys_sbrk(size);
+	if (p == (void *) -1)
+		return NULL;
+	// the old epilogue header becomes the new block's header
+	mb_settags(p, size, 0);
+	*mb_header(mb_next(p)) = 0 | MB_USED;
+	return mb_coalesce(p);
+}
+
+// Allocate a block of exactly 'size' bytes (or a little more, if the rest
+// of the free block it comes from would be too small to use).
+static void *
+mb_alloc(size_t size)
+{
+	struct mb_free *f;
+	size_t fsize;
+
+	for (f = mb_freelist.next; f != &mb_freelist; f = f->next)
+		if (MB_SIZE(*mb_header(f)) >= size)
+			break;
+	if (f == &mb_freelist
+	    && !(f = (struct mb_free *) mb_extend(MAX(size, MALLOC_GROW))))
+		return NULL;
+
+	mb_unlink(f);
+	fsize = MB_SIZE(*mb_header(f));
+	if (fsize - size >= MB_MINSIZE) {
+		void *rest = (uint8_t *) f + size;
+		mb_settags(f, size, MB_USED);
+		mb_settags(rest, fsize - size, 0);
+		mb_link((struct mb_free *) rest);
+	} else
+		mb_settags(f, fsize, MB_USED);
+	return f;
+}
+
+static void
+mb_release(void *p)
+{
+	mb_settags(p, MB_SIZE(*mb_header(p)), 0);
+	mb_coalesce(p);
+}
+
+// Hand cached blocks of class 'c' back to the back end until process
+// 'pid''s cache holds only 'keep' of them.  The caller holds the cache's
+// lock.
+static void
+mb_flush(pid_t pid, int c, int keep)
+{
+	struct mb_free *f;
+	spin_lock(&mb_lock);
+	while (mb_ncached[pid][c] > keep) {
+		f = mb_cache[pid][c];
+		mb_cache[pid][c] = f->next;
+		mb_ncached[pid][c]--;
+		atomic_xadd(&mb_cachedbytes, -MB_CLASSSIZE(c));
+		mb_release(f);
+	}
+	spin_unlock(&mb_lock);
+}
+
+
+/*****************************************************************************
+ * malloc(size)
+ *
+ *   Return a pointer to 'size' bytes of fresh, 8-byte-aligned memory, or
+ *   NULL if the heap is full.  The memory's contents are unspecified.
+ *
+ *****************************************************************************/
+
+static void *
+malloc(size_t size)
+{
+	struct mb_free *f;
+	void *p;
+	pid_t pid;
+	int c;
+
+	if (size == 0 || size > MALLOC_MAXSIZE)
+		return NULL;
+	if (!mb_initialized) {
+		spin_lock(&mb_lock);
+		c = mb_initialized || mb_init() == 0;
+		spin_unlock(&mb_lock);
+		if (!c)
+			return NULL;
+	}
+
+	size = MAX(ROUNDUP(size + 8, 8), MB_MINSIZE);
+	if ((c = mb_class(size)) >= 0) {
+		pid = stack_pid();
+		spin_lock(&mb_cachelock[pid]);
+		if ((f = mb_cache[pid][c])) {
+			mb_cache[pid][c] = f->next;
+			mb_ncached[pid][c]--;
+			atomic_xadd(&mb_cachedbytes, -MB_CLASSSIZE(c));
+			spin_unlock(&mb_cachelock[pid]);
+			return f;
+		}
+		spin_unlock(&mb_cachelock[pid]);
+		size = MB_CLASSSIZE(c);
+	}
+	spin_lock(&mb_lock);
+	p = mb_alloc(size);
+	spin_unlock(&mb_lock);
+	if (!p && mb_cachedbytes > 0) {
+		for (pid = 0; pid < NPROCS; pid++) {
+			spin_lock(&mb_cachelock[pid]);
+			for (c = 0; c < MALLOC_NCLASSES; c++)
+				mb_flush(pid, c, 0);
+			spin_unlock(&mb_cachelock[pid]);
+		}
+		spin_lock(&mb_lock);
+		p = mb_alloc(size);
+		spin_unlock(&mb_lock);
+	}
+	return p;
+}
+
+
+/*****************************************************************************
+ * free(ptr)
+ *
+ *   Free memory returned by malloc().  free(NULL) does nothing.
+ *
+ *****************************************************************************/
+
+static void
+free(void *ptr)
+{
+	struct mb_free *f = (struct mb_free *) ptr;
+	size_t size;
+	pid_t pid;
+	int c;
+
+	if (!ptr)
+		return;
+	size = MB_SIZE(*mb_header(ptr));
+	c = mb_class(size);
+	if (c < 0 || MB_CLASSSIZE(c) != size) {
+		spin_lock(&mb_lock);
+		mb_release(ptr);
+		spin_unlock(&mb_lock);
+		return;
+	}
+
+	pid = stack_pid();
+	spin_lock(&mb_cachelock[pid]);
+	if (mb_ncached[pid][c] >= MALLOC_CACHEBYTES / size)
+		mb_flush(pid, c, mb_ncached[pid][c] / 2);
+	f->next = mb_cache[pid][c];
+	mb_cache[pid][c] = f;
+	mb_ncached[pid][c]++;
+	atomic_xadd(&mb_cachedbytes, size);
+	spin_unlock(&mb_cachelock[pid]);
+}
+
+
+/*****************************************************************************
+ * malloc_stats(ms)
+ *
+ *   Fill in '*ms' with the heap's current usage, by walking every block.
+ *   Blocks in front-end caches count as cached, not in use.
+ *
+ *****************************************************************************/
+
+static void
+malloc_stats(malloc_stats_t *ms)
+{
+	uint32_t *p;
+	size_t size;
+
+	memset(ms, 0, sizeof(*ms));
+	if (!mb_initialized)
+		return;
+	spin_lock(&mb_lock);
+	for (p = mb_heap; (size = MB_SIZE(*mb_header(p))) != 0;
+	     p = (uint32_t *) mb_next(p)) {
+		if (*mb_header(p) & MB_USED)
+			ms->ms_inuse += size;
+		else {
+			ms->ms_free += size;
+			ms->ms_largest = MAX(ms->ms_largest, size);
+			ms->ms_nfree++;
+		}
+	}
+	ms->ms_heap = (uintptr_t) sys_sbrk(0) - (uintptr_t) mb_heap + 16;
+	ms->ms_cached = mb_cachedbytes;
+	spin_unlock(&mb_lock);
+	ms->ms_inuse -= ms->ms_cached;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "process.h"
+#include "lib.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-bench-disk
+ *
+ *   This application measures the interrupt-driven disk driver (see
+ *   k-disk.c) through sys_disk_read().  In each test, 'procs' reading
+ *   processes read NREADS 4 KB blocks between them, while one more
+ *   process does nothing but count loops and yield: it shows how much CPU
+ *   time the readers leave free while they wait for the disk.  Two access
+ *   patterns are tested, for each number of readers in 'nreaders':
+ *
+ *   - seq: the readers take turns along the disk, reader R reading
+ *     blocks R, R + procs, R + 2 * procs, ..., so with several readers
+ *     the queue holds requests for adjacent blocks, which the driver
+ *     merges into one command;
+ *   - rand: each reader reads blocks at random.
+ *
+ *   Each test prints one line of key=value pairs:
+ *
+ *     test	seq or rand
+ *     procs	reading processes
+ *     kb_sec	KB read per second, by all readers together
+ *     lat	average microseconds per sys_disk_read()
+ *     max	longest sys_disk_read(), in microseconds
+ *     cmds	disk commands the NREADS reads took
+ *     work	loops the counting process ran during the test
+ *
+ *   Finally the benchmark checks that sector 0 ends with the boot
+ *   signature.  Run with one CPU ('make run CPUS=1') so the counting
+ *   process and the readers share it.
+ *
+ *****************************************************************************/
+
+#define NREADS		512
+#define BLOCKSECT	DISK_READ_MAX		// sectors per 4 KB block
+#define MAXREADERS	16
+
+static const int nreaders[] = { 1, 4, MAXREADERS };
+
+static uint8_t bufs[MAXREADERS][BLOCKSECT * SECTORSIZE];
+static uint64_t lat_total[MAXREADERS];
+static uint64_t lat_max[MAXREADERS];
+static volatile int done;
+static volatile uint32_t work;
+
+static void
+reader(int r, int procs, int random, uint32_t nblocks)
+{
+	uint32_t seed = r * 2654435761U + 1, block;
+	int i;
+
+	for (i = r; i < NREADS; i += procs) {
+		uint64_t before, t;
+
+		if (random) {
+			seed = seed * 1103515245 + 12345;
+			block = (seed >> 8) % nblocks;
+		} else
+			block = i % nblocks;
+		before = bench_now();
+		if (sys_disk_read(bufs[r], block * BLOCKSECT, BLOCKSECT) < 0) {
+			app_printf("reading block %u failed!\n", block);
+			sys_exit(1);
+		}
+		t = bench_now() - before;
+		lat_total[r] += t;
+		if (t > lat_max[r])
+			lat_max[r] = t;
+	}
+	sys_exit(0);
+}
+
+static void
+counter(void)
+{
+	volatile uint32_t x = 0;
+	int j;
+
+	while (!done) {
+		for (j = 0; j < 1000; j++)
+			x += j;
+		work++;
+		sys_yield();
+	}
+	sys_exit(0);
+}
+
+static void
+reap(pid_t p)
+{
+	int status;
+
+	while ((status = sys_wait(p)) == WAIT_TRYAGAIN)
+		sys_yield();
+	if (status != 0)
+		sys_exit(1);
+}
+
+static void
+test(int procs, int random, uint32_t nblocks)
+{
+	pid_t children[MAXREADERS], counter_pid;
+	kstats_t before_ks, after_ks;
+	uint64_t start, elapsed, lat = 0, max = 0;
+	int r;
+
+	memset(lat_total, 0, sizeof(lat_total));
+	memset(lat_max, 0, sizeof(lat_max));
+	done = 0;
+	work = 0;
+	sys_kstats(&before_ks);
+
+	if ((counter_pid = sys_fork()) == 0)
+		counter();
+	start = bench_now();
+	for (r = 0; r < procs; r++)
+		if ((children[r] = sys_fork()) == 0)
+			reader(r, procs, random, nblocks);
+		else if (children[r] < 0) {
+			app_printf("sys_fork failed!\n");
+			sys_exit(1);
+		}
+	for (r = 0; r < procs; r++)
+		reap(children[r]);
+	elapsed = bench_now() - start;
+	done = 1;
+	reap(counter_pid);
+	sys_kstats(&after_ks);
+
+	for (r = 0; r < procs; r++) {
+		lat += lat_total[r];
+		if (lat_max[r] > max)
+			max = lat_max[r];
+	}
+	app_printf("test=%s procs=%d kb_sec=%u lat=%u max=%u cmds=%u "
+		   "work=%u\n", random ? "rand" : "seq", procs,
+		   per_second(NREADS * BLOCKSECT * SECTORSIZE / 1024, elapsed),
+		   cycles_to_us(cycles_per(lat, NREADS)), cycles_to_us(max),
+		   after_ks.ks_disk_commands - before_ks.ks_disk_commands,
+		   work);
+}
+
+void
+pmain(void)
+{
+	kstats_t ks;
+	uint32_t nblocks;
+	int random;
+	size_t i;
+
+	sys_kstats(&ks);
+	nblocks = ks.ks_disk_sectors / BLOCKSECT;
+	if (nblocks == 0) {
+		app_printf("no disk!\n");
+		sys_exit(1);
+	}
+	app_printf("disk: %u KB\n", ks.ks_disk_sectors / 2);
+
+	for (random = 0; random < 2; random++)
+		for (i = 0; i < sizeof(nreaders) / sizeof(nreaders[0]); i++)
+			test(nreaders[i], random, nblocks);
+
+	if (sys_disk_read(bufs[0], 0, 1) < 0
+	    || bufs[0][510] != 0x55 || bufs[0][511] != 0xAA) {
+		app_printf("boot sector check failed!\n");
+		sys_exit(1);
+	}
+	app_printf("boot sector ok\n");
+	sys_exit(0);
+}
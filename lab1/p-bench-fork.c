@@ -0,0 +1,131 @@
+#include "process.h"
+#include "lib.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-bench-fork
+ *
+ *   This application measures process creation, like p-procos-app2 but
+ *   with numbers.  It forks batches of children that exit at once, and
+ *   reaps each batch with sys_wait(), NPROCESSES children in all.  It does
+ *   this with the parent's stack DEPTH bytes deep at fork time, for each
+ *   depth in 'depths', since sys_fork() copies the live stack.
+ *
+ *   For each depth it prints one line of key=value pairs:
+ *
+ *     depth	live stack bytes at fork time
+ *     procs	children created and reaped
+ *     per_sec	children created and reaped per second
+ *     fork	average cycles per sys_fork() call, in the parent
+ *     wait	average cycles in sys_wait() per child, retries included
+ *     sched	average cycles from sys_fork() returning in the parent to
+ *		the child first running
+ *
+ *   Output is the same on every run apart from the numbers, so runs before
+ *   and after a kernel change can be compared line by line.  When the
+ *   benchmark exits, the kernel shuts down and log.txt holds the screen.
+ *
+ *****************************************************************************/
+
+#define NPROCESSES	1000
+
+static const uint32_t depths[] = { 0, 4096, 16384, 65536 };
+
+// When sys_fork() returned to the parent, and when each child first ran,
+// indexed by the child's pid.
+static uint64_t forked_at[NPROCS];
+static volatile uint64_t started_at[NPROCS];
+
+struct totals {
+	uint32_t procs;
+	uint64_t fork;
+	uint64_t wait;
+	uint64_t sched;
+};
+
+// Fork children until NPROCESSES are done or no more fit, then reap them.
+// Returns 0 if no child could be forked.
+static int
+batch(struct totals *t)
+{
+	pid_t children[NPROCS];
+	int i, n = 0, status;
+	uint64_t before;
+
+	while (t->procs + n < NPROCESSES) {
+		pid_t p;
+		before = bench_now();
+		p = sys_fork();
+		if (p == 0) {
+			started_at[sys_getpid()] = bench_now();
+			sys_exit(0);
+		} else if (p < 0)
+			break;
+		forked_at[p] = bench_now();
+		t->fork += forked_at[p] - before;
+		children[n++] = p;
+	}
+
+	for (i = 0; i < n; i++) {
+		before = bench_now();
+		while ((status = sys_wait(children[i])) == WAIT_TRYAGAIN)
+			sys_yield();
+		t->wait += bench_now() - before;
+		// (with several CPUs, a child can run before the parent
+		// returns from sys_fork())
+		if (started_at[children[i]] > forked_at[children[i]])
+			t->sched += started_at[children[i]]
+				- forked_at[children[i]];
+		if (status != 0) {
+			app_printf("child %d exited with %d!\n",
+				   children[i], status);
+			sys_exit(1);
+		}
+	}
+	t->procs += n;
+	return n;
+}
+
+// Run batches from a stack that is at least 'depth' bytes deeper.
+static void
+run_at_depth(uint32_t depth, struct totals *t)
+{
+	volatile uint8_t pad[1024];
+
+	if (depth >= sizeof(pad)) {
+		pad[0] = 0;
+		run_at_depth(depth - sizeof(pad), t);
+		// reading 'pad' afterwards keeps the call from becoming a
+		// jump that reuses this frame
+		(void) pad[0];
+		return;
+	}
+	while (t->procs < NPROCESSES)
+		if (!batch(t)) {
+			app_printf("sys_fork failed!\n");
+			sys_exit(1);
+		}
+}
+
+void
+pmain(void)
+{
+	size_t d;
+
+	for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+		struct totals t;
+		uint64_t start;
+
+		memset(&t, 0, sizeof(t));
+		start = bench_now();
+		run_at_depth(depths[d], &t);
+		app_printf("depth=%u procs=%u per_sec=%u fork=%u wait=%u "
+			   "sched=%u\n", depths[d], t.procs,
+			   per_second(t.procs, bench_now() - start),
+			   cycles_per(t.fork, t.procs),
+			   cycles_per(t.wait, t.procs),
+			   cycles_per(t.sched, t.procs));
+	}
+
+	sys_exit(0);
+}
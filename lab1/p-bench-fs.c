@@ -0,0 +1,108 @@
+#include "process.h"
+#include "lib.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-bench-fs
+ *
+ *   This application measures the buffer cache and read-only filesystem
+ *   (see k-bcache.c and k-fs.c).  It reads each file in 'files' from
+ *   start to end, CHUNK bytes per sys_read(), twice: the first, cold pass
+ *   reads the file from disk, with read-ahead, and the second, warm pass
+ *   should find every block in the cache.  Each pass prints one line of
+ *   key=value pairs:
+ *
+ *     file	the file's name
+ *     pass	cold or warm
+ *     kb	the file's size, in KB
+ *     kb_sec	KB read per second
+ *     hits	blocks the buffer cache already had
+ *     misses	blocks read from disk because the process needed them
+ *     ahead	blocks read from disk in advance
+ *     cmds	disk commands the pass took
+ *
+ *   Both passes must read the same bytes, and the kernel's file must start
+ *   with the ELF magic number; the benchmark also checks that
+ *   opening a missing file fails.
+ *
+ *****************************************************************************/
+
+#define CHUNK		4096
+
+static const struct {
+	const char *name;
+	int elf;			// 1 if it must be an ELF file
+} files[] = {
+	{ "COPYRIGHT", 0 }, { "kernel.c", 0 }, { "kernel", 1 },
+	{ "kernel.asm", 0 }
+};
+
+static uint8_t buf[CHUNK];
+
+// Read all of file 'name', printing a line for 'pass'.  Returns a checksum
+// of its contents.
+static uint32_t
+readfile(const char *name, int elf, const char *pass)
+{
+	kstats_t before_ks, after_ks;
+	uint64_t start, elapsed;
+	uint32_t sum = 0, size = 0;
+	ssize_t n, i;
+	int fd;
+
+	sys_kstats(&before_ks);
+	start = bench_now();
+	if ((fd = sys_open(name)) < 0) {
+		app_printf("opening %s failed!\n", name);
+		sys_exit(1);
+	}
+	while ((n = sys_read(fd, buf, CHUNK)) > 0) {
+		if (size == 0 && elf
+		    && (n < 4 || memcmp(buf, "\177ELF", 4) != 0)) {
+			app_printf("%s is not an ELF file!\n", name);
+			sys_exit(1);
+		}
+		for (i = 0; i < n; i++)
+			sum = sum * 31 + buf[i];
+		size += n;
+	}
+	if (n < 0) {
+		app_printf("reading %s failed!\n", name);
+		sys_exit(1);
+	}
+	sys_close(fd);
+	elapsed = bench_now() - start;
+	sys_kstats(&after_ks);
+
+	app_printf("file=%s pass=%s kb=%u kb_sec=%u hits=%u misses=%u "
+		   "ahead=%u cmds=%u\n", name, pass, size / 1024,
+		   per_second(size / 1024, elapsed),
+		   after_ks.ks_bcache_hits - before_ks.ks_bcache_hits,
+		   after_ks.ks_bcache_misses - before_ks.ks_bcache_misses,
+		   after_ks.ks_bcache_readaheads - before_ks.ks_bcache_readaheads,
+		   after_ks.ks_disk_commands - before_ks.ks_disk_commands);
+	return sum;
+}
+
+void
+pmain(void)
+{
+	uint32_t cold;
+	size_t i;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		cold = readfile(files[i].name, files[i].elf, "cold");
+		if (readfile(files[i].name, files[i].elf, "warm") != cold) {
+			app_printf("%s read differently the second time!\n",
+				   files[i].name);
+			sys_exit(1);
+		}
+	}
+
+	if (sys_open("no-such-file") >= 0) {
+		app_printf("opened a missing file!\n");
+		sys_exit(1);
+	}
+	app_printf("files ok\n");
+	sys_exit(0);
+}
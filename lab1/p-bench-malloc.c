@@ -0,0 +1,113 @@
+#include "process.h"
+#include "lib.h"
+#include "malloc.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-bench-malloc
+ *
+ *   This application measures malloc() and free() (see malloc.h).
+ *   It does three runs, each reporting allocations per second, then how
+ *   big the heap is and how fragmented its free memory is:
+ *
+ *   'fixed'   Allocate and free one 32-byte block, NFIXED times.  The
+ *             process's front-end cache serves every call.
+ *   'random'  Keep NLIVE blocks of random sizes, 8 bytes to 2 KB, alive,
+ *             freeing a random one and allocating a replacement NRANDOM
+ *             times.  This works the back end too.
+ *   'shared'  NCHILDREN forked processes do the 'random' run at once,
+ *             taking turns every NYIELD steps, all on the one 1 MB heap.
+ *
+ *   Fragmentation is the share of the back end's free memory that lies
+ *   outside its largest free block: 0% means all free memory could serve
+ *   one big request.
+ *
+ *****************************************************************************/
+
+#define NFIXED		200000
+#define NLIVE		128
+#define NRANDOM		100000
+#define NCHILDREN	4
+#define NYIELD		1000
+#define MAXSIZE		2048
+
+static uint32_t
+random(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static void
+report(const char *name, uint32_t nallocs, uint64_t cycles)
+{
+	malloc_stats_t ms;
+	malloc_stats(&ms);
+	app_printf("%s: %u allocs/s, heap %uK, used %uK, free %uK in %u, frag %u%%\n",
+		   name, per_second(nallocs, cycles), ms.ms_heap / 1024,
+		   ms.ms_inuse / 1024, ms.ms_free / 1024, ms.ms_nfree,
+		   ms.ms_free ? 100 - ms.ms_largest * 100 / ms.ms_free : 0);
+}
+
+// The 'random' run.  Returns how many allocations it made.
+static uint32_t
+run_random(uint32_t seed, int yield)
+{
+	void *live[NLIVE];
+	uint32_t i, n = 0;
+
+	for (i = 0; i < NLIVE; i++, n++)
+		live[i] = malloc(8 + random(&seed) % MAXSIZE);
+	for (i = 0; i < NRANDOM; i++, n++) {
+		uint32_t j = random(&seed) % NLIVE;
+		free(live[j]);
+		live[j] = malloc(8 + random(&seed) % MAXSIZE);
+		if (!live[j]) {
+			app_printf("malloc failed!\n");
+			sys_exit(1);
+		}
+		if (yield && i % NYIELD == 0)
+			sys_yield();
+	}
+	for (i = 0; i < NLIVE; i++)
+		free(live[i]);
+	return n;
+}
+
+void
+pmain(void)
+{
+	uint64_t start;
+	uint32_t i;
+	pid_t children[NCHILDREN];
+	int c;
+
+	app_printf("malloc benchmark, %u kHz cycle counter\n", tsc_khz);
+
+	start = bench_now();
+	for (i = 0; i < NFIXED; i++)
+		free(malloc(32));
+	report("fixed", NFIXED, bench_now() - start);
+
+	start = bench_now();
+	i = run_random(1, 0);
+	report("random", i, bench_now() - start);
+
+	start = bench_now();
+	for (c = 0; c < NCHILDREN; c++) {
+		children[c] = sys_fork();
+		if (children[c] == 0)
+			sys_exit(run_random(c + 2, 1));
+	}
+	for (i = c = 0; c < NCHILDREN; c++) {
+		int status;
+		if (children[c] < 0)
+			continue;
+		while ((status = sys_wait(children[c])) == WAIT_TRYAGAIN)
+			sys_yield();
+		i += status;
+	}
+	report("shared", i, bench_now() - start);
+
+	sys_exit(0);
+}
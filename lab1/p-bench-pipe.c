@@ -0,0 +1,108 @@
+#include "process.h"
+#include "lib.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-bench-pipe
+ *
+ *   This application measures pipe throughput.  For each chunk size, it
+ *   forks a producer that writes NBYTES bytes into a pipe, CHUNK bytes per
+ *   sys_write(), while the parent reads them back out with CHUNK-byte
+ *   sys_read()s until end of file.  It checks every byte and reports
+ *   megabytes per second.  Small chunks measure per-call overhead; large
+ *   ones measure copying and blocking.
+ *
+ *****************************************************************************/
+
+#define NBYTES		(8 << 20)
+#define MAXCHUNK	16384
+
+static const size_t chunks[] = { 64, 512, 4096, 16384 };
+
+// The producer and consumer have separate buffers, since all processes
+// share globals.
+static uint8_t wbuf[MAXCHUNK];
+static uint8_t rbuf[MAXCHUNK];
+
+static void
+produce(int fd, size_t chunk)
+{
+	uint32_t sent = 0;
+	size_t i;
+	ssize_t r;
+
+	while (sent < NBYTES) {
+		for (i = 0; i < chunk; i++)
+			wbuf[i] = (uint8_t) (sent + i);
+		for (i = 0; i < chunk; i += r)
+			if ((r = sys_write(fd, wbuf + i, chunk - i)) <= 0) {
+				app_printf("write failed!\n");
+				sys_exit(1);
+			}
+		sent += chunk;
+	}
+	sys_exit(0);
+}
+
+// Read until end of file.  Returns the number of bytes read, or -1 if
+// any byte was wrong.
+static int32_t
+consume(int fd, size_t chunk)
+{
+	uint32_t received = 0;
+	ssize_t r, i;
+
+	while ((r = sys_read(fd, rbuf, chunk)) > 0) {
+		for (i = 0; i < r; i++)
+			if (rbuf[i] != (uint8_t) (received + i))
+				return -1;
+		received += r;
+	}
+	return received;
+}
+
+void
+pmain(void)
+{
+	int fds[2], status;
+	size_t c;
+	pid_t p;
+
+	app_printf("pipe benchmark, %u MB per run\n", NBYTES >> 20);
+
+	for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+		uint64_t start;
+		uint32_t kbps;
+		int32_t n;
+
+		if (sys_pipe(fds) < 0) {
+			app_printf("sys_pipe failed!\n");
+			sys_exit(1);
+		}
+
+		start = bench_now();
+		p = sys_fork();
+		if (p == 0) {
+			sys_close(fds[0]);
+			produce(fds[1], chunks[c]);
+		} else if (p < 0) {
+			app_printf("sys_fork failed!\n");
+			sys_exit(1);
+		}
+		sys_close(fds[1]);
+		n = consume(fds[0], chunks[c]);
+		sys_close(fds[0]);
+		while ((status = sys_wait(p)) == WAIT_TRYAGAIN)
+			sys_yield();
+
+		kbps = per_second(NBYTES >> 10, bench_now() - start);
+		if (n != NBYTES || status != 0)
+			app_printf("chunk %u: FAILED (%d bytes, status %d)\n",
+				   chunks[c], n, status);
+		else
+			app_printf("chunk %u: %u.%u MB/s\n", chunks[c],
+				   kbps >> 10, (kbps & 1023) * 10 >> 10);
+	}
+
+	sys_exit(0);
+}
@@ -0,0 +1,192 @@
+#include "process.h"
+#include "lib.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-bench-switch
+ *
+ *   This application measures what the kernel's cheapest operations cost,
+ *   in cycles:
+ *
+ *   - a null system call, sys_getpid();
+ *   - sys_yield() with nothing else to run, which goes through the
+ *     scheduler but returns to the same process;
+ *   - a context switch: a forked partner and the parent ping-pong with
+ *     sys_yield(), so every yield switches to the other process;
+ *   - a handoff round trip: the parent passes a token to the partner,
+ *     which passes it straight back, with 'nrunnable' processes runnable
+ *     in all (the rest just yield), first with sys_yield() and then with
+ *     sys_yield_to().  A plain yield waits behind every other runnable
+ *     process; a directed one switches straight to the partner.
+ *
+ *   Each is timed over NROUNDS rounds of NITER calls (or round trips),
+ *   and reported as the minimum, median and 99th percentile of the
+ *   per-call cost over rounds.  Run with one CPU ('make run CPUS=1'):
+ *   with more, the partner can run on another CPU, and the yields stop
+ *   switching.
+ *
+ *****************************************************************************/
+
+#define NROUNDS		100
+#define NITER		500
+#define MAXRUNNABLE	15
+
+static const int nrunnable[] = { 2, MAXRUNNABLE };
+
+static uint32_t samples[NROUNDS];
+static volatile int done;
+static volatile uint32_t token;		// odd: the partner's turn
+static pid_t parent_pid;
+
+// Sort 'samples' and print its minimum, median and 99th percentile, for
+// a test with 'nprocs' processes runnable (not shown if 0).
+static void
+report(const char *what, int nprocs)
+{
+	int i, j;
+	for (i = 1; i < NROUNDS; i++) {
+		uint32_t x = samples[i];
+		for (j = i; j > 0 && samples[j - 1] > x; j--)
+			samples[j] = samples[j - 1];
+		samples[j] = x;
+	}
+	if (nprocs > 0)
+		app_printf("%s, %d runnable", what, nprocs);
+	else
+		app_printf("%s", what);
+	app_printf(": min %u, median %u, p99 %u cycles\n", samples[0],
+		   samples[NROUNDS / 2],
+		   samples[(NROUNDS * 99 + 99) / 100 - 1]);
+}
+
+static void
+partner(void)
+{
+	while (!done)
+		sys_yield();
+	sys_exit(0);
+}
+
+// Pass the token back whenever it is ours, yielding to the parent if
+// 'directed'.
+static void
+handoff_partner(int directed)
+{
+	while (!done) {
+		if (token & 1)
+			token++;
+		if (directed)
+			sys_yield_to(parent_pid);
+		else
+			sys_yield();
+	}
+	sys_exit(0);
+}
+
+static void
+reap(pid_t p)
+{
+	while (sys_wait(p) == WAIT_TRYAGAIN)
+		sys_yield();
+}
+
+// Time handoff round trips with 'nprocs' processes runnable, ours
+// included.
+static void
+handoff(int nprocs, int directed)
+{
+	pid_t children[MAXRUNNABLE], partner_pid;
+	uint32_t ping;
+	uint64_t start;
+	int r, i, n;
+
+	done = 0;
+	token = 0;
+	for (n = 0; n < nprocs - 1; n++) {
+		if ((children[n] = sys_fork_stack(4096)) == 0) {
+			if (n == 0)
+				handoff_partner(directed);
+			partner();	// just yields
+		} else if (children[n] < 0) {
+			app_printf("sys_fork failed!\n");
+			sys_exit(1);
+		}
+	}
+	partner_pid = children[0];
+	// Let every child reach its loop before timing.
+	sys_yield();
+
+	for (r = 0; r < NROUNDS; r++) {
+		start = bench_now();
+		for (i = 0; i < NITER; i++) {
+			ping = ++token;
+			while (token == ping)
+				if (directed)
+					sys_yield_to(partner_pid);
+				else
+					sys_yield();
+		}
+		samples[r] = cycles_per(bench_now() - start, NITER);
+	}
+	done = 1;
+	for (n = 0; n < nprocs - 1; n++)
+		reap(children[n]);
+	report(directed ? "handoff with sys_yield_to"
+	       : "handoff with sys_yield", nprocs);
+}
+
+void
+pmain(void)
+{
+	uint64_t start;
+	int r, i;
+	size_t n;
+	pid_t p;
+
+	app_printf("switch benchmark, %u rounds of %u calls\n",
+		   NROUNDS, NITER);
+
+	for (r = 0; r < NROUNDS; r++) {
+		start = bench_now();
+		for (i = 0; i < NITER; i++)
+			sys_getpid();
+		samples[r] = cycles_per(bench_now() - start, NITER);
+	}
+	report("null syscall", 0);
+
+	for (r = 0; r < NROUNDS; r++) {
+		start = bench_now();
+		for (i = 0; i < NITER; i++)
+			sys_yield();
+		samples[r] = cycles_per(bench_now() - start, NITER);
+	}
+	report("yield to self", 0);
+
+	p = sys_fork_stack(4096);
+	if (p == 0)
+		partner();
+	else if (p < 0) {
+		app_printf("sys_fork failed!\n");
+		sys_exit(1);
+	}
+	// Let the partner reach its loop before timing.
+	sys_yield();
+	// Each of our yields runs the partner once: two switches.
+	for (r = 0; r < NROUNDS; r++) {
+		start = bench_now();
+		for (i = 0; i < NITER; i++)
+			sys_yield();
+		samples[r] = cycles_per(bench_now() - start, 2 * NITER);
+	}
+	done = 1;
+	reap(p);
+	report("context switch", 0);
+
+	parent_pid = sys_getpid();
+	for (n = 0; n < sizeof(nrunnable) / sizeof(nrunnable[0]); n++) {
+		handoff(nrunnable[n], 0);
+		handoff(nrunnable[n], 1);
+	}
+
+	sys_exit(0);
+}
@@ -0,0 +1,54 @@
+#include "process.h"
+#include "lib.h"
+
+/*****************************************************************************
+ * p-mixed
+ *
+ *   This application runs a mixed workload in one boot: it starts two
+ *   children, which use sys_exec() to become procos-app and procos-app3,
+ *   then waits for both to exit.  The three programs are resident and
+ *   running at the same time.
+ *
+ *   PROGRAM_PROCOS_APP and PROGRAM_PROCOS_APP3 come from the GNUmakefile.
+ *
+ *****************************************************************************/
+
+static pid_t start_program(int program_id);
+
+void
+pmain(void)
+{
+	pid_t p1, p3;
+	int status;
+
+	app_printf("Starting procos-app and procos-app3 together...\n");
+	p1 = start_program(PROGRAM_PROCOS_APP);
+	p3 = start_program(PROGRAM_PROCOS_APP3);
+
+	do {
+		status = sys_wait(p1);
+	} while (status == WAIT_TRYAGAIN);
+	app_printf("procos-app (process %d) exited with status %d\n", p1, status);
+
+	do {
+		status = sys_wait(p3);
+	} while (status == WAIT_TRYAGAIN);
+	app_printf("procos-app3 (process %d) exited with status %d\n", p3, status);
+
+	sys_exit(0);
+}
+
+static pid_t
+start_program(int program_id)
+{
+	pid_t p = sys_fork();
+	if (p == 0) {
+		sys_exec(program_id);
+		app_printf("sys_exec(%d) failed!\n", program_id);
+		sys_exit(1);
+	} else if (p < 0) {
+		app_printf("Error!\n");
+		sys_exit(1);
+	}
+	return p;
+}
@@ -11,6 +11,9 @@
 
 volatile int counter;
 
+// run_child() needs very little stack.
+#define CHILD_STACK_SIZE	4096
+
 void run_child(void);
 static void check(int actual_value, int expected_value, const char *type);
 
@@ -31,7 +34,7 @@ pmain(void)
 		// Start as many processes as possible, until we fail to start
 		// a process or we have started 1025 processes total.
 		while (counter + n_started < 1025) {
-			p = sys_fork();
+			p = sys_fork_stack(CHILD_STACK_SIZE);
 			if (p == 0) {
 				check(checker, 30, "child");
 				checker = 30 + counter;
@@ -62,11 +65,10 @@ pmain(void)
 void
 run_child(void)
 {
-	int input_counter = counter;
-
-	counter++;		/* Note that all "processes" share an address
-				   space, so this change to 'counter' will be
-				   visible to all processes. */
+	/* Note that all "processes" share an address space, so this change
+	   to 'counter' will be visible to all processes.  An atomic
+	   increment keeps it correct even if processes run at once. */
+	int input_counter = atomic_xadd((volatile int *) &counter, 1);
 
 	app_printf("Process %d lives, counter %d!\n",
 		   sys_getpid(), input_counter);
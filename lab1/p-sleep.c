@@ -0,0 +1,80 @@
+#include "process.h"
+#include "lib.h"
+#include "bench.h"
+
+/*****************************************************************************
+ * p-sleep
+ *
+ *   This application exercises sys_sleep.  It forks NSLEEPERS children,
+ *   and each sleeps NSLEEPS times for a random 1 to MAXSLEEP milliseconds,
+ *   timing every sleep with the cycle counter.  A sleep that ends early is
+ *   an error; each child reports how late its sleeps ended on average and
+ *   at worst.  The parent sleeps while it waits for them, so the processor
+ *   is idle nearly the whole time.
+ *
+ *****************************************************************************/
+
+#define NSLEEPERS	32
+#define NSLEEPS		10
+#define MAXSLEEP	500
+
+static uint32_t
+random(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static void
+sleeper(uint32_t seed)
+{
+	uint32_t i, late, total_late = 0, max_late = 0;
+
+	for (i = 0; i < NSLEEPS; i++) {
+		uint32_t ms = 1 + random(&seed) % MAXSLEEP;
+		uint64_t start = bench_now();
+		uint32_t us;
+
+		sys_sleep(ms);
+		us = cycles_to_us(bench_now() - start);
+		// allow 1% for error in the kernel's measure of 'tsc_khz'
+		if (us < ms * 990) {
+			app_printf("%d: slept %u us, wanted %u ms!\n",
+				   sys_getpid(), us, ms);
+			sys_exit(1);
+		}
+		late = us > ms * 1000 ? us - ms * 1000 : 0;
+		total_late += late;
+		max_late = MAX(max_late, late);
+	}
+	app_printf("%d: late by %u us on average, %u us at most\n",
+		   sys_getpid(), total_late / NSLEEPS, max_late);
+	sys_exit(0);
+}
+
+void
+pmain(void)
+{
+	pid_t children[NSLEEPERS];
+	uint64_t start = bench_now();
+	int c, status, failed = 0;
+
+	for (c = 0; c < NSLEEPERS; c++) {
+		children[c] = sys_fork_stack(4096);
+		if (children[c] == 0)
+			sleeper(c + 1);
+		else if (children[c] < 0) {
+			app_printf("sys_fork failed!\n");
+			sys_exit(1);
+		}
+	}
+
+	for (c = 0; c < NSLEEPERS; c++) {
+		while ((status = sys_wait(children[c])) == WAIT_TRYAGAIN)
+			sys_sleep(10);
+		failed += status != 0;
+	}
+	app_printf("%d sleepers done in %u ms, %d failed\n", NSLEEPERS,
+		   cycles_to_us(bench_now() - start) / 1000, failed);
+	sys_exit(0);
+}
@@ -0,0 +1,114 @@
+#include "process.h"
+#include "lib.h"
+#include "sync.h"
+
+/*****************************************************************************
+ * p-sync
+ *
+ *   This application exercises mutexes and condition variables (sync.h).
+ *   NPRODUCERS processes put the numbers 1 to NITEMS into a small shared
+ *   ring buffer, and NCONSUMERS processes take them out and add them up.
+ *   Everyone yields inside the critical section now and then, so other
+ *   processes find the mutex held and must sleep on it, and producers and
+ *   consumers often find the buffer full or empty.  At the end, the parent
+ *   checks that every item arrived exactly once.
+ *
+ *****************************************************************************/
+
+#define NPRODUCERS	4
+#define NCONSUMERS	4
+#define NITEMS		5000
+#define NSLOTS		8
+#define NYIELD		7
+
+static mutex_t lock;
+static cond_t notfull;
+static cond_t notempty;
+static int buffer[NSLOTS];
+static int head, tail, count;		// protected by 'lock'
+static int nconsumed;			// protected by 'lock'
+static volatile int sum;		// updated with atomic_xadd
+
+static void
+produce(void)
+{
+	int i;
+	for (i = 1; i <= NITEMS; i++) {
+		mutex_lock(&lock);
+		while (count == NSLOTS)
+			cond_wait(&notfull, &lock);
+		buffer[tail] = i;
+		tail = (tail + 1) % NSLOTS;
+		count++;
+		cond_signal(&notempty);
+		if (i % NYIELD == 0)
+			sys_yield();
+		mutex_unlock(&lock);
+	}
+	sys_exit(0);
+}
+
+static void
+consume(void)
+{
+	int n = 0, item;
+	while (1) {
+		mutex_lock(&lock);
+		while (count == 0 && nconsumed < NPRODUCERS * NITEMS)
+			cond_wait(&notempty, &lock);
+		if (count == 0) {
+			// Everything is consumed; wake the other consumers so
+			// they notice too.
+			cond_broadcast(&notempty);
+			mutex_unlock(&lock);
+			sys_exit(n);
+		}
+		item = buffer[head];
+		head = (head + 1) % NSLOTS;
+		count--;
+		nconsumed++;
+		cond_signal(&notfull);
+		if (++n % NYIELD == 0)
+			sys_yield();
+		mutex_unlock(&lock);
+		atomic_xadd(&sum, item);
+	}
+}
+
+void
+pmain(void)
+{
+	pid_t children[NPRODUCERS + NCONSUMERS];
+	int c, status, total = 0;
+
+	for (c = 0; c < NPRODUCERS + NCONSUMERS; c++) {
+		children[c] = sys_fork_stack(4096);
+		if (children[c] == 0) {
+			if (c < NPRODUCERS)
+				produce();
+			else
+				consume();
+		} else if (children[c] < 0) {
+			app_printf("sys_fork failed!\n");
+			sys_exit(1);
+		}
+	}
+
+	for (c = 0; c < NPRODUCERS + NCONSUMERS; c++) {
+		while ((status = sys_wait(children[c])) == WAIT_TRYAGAIN)
+			sys_yield();
+		if (c >= NPRODUCERS) {
+			app_printf("consumer %d took %d items\n",
+				   children[c], status);
+			total += status;
+		}
+	}
+
+	// Each producer's items add up to NITEMS * (NITEMS + 1) / 2.
+	if (total == NPRODUCERS * NITEMS
+	    && sum == NPRODUCERS * (NITEMS * (NITEMS + 1) / 2))
+		app_printf("%d items, sum %d: OK\n", total, sum);
+	else
+		app_printf("%d items, sum %d: FAILED\n", total, sum);
+	sys_exit(0);
+}
@@ -6,7 +6,7 @@
 /*****************************************************************************
  * process.h
  *
- *   This header file defines the C versions of the 5 system calls.
+ *   This header file defines the C versions of the system calls.
  *   Each system call is defined by assembly code that implements a protected
  *   control transfer to the kernel, using the 'int' machine instruction.
  *   Any arguments to the system call are passed in registers, which have
@@ -70,11 +70,38 @@ static inline pid_t
 sys_fork(void)
 {
 	// This system call follows the same pattern as sys_getpid().
+	// %eax == 0 gives the child the same stack limit as the parent
+	// (see sys_fork_stack, below).
 
 	pid_t result;
 	asm volatile("int %1\n"
 		     : "=a" (result)
-		     : "i" (INT_SYS_FORK)
+		     : "i" (INT_SYS_FORK),
+		       "a" (0)
+		     : "cc", "memory");
+	return result;
+}
+
+
+/*****************************************************************************
+ * sys_fork_stack(stack_limit)
+ *
+ *   Like sys_fork, but the child's stack may grow to at most 'stack_limit'
+ *   bytes (rounded up to whole pages, and at most 256 KB) instead of the
+ *   parent's limit.  A stack only takes up as much memory as it has
+ *   actually used, so small limits are for catching runaway recursion.
+ *   Returns -1 if the parent's current stack would not fit in the child's.
+ *
+ *****************************************************************************/
+
+static inline pid_t
+sys_fork_stack(size_t stack_limit)
+{
+	pid_t result;
+	asm volatile("int %1\n"
+		     : "=a" (result)
+		     : "i" (INT_SYS_FORK),
+		       "a" (stack_limit)
 		     : "cc", "memory");
 	return result;
 }
@@ -100,6 +127,29 @@ sys_yield(void)
 }
 
 
+/*****************************************************************************
+ * sys_yield_to(pid)
+ *
+ *   Like sys_yield(), but hand the CPU straight to process 'pid' if it is
+ *   runnable and waiting for a CPU, ahead of every other process waiting.
+ *   Otherwise (it is blocked, or running on another CPU, or there is no
+ *   such process) this is sys_yield().  A process that has just produced
+ *   something for another can use it to have that process run next.
+ *
+ *****************************************************************************/
+
+static inline void
+sys_yield_to(pid_t pid)
+{
+	// The kernel leaves %eax alone.
+	asm volatile("int %0\n"
+		     :
+		     : "i" (INT_SYS_YIELD_TO),
+		       "a" (pid)
+		     : "cc", "memory");
+}
+
+
 /*****************************************************************************
  * sys_exit(status)
  *
@@ -163,6 +213,305 @@ sys_wait(pid_t pid)
 
 
 
+/*****************************************************************************
+ * sys_exec(program_id)
+ *
+ *   Replace the current process's program with program 'program_id'
+ *   (its position in the application directory on disk, counting from 0),
+ *   starting at its entry point with an empty stack.  The process ID stays the same.
+ *   Several processes may run different programs at the same time.
+ *   Returns -1 if there is no such program; otherwise does not return.
+ *
+ *****************************************************************************/
+
+static inline int
+sys_exec(int program_id)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_EXEC),
+		       "a" (program_id)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_sbrk(increment)
+ *
+ *   Grow (or, if 'increment' is negative, shrink) the heap by 'increment'
+ *   bytes, and return the old end of the heap.  sys_sbrk(0) returns the
+ *   current end.  The heap starts just past the program's globals, and,
+ *   like them, is shared by every process running the program.  New heap
+ *   memory reads as zero.
+ *   Returns (void *) -1 if the heap cannot grow (or shrink) that far.
+ *   Most applications should use malloc() instead (see malloc.h).
+ *
+ *****************************************************************************/
+
+static inline void *
+sys_sbrk(intptr_t increment)
+{
+	void *retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_SBRK),
+		       "a" (increment)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_pipe(fds)
+ *
+ *   Create a pipe: a buffer in the kernel that one process can write bytes
+ *   into and another can read them out of, in order.  Stores a file
+ *   descriptor for the read end in fds[0], and one for the write end in
+ *   fds[1].  A forked child inherits its parent's file descriptors.
+ *   Returns 0 on success, -1 on error (no free file descriptors, say).
+ *
+ *****************************************************************************/
+
+static inline int
+sys_pipe(int *fds)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_PIPE),
+		       "a" (fds)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_read(fd, buf, n)
+ * sys_write(fd, buf, n)
+ *
+ *   Read up to 'n' bytes from file descriptor 'fd' into 'buf', or write up
+ *   to 'n' bytes from 'buf' to 'fd'.  Returns the number of bytes read or
+ *   written, which may be less than 'n', or -1 on error.
+ *   Reading an empty pipe blocks until there is something to read, and
+ *   returns 0 once every write end is closed.  Writing a full pipe blocks
+ *   until there is room; writing a pipe with no read end returns -1.
+ *   Reading a file (see sys_open) returns 0 at its end; files cannot be
+ *   written.
+ *
+ *****************************************************************************/
+
+static inline ssize_t
+sys_read(int fd, void *buf, size_t n)
+{
+	ssize_t retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_READ),
+		       "a" (fd), "b" (buf), "c" (n)
+		     : "cc", "memory");
+	return retval;
+}
+
+static inline ssize_t
+sys_write(int fd, const void *buf, size_t n)
+{
+	ssize_t retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_WRITE),
+		       "a" (fd), "b" (buf), "c" (n)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_close(fd)
+ *
+ *   Close file descriptor 'fd'.  A pipe end closes when no process has a
+ *   descriptor for it any more.  sys_exit closes all of a process's file
+ *   descriptors.  Returns 0 on success, -1 if 'fd' is not open.
+ *
+ *****************************************************************************/
+
+static inline int
+sys_close(int fd)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_CLOSE),
+		       "a" (fd)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_futex_wait(addr, expected)
+ * sys_futex_wake(addr, n)
+ *
+ *   Low-level waiting, for building locks (see sync.h).  sys_futex_wait
+ *   blocks until another process calls sys_futex_wake on the same address,
+ *   but only if the int at 'addr' still equals 'expected' when the kernel
+ *   looks; otherwise it returns -1 right away.  It returns 0 once woken.
+ *   Callers must recheck their condition after waking.
+ *   sys_futex_wake wakes up to 'n' processes waiting on 'addr', or all of
+ *   them if 'n' is negative, and returns how many it woke.
+ *
+ *****************************************************************************/
+
+static inline int
+sys_futex_wait(volatile int *addr, int expected)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_FUTEX_WAIT),
+		       "a" (addr), "b" (expected)
+		     : "cc", "memory");
+	return retval;
+}
+
+static inline int
+sys_futex_wake(volatile int *addr, int n)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_FUTEX_WAKE),
+		       "a" (addr), "b" (n)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_sleep(ms)
+ *
+ *   Block for at least 'ms' milliseconds, using no CPU time, and let other
+ *   processes run in the meantime.  The kernel counts time in timer ticks,
+ *   so the sleep may last up to a tick longer.  sys_sleep(0) is like
+ *   sys_yield().
+ *
+ *****************************************************************************/
+
+static inline void
+sys_sleep(uint32_t ms)
+{
+	// The kernel returns 0 in %eax, so tell the compiler it changes.
+	asm volatile("int %1\n"
+		     : "+a" (ms)
+		     : "i" (INT_SYS_SLEEP)
+		     : "cc", "memory");
+}
+
+
+
+/*****************************************************************************
+ * sys_disk_read(buf, sect, nsect)
+ *
+ *   Read 'nsect' sectors, at most DISK_READ_MAX, starting at sector 'sect'
+ *   of the boot disk, into 'buf'.  The process blocks until the disk has
+ *   the data, and other processes run meanwhile.  sys_kstats() reports
+ *   the disk's size.
+ *   Returns 0 on success, -1 on error (a bad buffer, or sectors past the
+ *   end of the disk, say).
+ *
+ *****************************************************************************/
+
+static inline int
+sys_disk_read(void *buf, uint32_t sect, uint32_t nsect)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_DISK_READ),
+		       "a" (buf), "b" (sect), "c" (nsect)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * sys_open(name)
+ *
+ *   Open the file called 'name' in the boot disk's read-only filesystem,
+ *   for reading from its start with sys_read().  Forked children share the
+ *   file's position.  The kernel keeps recently read blocks in memory, and
+ *   reads ahead of a process that reads a file in order, so the process
+ *   seldom waits for the disk.
+ *   Returns a file descriptor, or -1 if there is no such file or no free
+ *   descriptor.
+ *
+ *****************************************************************************/
+
+static inline int
+sys_open(const char *name)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_OPEN),
+		       "a" (name)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
+/*****************************************************************************
+ * stack_pid
+ *
+ *   Returns the current process's process ID, like sys_getpid(), but
+ *   without a system call: each process has its own stack slot (see
+ *   PROC_STACK_TOP in const.h), so the stack pointer says which process
+ *   is running.
+ *
+ *****************************************************************************/
+
+static inline pid_t
+stack_pid(void)
+{
+	uintptr_t esp;
+	asm volatile("movl %%esp,%0" : "=r" (esp));
+	return (esp - 1 - STACK_REGION_START) / PROC_STACK_SIZE + 1;
+}
+
+
+
+/*****************************************************************************
+ * sys_kstats(ks)
+ *
+ *   Copy the kernel's memory usage into '*ks': how many page frames are
+ *   free, and how full each slab cache is (see kstats_t in const.h).
+ *   Returns 0 on success, -1 if 'ks' is not a valid buffer.
+ *
+ *****************************************************************************/
+
+static inline int
+sys_kstats(kstats_t *ks)
+{
+	int retval;
+	asm volatile("int %1\n"
+		     : "=a" (retval)
+		     : "i" (INT_SYS_KSTATS),
+		       "a" (ks)
+		     : "cc", "memory");
+	return retval;
+}
+
+
+
 /*****************************************************************************
  * app_printf(format, ...)
  *
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ex4.h"
+#include "pdist.h"
+#include "timing.h"
+
+// Benchmark the batched distance kernels in pdist.c against a loop of
+// point_dist() calls (ex4.c) over arrays of struct point.  Computes the
+// distances between N pairs of random points (1 M, or the number given on
+// the command line), and from one point to N points, repeating until
+// about MINWORK distances are done.  Reports the best of 3 runs in
+// millions of distances per second.  Every kernel's results must equal
+// point_dist()'s exactly.
+//
+// Usage: bench-dist [points]
+
+double point_dist(struct point *pt1, struct point *pt2);
+
+#define MINWORK (64UL << 20)
+
+static struct point *pa, *pb;
+static double *x1, *y1, *x2, *y2, *out, *want;
+
+static void
+aos_pairs(size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = point_dist(&pa[i], &pb[i]);
+}
+
+static void
+aos_from(size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = point_dist(&pb[0], &pa[i]);
+}
+
+struct test {
+	const char *name;
+	void (*aos)(size_t n);		// or:
+	pdist_fn kernel;
+	int avx, sq, bcast;
+};
+
+static const struct test tests[] = {
+	{ "point_dist pairs", aos_pairs, NULL, 0, 0, 0 },
+	{ "scalar pairs", NULL, pdist_scalar, 0, 0, 0 },
+	{ "sse2 pairs", NULL, pdist_sse2, 0, 0, 0 },
+	{ "avx pairs", NULL, pdist_avx, 1, 0, 0 },
+	{ "avx pairs, squared", NULL, pdist_avx, 1, 1, 0 },
+	{ "point_dist from", aos_from, NULL, 0, 0, 1 },
+	{ "scalar from", NULL, pdist_scalar, 0, 0, 1 },
+	{ "sse2 from", NULL, pdist_sse2, 0, 0, 1 },
+	{ "avx from", NULL, pdist_avx, 1, 0, 1 },
+	{ "avx from, squared", NULL, pdist_avx, 1, 1, 1 },
+};
+
+static void
+run(const struct test *t, size_t n)
+{
+	if (t->aos)
+		t->aos(n);
+	else
+		t->kernel(x1, y1, x2, y2, out, n, t->sq, t->bcast);
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1UL << 20;
+	size_t reps = n < MINWORK ? MINWORK / n : 1;
+	int have_avx = pdist_have_avx();
+
+	pa = malloc(n * sizeof(*pa));
+	pb = malloc(n * sizeof(*pb));
+	x1 = malloc(n * sizeof(double));
+	y1 = malloc(n * sizeof(double));
+	x2 = malloc(n * sizeof(double));
+	y2 = malloc(n * sizeof(double));
+	out = malloc(n * sizeof(double));
+	want = malloc(n * sizeof(double));
+	if (!pa || !pb || !x1 || !y1 || !x2 || !y2 || !out || !want) {
+		fprintf(stderr, "bench-dist: cannot allocate %zu points\n", n);
+		return 1;
+	}
+	srandom(1);
+	for (size_t i = 0; i < n; i++) {
+		pa[i].x = x1[i] = random() / 1e6;
+		pa[i].y = y1[i] = random() / 1e6;
+		pb[i].x = x2[i] = random() / 1e6;
+		pb[i].y = y2[i] = random() / 1e6;
+	}
+
+	printf("%zu points, %zu repetitions\n", n, reps);
+	for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+		const struct test *test = &tests[t];
+		double best = 0;
+
+		if (test->avx && !have_avx) {
+			printf("%-20s (no AVX)\n", test->name);
+			continue;
+		}
+		for (int r = 0; r < 3; r++) {
+			double start = now_sec(), time;
+			for (size_t i = 0; i < reps; i++)
+				run(test, n);
+			time = now_sec() - start;
+			if (best == 0 || time < best)
+				best = time;
+		}
+
+		// point_dist()'s results are the reference.
+		if (test->aos)
+			memcpy(want, out, n * sizeof(double));
+		for (size_t i = 0; i < n; i++) {
+			double w = test->sq ? want[i] * want[i] : want[i];
+			if (test->sq ? out[i] > w * (1 + 1e-12)
+				       || out[i] < w * (1 - 1e-12)
+			    : out[i] != w) {
+				printf("%s: wrong result at %zu\n",
+				       test->name, i);
+				return 1;
+			}
+		}
+		printf("%-20s %8.1f M/s\n", test->name,
+		       (double) n * reps / best * 1e-6);
+	}
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "distmat.h"
+#include "ex4.h"
+#include "timing.h"
+
+// Benchmark dist_matrix() against filling the whole matrix with nested
+// point_dist() calls (ex4.c), for 4096 random points (or the number
+// given), with 1 thread, 2, and so on up to the number of online CPUs (or
+// the count given).  Reports the best of 3 runs in seconds and GFLOP/s,
+// counting 6 floating-point operations (2 subtractions, 2
+// multiplications, an addition and a square root) per distance actually
+// computed, and the speedup over one thread.  The point_dist() loop
+// computes every distance into a buffer one row long, so it needs no
+// n * n matrix of its own; CHECKROWS rows of each result, spread evenly,
+// must then equal point_dist()'s.
+//
+// Given a file name, the matrix is written to that file through
+// dist_matrix_map() instead of memory; the time of every run includes
+// writing it back, and it is mapped again, read-only, to be checked.
+//
+// Usage: bench-distmat [points [max-threads [file]]]
+
+double point_dist(struct point *pt1, struct point *pt2);
+
+#define FLOPS		6
+#define CHECKROWS	64
+
+// Map the n * n matrix that dist_matrix_unmap() wrote to "path", to read
+// it back.
+static double *
+map_result(const char *path, size_t n)
+{
+	void *m;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	m = mmap(NULL, n * n * sizeof(double), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return m == MAP_FAILED ? NULL : m;
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 4096;
+	int maxthreads = argc > 2 ? atoi(argv[2])
+		: (int) sysconf(_SC_NPROCESSORS_ONLN);
+	const char *path = argc > 3 ? argv[3] : NULL;
+	struct point *pts = malloc(n * sizeof(*pts));
+	double *x = malloc(n * sizeof(double));
+	double *y = malloc(n * sizeof(double));
+	double *want = malloc(n * sizeof(double));
+	double *m = path ? NULL : malloc(n * n * sizeof(double));
+	double start, naive, best1 = 0;
+	size_t step = n / CHECKROWS ? n / CHECKROWS : 1;
+
+	if (!pts || !x || !y || !want || (!path && !m)) {
+		fprintf(stderr, "bench-distmat: cannot allocate %zu points\n",
+			n);
+		return 1;
+	}
+	srandom(1);
+	for (size_t i = 0; i < n; i++) {
+		pts[i].x = x[i] = random() / 1e6;
+		pts[i].y = y[i] = random() / 1e6;
+	}
+
+	start = now_sec();
+	for (size_t i = 0; i < n; i++)
+		for (size_t j = 0; j < n; j++)
+			want[j] = point_dist(&pts[i], &pts[j]);
+	naive = now_sec() - start;
+
+	printf("%zu points, %s\n", n, path ? path : "in memory");
+	printf("%-10s %9s %8s %8s\n", "threads", "seconds", "GFLOP/s",
+	       "speedup");
+	printf("%-10s %9.3f %8.2f\n", "point_dist", naive,
+	       (double) n * n * FLOPS / naive * 1e-9);
+	for (int nthreads = 1; nthreads <= maxthreads; nthreads++) {
+		double best = 0;
+
+		for (int r = 0; r < 3; r++) {
+			double t;
+
+			start = now_sec();
+			if (path && !(m = dist_matrix_map(path, n))) {
+				perror(path);
+				return 1;
+			}
+			dist_matrix(x, y, n, m, nthreads);
+			if (path && dist_matrix_unmap(m, n) < 0) {
+				perror(path);
+				return 1;
+			}
+			t = now_sec() - start;
+			if (best == 0 || t < best)
+				best = t;
+		}
+		if (nthreads == 1)
+			best1 = best;
+
+		if (path && !(m = map_result(path, n))) {
+			perror(path);
+			return 1;
+		}
+		for (size_t i = 0; i < n; i++) {
+			if (i % step != 0 && i != n - 1)
+				continue;
+			for (size_t j = 0; j < n; j++)
+				want[j] = point_dist(&pts[i], &pts[j]);
+			for (size_t j = 0; j < n; j++)
+				if (dist_matrix_get(m, n, i, j) != want[j]) {
+					printf("wrong distance (%zu, %zu) with %d threads\n",
+					       i, j, nthreads);
+					return 1;
+				}
+		}
+		if (path)
+			munmap(m, n * n * sizeof(double));
+		printf("%-10d %9.3f %8.2f %8.2f\n", nthreads, best,
+		       (double) n * (n + 1) / 2 * FLOPS / best * 1e-9,
+		       best1 / best);
+	}
+	return 0;
+}
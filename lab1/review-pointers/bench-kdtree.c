@@ -0,0 +1,171 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ex4.h"
+#include "kdtree.h"
+#include "timing.h"
+
+// Benchmark k-d tree queries (kdtree.c) against scanning every point with
+// point_dist() (ex4.c).  For 1 K, 10 K, ... points, up to 10 M (or the
+// number given on the command line), builds a tree over random points,
+// then times NQUERY queries for the K nearest points, and NQUERY queries
+// for the points within a radius chosen to hold about K of them.  The
+// scans are slow for large sets, so they run only as many queries as
+// take about SCANWORK distances.  Every tree query's results must match
+// the scan's.
+//
+// Usage: bench-kdtree [maxpoints]
+
+double point_dist(struct point *pt1, struct point *pt2);
+
+#define K		8
+#define NQUERY		10000
+#define SCANWORK	(100UL << 20)
+#define SPAN		1e3		// coordinates are in [0, SPAN)
+
+static double
+rand_coord(void)
+{
+	return random() / (RAND_MAX + 1.0) * SPAN;
+}
+
+// Find the K points nearest "q" by scanning; writes their distances to
+// "dist", nearest first.
+static void
+scan_knn(struct point *pts, size_t n, struct point *q, double *dist)
+{
+	size_t found = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		double d = point_dist(q, &pts[i]);
+		size_t j;
+
+		if (found == K && d >= dist[K - 1])
+			continue;
+		if (found < K)
+			found++;
+		for (j = found - 1; j > 0 && dist[j - 1] > d; j--)
+			dist[j] = dist[j - 1];
+		dist[j] = d;
+	}
+}
+
+static size_t
+scan_radius(struct point *pts, size_t n, struct point *q, double r)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < n; i++)
+		count += point_dist(q, &pts[i]) <= r;
+	return count;
+}
+
+static int
+bench(size_t n)
+{
+	struct point *pts = malloc(n * sizeof(*pts));
+	struct point *qs = malloc(NQUERY * sizeof(*qs));
+	size_t *radius_counts = malloc(NQUERY * sizeof(size_t));
+	size_t nscan = SCANWORK / n < 10 ? 10 : SCANWORK / n;
+	// a circle of this radius holds about K points
+	double r = sqrt(K / M_PI * SPAN * SPAN / n);
+	struct kdtree tree;
+	size_t idx[K], total = 0;
+	double dist2[K], dist[K], start, build_time, knn_time, radius_time;
+	double scan_knn_time, scan_radius_time;
+
+	if (nscan > NQUERY)
+		nscan = NQUERY;
+	if (!pts || !qs || !radius_counts) {
+		fprintf(stderr, "bench-kdtree: cannot allocate %zu points\n", n);
+		return 1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		pts[i].x = rand_coord();
+		pts[i].y = rand_coord();
+	}
+	for (size_t i = 0; i < NQUERY; i++) {
+		qs[i].x = rand_coord();
+		qs[i].y = rand_coord();
+	}
+
+	start = now_sec();
+	if (kdtree_build(&tree, pts, n) < 0) {
+		fprintf(stderr, "bench-kdtree: cannot build tree of %zu points\n", n);
+		return 1;
+	}
+	build_time = now_sec() - start;
+
+	start = now_sec();
+	for (size_t i = 0; i < NQUERY; i++)
+		total += kdtree_knn(&tree, qs[i].x, qs[i].y, K, idx, dist2);
+	knn_time = now_sec() - start;
+
+	start = now_sec();
+	for (size_t i = 0; i < NQUERY; i++)
+		total += radius_counts[i] =
+			kdtree_radius(&tree, qs[i].x, qs[i].y, r, idx, K);
+	radius_time = now_sec() - start;
+
+	start = now_sec();
+	for (size_t i = 0; i < nscan; i++)
+		scan_knn(pts, n, &qs[i], dist);
+	scan_knn_time = now_sec() - start;
+
+	start = now_sec();
+	for (size_t i = 0; i < nscan; i++)
+		scan_radius(pts, n, &qs[i], r);
+	scan_radius_time = now_sec() - start;
+
+	// Check a sample of queries against the scans.  The tree compares
+	// squared distances, so allow for rounding.
+	for (size_t i = 0; i < nscan; i++) {
+		size_t found = kdtree_knn(&tree, qs[i].x, qs[i].y, K, idx, dist2);
+
+		scan_knn(pts, n, &qs[i], dist);
+		for (size_t j = 0; j < found; j++)
+			if (fabs(sqrt(dist2[j]) - dist[j]) > 1e-9
+			    || fabs(point_dist(&qs[i], &pts[idx[j]]) - dist[j])
+			       > 1e-9) {
+				printf("%zu points: wrong neighbor %zu for query %zu\n",
+				       n, j, i);
+				return 1;
+			}
+		if (radius_counts[i] != scan_radius(pts, n, &qs[i], r)) {
+			printf("%zu points: wrong radius count for query %zu\n",
+			       n, i);
+			return 1;
+		}
+	}
+
+	printf("%9zu %9.1f %9.2f %9.2f %11.1f %11.1f %8.0fx\n", n,
+	       build_time * 1e3, knn_time / NQUERY * 1e6,
+	       radius_time / NQUERY * 1e6, scan_knn_time / nscan * 1e6,
+	       scan_radius_time / nscan * 1e6,
+	       (scan_knn_time / nscan) / (knn_time / NQUERY));
+
+	// keep the queries from being optimized away
+	if (total == 0)
+		printf("no results\n");
+	kdtree_free(&tree);
+	free(pts);
+	free(qs);
+	free(radius_counts);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t max = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+
+	srandom(1);
+	printf("k = %d; build in ms, queries in us\n", K);
+	printf("%9s %9s %9s %9s %11s %11s %9s\n", "points", "build",
+	       "knn", "radius", "scan knn", "scan radius", "speedup");
+	for (size_t n = 1000; n <= max; n *= 10)
+		if (bench(n))
+			return 1;
+	return 0;
+}
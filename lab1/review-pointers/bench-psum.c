@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "psum.h"
+#include "sum.h"
+#include "timing.h"
+
+// Benchmark array_sum_parallel() and array_scan_parallel() on one array
+// of 64 M ints (or the size given on the command line), with 1 thread, 2,
+// and so on up to the number of online CPUs (or the count given).  Reports
+// the best of 5 runs in elements per nanosecond, and the speedup over one
+// thread.  Results are checked against the serial versions.  The scan
+// timed is the inclusive one; the exclusive scan is run once more with
+// each thread count, untimed, to check it too.
+//
+// Usage: bench-psum [elements [max-threads]]
+
+static double
+best_of(int runs, void (*fn)(void *), void *arg)
+{
+	double best = 0;
+	for (int i = 0; i < runs; i++) {
+		double start = now_sec(), t;
+		fn(arg);
+		t = now_sec() - start;
+		if (best == 0 || t < best)
+			best = t;
+	}
+	return best;
+}
+
+struct args {
+	const int *arr;
+	long long *out;
+	size_t n;
+	int nthreads;
+	long long sum;
+};
+
+static void
+run_sum(void *arg)
+{
+	struct args *a = arg;
+	a->sum = array_sum_parallel(a->arr, a->n, a->nthreads);
+}
+
+static void
+run_scan(void *arg)
+{
+	struct args *a = arg;
+	array_scan_parallel(a->arr, a->out, a->n, a->nthreads, 1);
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 64UL << 20;
+	int maxthreads = argc > 2 ? atoi(argv[2])
+		: (int) sysconf(_SC_NPROCESSORS_ONLN);
+	struct args a = { .n = n };
+	double sum1 = 0, scan1 = 0;
+	long long want, running = 0;
+	int *arr;
+
+	arr = malloc(n * sizeof(int));
+	a.out = malloc(n * sizeof(long long));
+	if (!arr || !a.out) {
+		fprintf(stderr, "bench-psum: cannot allocate %zu elements\n", n);
+		return 1;
+	}
+	srandom(1);
+	for (size_t i = 0; i < n; i++)
+		arr[i] = (int) (random() - (1L << 30));
+	a.arr = arr;
+	want = array_sum64(arr, n);
+
+	printf("n = %zu\n%7s %10s %7s %10s %7s   (elements/ns, best of 5)\n",
+	       n, "threads", "sum", "speedup", "scan", "speedup");
+	for (a.nthreads = 1; a.nthreads <= maxthreads; a.nthreads++) {
+		double tsum = best_of(5, run_sum, &a);
+		double tscan = best_of(5, run_scan, &a);
+
+		if (a.nthreads == 1) {
+			sum1 = tsum;
+			scan1 = tscan;
+		}
+		if (a.sum != want) {
+			printf("wrong sum with %d threads\n", a.nthreads);
+			return 1;
+		}
+		running = 0;
+		for (size_t i = 0; i < n; i++)
+			if (a.out[i] != (running += arr[i])) {
+				printf("wrong scan at %zu with %d threads\n",
+				       i, a.nthreads);
+				return 1;
+			}
+		array_scan_parallel(arr, a.out, n, a.nthreads, 0);
+		running = 0;
+		for (size_t i = 0; i < n; running += arr[i++])
+			if (a.out[i] != running) {
+				printf("wrong exclusive scan at %zu with %d "
+				       "threads\n", i, a.nthreads);
+				return 1;
+			}
+		printf("%7d %10.2f %7.2f %10.2f %7.2f\n", a.nthreads,
+		       n / tsum * 1e-9, sum1 / tsum, n / tscan * 1e-9,
+		       scan1 / tscan);
+	}
+
+	free(arr);
+	free(a.out);
+	return 0;
+}
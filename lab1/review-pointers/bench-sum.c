@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sum.h"
+#include "timing.h"
+
+// Benchmark the array_sum() variants in sum.c, over arrays of 1 K to
+// 256 M ints (or the size given on the command line), growing by 4x.
+// Each variant sums about MINWORK elements at every size, repeating small
+// arrays, and reports the best of 3 runs in elements per nanosecond.  The
+// array starts one int past an aligned address, so the vector versions
+// always have a head and a tail to handle, and its values are large
+// enough that the int sums overflow.  Every result is checked against the
+// scalar versions.
+//
+// Usage: bench-sum [max-elements]
+
+#define MINWORK (256UL << 20)
+
+struct variant {
+	const char *name;
+	int avx2;
+	int (*sum)(const int *, size_t);
+	long long (*sum64)(const int *, size_t);
+};
+
+static const struct variant variants[] = {
+	{ "scalar", 0, array_sum_scalar, NULL },
+	{ "sse2", 0, array_sum_sse2, NULL },
+	{ "avx2", 1, array_sum_avx2, NULL },
+	{ "scalar64", 0, NULL, array_sum64_scalar },
+	{ "sse2-64", 0, NULL, array_sum64_sse2 },
+	{ "avx2-64", 1, NULL, array_sum64_avx2 },
+};
+#define NVARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+int
+main(int argc, char **argv)
+{
+	size_t maxn = argc > 1 ? strtoul(argv[1], NULL, 0) : 256UL << 20;
+	int have_avx2 = array_sum_have_avx2();
+	int *buf, *arr;
+
+	if (!(buf = aligned_alloc(64, (maxn + 16) * sizeof(int)))) {
+		fprintf(stderr, "bench-sum: cannot allocate %zu ints\n", maxn);
+		return 1;
+	}
+	arr = buf + 1;
+	srandom(1);
+	for (size_t i = 0; i < maxn; i++)
+		arr[i] = (int) (random() - (1L << 30));
+
+	printf("%10s", "n");
+	for (size_t v = 0; v < NVARIANTS; v++)
+		printf(" %9s", variants[v].name);
+	printf("   (elements/ns, best of 3)\n");
+
+	for (size_t n = 1024; n <= maxn; n *= 4) {
+		size_t reps = n < MINWORK ? MINWORK / n : 1;
+		int want = array_sum_scalar(arr, n);
+		long long want64 = array_sum64_scalar(arr, n);
+
+		printf("%10zu", n);
+		for (size_t v = 0; v < NVARIANTS; v++) {
+			const struct variant *var = &variants[v];
+			double best = 0;
+			if (var->avx2 && !have_avx2) {
+				printf(" %9s", "-");
+				continue;
+			}
+			for (int run = 0; run < 3; run++) {
+				volatile long long sink = 0;
+				double start = now_sec(), t;
+				for (size_t r = 0; r < reps; r++)
+					sink += var->sum ? var->sum(arr, n)
+						: var->sum64(arr, n);
+				t = now_sec() - start;
+				if (best == 0 || t < best)
+					best = t;
+			}
+			if (var->sum ? var->sum(arr, n) != want
+			    : var->sum64(arr, n) != want64) {
+				printf("\n%s: wrong sum for n=%zu\n",
+				       var->name, n);
+				return 1;
+			}
+			printf(" %9.2f", (double) n * reps / best * 1e-9);
+		}
+		printf("\n");
+	}
+
+	free(buf);
+	return 0;
+}
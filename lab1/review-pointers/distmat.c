@@ -0,0 +1,122 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "distmat.h"
+#include "pdist.h"
+
+#define MAXTHREADS	256
+
+struct job {
+	const double *x;
+	const double *y;
+	size_t n;
+	double *m;
+	size_t ntiles;		// tiles per side
+	size_t next;		// next tile to hand out, as row * ntiles + col
+};
+
+struct worker {
+	struct job *job;
+	pthread_t thread;
+};
+
+// Compute the tile at block row "bi" and block column "bj" >= bi.  Each
+// row of the tile is one batched call, distances from point i to the
+// tile's columns; on the diagonal, only to the columns from i on.
+static void
+tile_run(struct job *job, size_t bi, size_t bj)
+{
+	size_t i0 = bi * DISTMAT_TILE, j0 = bj * DISTMAT_TILE;
+	size_t iend = i0 + DISTMAT_TILE < job->n ? i0 + DISTMAT_TILE : job->n;
+	size_t jend = j0 + DISTMAT_TILE < job->n ? j0 + DISTMAT_TILE : job->n;
+
+	for (size_t i = i0; i < iend; i++) {
+		size_t j = bi == bj ? i : j0;
+		point_dist_from(job->x[i], job->y[i], job->x + j, job->y + j,
+				job->m + i * job->n + j, jend - j);
+	}
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct job *job = ((struct worker *) arg)->job;
+	size_t t;
+
+	// Tiles below the diagonal are skipped, not handed out.
+	while ((t = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED))
+	       < job->ntiles * job->ntiles) {
+		size_t bi = t / job->ntiles, bj = t % job->ntiles;
+		if (bj >= bi)
+			tile_run(job, bi, bj);
+	}
+	return NULL;
+}
+
+void
+dist_matrix(const double *x, const double *y, size_t n, double *m,
+	    int nthreads)
+{
+	struct job job = {
+		.x = x, .y = y, .n = n, .m = m,
+		.ntiles = (n + DISTMAT_TILE - 1) / DISTMAT_TILE
+	};
+	struct worker workers[MAXTHREADS];
+	size_t ntri = job.ntiles * (job.ntiles + 1) / 2;
+	int i, nstarted;
+
+	if (nthreads <= 0)
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if ((size_t) nthreads > ntri)
+		nthreads = (int) ntri;
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	// The calling thread is worker 0.  Tiles are handed out as threads
+	// ask for them, so if a thread cannot be started, the ones that were
+	// share its tiles.
+	for (i = 0; i < nthreads; i++)
+		workers[i].job = &job;
+	for (nstarted = 1; nstarted < nthreads; nstarted++)
+		if (pthread_create(&workers[nstarted].thread, NULL, worker_run,
+				   &workers[nstarted]) != 0)
+			break;
+	worker_run(&workers[0]);
+	for (i = 1; i < nstarted; i++)
+		pthread_join(workers[i].thread, NULL);
+}
+
+double *
+dist_matrix_map(const char *path, size_t n)
+{
+	size_t size = n * n * sizeof(double);
+	void *m;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		return NULL;
+	}
+	m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	// the mapping keeps the file open
+	close(fd);
+	return m == MAP_FAILED ? NULL : m;
+}
+
+int
+dist_matrix_unmap(double *m, size_t n)
+{
+	size_t size = n * n * sizeof(double);
+
+	if (msync(m, size, MS_SYNC) < 0) {
+		munmap(m, size);
+		return -1;
+	}
+	return munmap(m, size);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+// The matrix of distances between every pair of n points, stored as a
+// structure of arrays as in pdist.h: point i is (x[i], y[i]).
+//
+// The matrix is n * n doubles, row-major: the distance between points i
+// and j is m[i * n + j].  Since that equals m[j * n + i], only the upper
+// triangle (j >= i) is computed and written; use dist_matrix_get() to
+// read either half.
+//
+// The work is split into square tiles of DISTMAT_TILE rows and columns,
+// so the points a tile reads stay in the L1 cache while it is computed,
+// rather than streaming all n points past the cache for every row.  Tiles
+// are handed out to threads one at a time, in row order, so threads stay
+// busy however unequal the tiles on the diagonal are.
+
+#define DISTMAT_TILE	256
+
+// Compute the upper triangle of the distance matrix into "m".
+// "nthreads" is how many threads to use; 0 means one per online CPU.
+void dist_matrix(const double *x, const double *y, size_t n, double *m,
+		 int nthreads);
+
+static inline double
+dist_matrix_get(const double *m, size_t n, size_t i, size_t j)
+{
+	return i <= j ? m[i * n + j] : m[j * n + i];
+}
+
+// Create (or truncate) the file "path" to hold an n * n matrix, and map
+// it into memory, so dist_matrix() can fill in matrices larger than RAM:
+// the kernel writes finished pages back to the file as memory runs short.
+// Only the upper triangle's pages are ever written, so for large n most
+// of the file's lower triangle is left as holes that take no disk space,
+// on filesystems with sparse files.
+// Returns NULL on error, with errno set.
+double *dist_matrix_map(const char *path, size_t n);
+
+// Write a mapped matrix back to its file and unmap it.  Returns 0 on
+// success and -1 on error, with errno set.
+int dist_matrix_unmap(double *m, size_t n);
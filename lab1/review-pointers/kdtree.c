@@ -0,0 +1,316 @@
+#include <stdlib.h>
+
+#include "kdtree.h"
+
+// A point during construction, with its build-array position.
+struct kdpoint {
+	double c[2];		// x, y
+	size_t index;
+};
+
+static inline void
+kdswap(struct kdpoint *a, struct kdpoint *b)
+{
+	struct kdpoint t = *a;
+	*a = *b;
+	*b = t;
+}
+
+static void
+insertion_sort(struct kdpoint *a, size_t n, int dim)
+{
+	for (size_t i = 1; i < n; i++)
+		for (size_t j = i; j > 0 && a[j].c[dim] < a[j - 1].c[dim]; j--)
+			kdswap(&a[j], &a[j - 1]);
+}
+
+static void select_kth(struct kdpoint *a, size_t n, size_t k, int dim);
+
+// Return a pivot guaranteed to have at least about 3/10 of the "n" points
+// on each side: the median of the medians of groups of 5.  Reorders "a".
+static double
+median_of_medians(struct kdpoint *a, size_t n, int dim)
+{
+	size_t m = 0;
+	for (size_t i = 0; i < n; i += 5) {
+		size_t len = n - i < 5 ? n - i : 5;
+		insertion_sort(a + i, len, dim);
+		kdswap(&a[m++], &a[i + len / 2]);
+	}
+	select_kth(a, m, m / 2, dim);
+	return a[m / 2].c[dim];
+}
+
+// Reorder "a" so that a[k] holds the point that would be there if "a" were
+// sorted by coordinate "dim", with no greater points before it and no
+// lesser points after.  Linear time.
+static void
+select_kth(struct kdpoint *a, size_t n, size_t k, int dim)
+{
+	while (n > 10) {
+		double pivot = median_of_medians(a, n, dim);
+		size_t lt = 0, i = 0, gt = n;
+
+		// three-way partition: [0, lt) < pivot, [lt, gt) == pivot,
+		// [gt, n) > pivot, so runs of equal points cannot stall it
+		while (i < gt) {
+			if (a[i].c[dim] < pivot)
+				kdswap(&a[lt++], &a[i++]);
+			else if (a[i].c[dim] > pivot)
+				kdswap(&a[i], &a[--gt]);
+			else
+				i++;
+		}
+		if (k < lt)
+			n = lt;
+		else if (k < gt)
+			return;
+		else {
+			a += gt;
+			k -= gt;
+			n -= gt;
+		}
+	}
+	insertion_sort(a, n, dim);
+}
+
+static void
+build(struct kdpoint *a, size_t lo, size_t hi, int dim)
+{
+	while (hi - lo > KDTREE_LEAF) {
+		size_t mid = lo + (hi - lo) / 2;
+		select_kth(a + lo, hi - lo, mid - lo, dim);
+		build(a, lo, mid, !dim);
+		lo = mid + 1;
+		dim = !dim;
+	}
+}
+
+int
+kdtree_build(struct kdtree *tree, const struct point *pts, size_t n)
+{
+	struct kdpoint *a;
+
+	// an empty tree has no arrays; malloc(0) may return NULL
+	tree->n = n;
+	if (n == 0) {
+		tree->x = tree->y = NULL;
+		tree->index = NULL;
+		return 0;
+	}
+	a = malloc(n * sizeof(*a));
+	tree->x = malloc(n * sizeof(double));
+	tree->y = malloc(n * sizeof(double));
+	tree->index = malloc(n * sizeof(size_t));
+	if (!a || !tree->x || !tree->y || !tree->index) {
+		free(a);
+		kdtree_free(tree);
+		return -1;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		a[i].c[0] = pts[i].x;
+		a[i].c[1] = pts[i].y;
+		a[i].index = i;
+	}
+	build(a, 0, n, 0);
+	for (size_t i = 0; i < n; i++) {
+		tree->x[i] = a[i].c[0];
+		tree->y[i] = a[i].c[1];
+		tree->index[i] = a[i].index;
+	}
+	free(a);
+	return 0;
+}
+
+void
+kdtree_free(struct kdtree *tree)
+{
+	free(tree->x);
+	free(tree->y);
+	free(tree->index);
+	tree->x = tree->y = NULL;
+	tree->index = NULL;
+	tree->n = 0;
+}
+
+
+// k-nearest-neighbor search keeps the best points so far in a max-heap on
+// squared distance, so the worst of them, which a new point must beat, is
+// always at the top.
+
+struct knn {
+	const struct kdtree *tree;
+	double q[2];
+	size_t k;
+	size_t count;
+	size_t *pos;		// heap of tree positions
+	double *d2;		// and their squared distances
+};
+
+static inline double
+dist2(const struct kdtree *tree, const double *q, size_t i)
+{
+	double dx = tree->x[i] - q[0], dy = tree->y[i] - q[1];
+	return dx * dx + dy * dy;
+}
+
+static void
+heap_sift_down(struct knn *s, size_t i, size_t n)
+{
+	size_t pos = s->pos[i];
+	double d2 = s->d2[i];
+
+	while (2 * i + 1 < n) {
+		size_t c = 2 * i + 1;
+		if (c + 1 < n && s->d2[c + 1] > s->d2[c])
+			c++;
+		if (s->d2[c] <= d2)
+			break;
+		s->pos[i] = s->pos[c];
+		s->d2[i] = s->d2[c];
+		i = c;
+	}
+	s->pos[i] = pos;
+	s->d2[i] = d2;
+}
+
+static inline void
+knn_offer(struct knn *s, size_t pos, double d2)
+{
+	size_t i;
+
+	if (s->count == s->k) {
+		if (d2 >= s->d2[0])
+			return;
+		s->pos[0] = pos;
+		s->d2[0] = d2;
+		heap_sift_down(s, 0, s->count);
+		return;
+	}
+	// sift up
+	for (i = s->count++; i > 0 && s->d2[(i - 1) / 2] < d2; i = (i - 1) / 2) {
+		s->pos[i] = s->pos[(i - 1) / 2];
+		s->d2[i] = s->d2[(i - 1) / 2];
+	}
+	s->pos[i] = pos;
+	s->d2[i] = d2;
+}
+
+static void
+knn_search(struct knn *s, size_t lo, size_t hi, int dim)
+{
+	const struct kdtree *tree = s->tree;
+
+	while (hi - lo > KDTREE_LEAF) {
+		size_t mid = lo + (hi - lo) / 2;
+		double split = dim ? tree->y[mid] : tree->x[mid];
+		double diff = s->q[dim] - split;
+
+		knn_offer(s, mid, dist2(tree, s->q, mid));
+		// Search the side the query is on first; the other side
+		// only matters if the splitting line is nearer than the
+		// current k-th best.
+		if (diff < 0) {
+			knn_search(s, lo, mid, !dim);
+			if (s->count == s->k && diff * diff >= s->d2[0])
+				return;
+			lo = mid + 1;
+		} else {
+			knn_search(s, mid + 1, hi, !dim);
+			if (s->count == s->k && diff * diff >= s->d2[0])
+				return;
+			hi = mid;
+		}
+		dim = !dim;
+	}
+	for (size_t i = lo; i < hi; i++)
+		knn_offer(s, i, dist2(tree, s->q, i));
+}
+
+size_t
+kdtree_knn(const struct kdtree *tree, double qx, double qy, size_t k,
+	   size_t *idx, double *dist2_out)
+{
+	struct knn s = { tree, { qx, qy }, k < tree->n ? k : tree->n, 0 };
+	size_t n;
+
+	if (s.k == 0)
+		return 0;
+	s.pos = idx;
+	s.d2 = dist2_out ? dist2_out : malloc(s.k * sizeof(double));
+	if (!s.d2)
+		return 0;
+	knn_search(&s, 0, tree->n, 0);
+
+	// Heapsort the results in place, nearest first, then map tree
+	// positions to build-array positions.
+	for (n = s.count; n > 1; n--) {
+		size_t pos = s.pos[0];
+		double d2 = s.d2[0];
+		s.pos[0] = s.pos[n - 1];
+		s.d2[0] = s.d2[n - 1];
+		heap_sift_down(&s, 0, n - 1);
+		s.pos[n - 1] = pos;
+		s.d2[n - 1] = d2;
+	}
+	for (n = 0; n < s.count; n++)
+		idx[n] = tree->index[idx[n]];
+	if (!dist2_out)
+		free(s.d2);
+	return s.count;
+}
+
+
+struct radius {
+	const struct kdtree *tree;
+	double q[2];
+	double r2;
+	size_t *idx;
+	size_t max;
+	size_t count;
+};
+
+static inline void
+radius_offer(struct radius *s, size_t pos)
+{
+	if (dist2(s->tree, s->q, pos) <= s->r2) {
+		if (s->count < s->max)
+			s->idx[s->count] = s->tree->index[pos];
+		s->count++;
+	}
+}
+
+static void
+radius_search(struct radius *s, size_t lo, size_t hi, int dim)
+{
+	const struct kdtree *tree = s->tree;
+
+	while (hi - lo > KDTREE_LEAF) {
+		size_t mid = lo + (hi - lo) / 2;
+		double diff = s->q[dim] - (dim ? tree->y[mid] : tree->x[mid]);
+
+		radius_offer(s, mid);
+		if (diff * diff <= s->r2)
+			radius_search(s, diff < 0 ? mid + 1 : lo,
+				      diff < 0 ? hi : mid, !dim);
+		if (diff < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+		dim = !dim;
+	}
+	for (size_t i = lo; i < hi; i++)
+		radius_offer(s, i);
+}
+
+size_t
+kdtree_radius(const struct kdtree *tree, double qx, double qy, double r,
+	      size_t *idx, size_t max)
+{
+	struct radius s = { tree, { qx, qy }, r * r, idx, max, 0 };
+
+	if (r >= 0)
+		radius_search(&s, 0, tree->n, 0);
+	return s.count;
+}
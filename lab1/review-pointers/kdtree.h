@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "ex4.h"
+
+// A 2-d tree over an array of struct point (ex4.h), for finding the
+// points nearest a query point without measuring the distance to every
+// one of them.
+//
+// The tree is implicit: there are no nodes or pointers, just the points,
+// reordered.  The points in positions [lo, hi) form a subtree.  Unless it
+// is a leaf of at most KDTREE_LEAF points, the point at its middle position
+// "mid" splits it: the points before "mid" are no greater than it in the
+// subtree's split coordinate, and the points after are no less.  The split
+// coordinate is x at the root and alternates with depth.  Points are
+// stored as separate x and y arrays, so leaves are scanned with sequential
+// reads, and so is the start of every subtree.
+//
+// Queries compare squared distances, so they never compute a square root,
+// and skip any subtree that cannot hold a point closer than the ones
+// already found.
+
+#define KDTREE_LEAF	8
+
+struct kdtree {
+	size_t n;
+	double *x;		// the points' coordinates, in tree order
+	double *y;
+	size_t *index;		// each point's position in the build array
+};
+
+// Build "tree" over the "n" points at "pts", which are not changed.
+// Splits are found with the median-of-medians selection algorithm, so
+// building takes O(n log n) time however the points are arranged.
+// Returns 0 on success, -1 if out of memory.
+int kdtree_build(struct kdtree *tree, const struct point *pts, size_t n);
+
+void kdtree_free(struct kdtree *tree);
+
+// Find the "k" points nearest (qx, qy).  Writes their build-array
+// positions to "idx", and their squared distances to "dist2" unless it is
+// NULL, nearest first.  Returns how many were found: "k", or all "n"
+// points if there are fewer.
+size_t kdtree_knn(const struct kdtree *tree, double qx, double qy, size_t k,
+		  size_t *idx, double *dist2);
+
+// Find the points within distance "r" of (qx, qy), in no particular
+// order.  Writes the build-array positions of the first "max" of them to
+// "idx", and returns how many there are in all.
+size_t kdtree_radius(const struct kdtree *tree, double qx, double qy,
+		     double r, size_t *idx, size_t max);
@@ -0,0 +1,161 @@
+#include <math.h>
+#include <immintrin.h>
+
+#include "pdist.h"
+
+// Each vector kernel loads 2 or 4 x's and y's at a time, unaligned, with
+// the remaining points done by the scalar kernel.  The arithmetic is the
+// same as point_dist()'s, in the same order, so every version returns
+// exactly the same results.
+//
+// The public kernels dispatch on "sq" and "bcast" once, to a body that
+// the compiler specializes for each combination, so the loops themselves
+// have no branches.
+
+#define PDIST_SPECIALIZE(body, x1, y1, x2, y2, out, n, sq, bcast)	\
+	do {								\
+		if (sq && bcast)					\
+			body(x1, y1, x2, y2, out, n, 1, 1);		\
+		else if (sq)						\
+			body(x1, y1, x2, y2, out, n, 1, 0);		\
+		else if (bcast)						\
+			body(x1, y1, x2, y2, out, n, 0, 1);		\
+		else							\
+			body(x1, y1, x2, y2, out, n, 0, 0);		\
+	} while (0)
+
+__attribute__((always_inline))
+static inline void
+scalar_body(const double *x1, const double *y1, const double *x2,
+	    const double *y2, double *out, size_t n, const int sq,
+	    const int bcast)
+{
+	for (size_t i = 0; i < n; i++) {
+		double dx = x1[i] - x2[bcast ? 0 : i];
+		double dy = y1[i] - y2[bcast ? 0 : i];
+		double d2 = dx * dx + dy * dy;
+		out[i] = sq ? d2 : sqrt(d2);
+	}
+}
+
+void
+pdist_scalar(const double *x1, const double *y1, const double *x2,
+	     const double *y2, double *out, size_t n, int sq, int bcast)
+{
+	PDIST_SPECIALIZE(scalar_body, x1, y1, x2, y2, out, n, sq, bcast);
+}
+
+__attribute__((target("sse2"), always_inline))
+static inline void
+sse2_body(const double *x1, const double *y1, const double *x2,
+	  const double *y2, double *out, size_t n, const int sq,
+	  const int bcast)
+{
+	__m128d qx = bcast ? _mm_set1_pd(*x2) : _mm_setzero_pd();
+	__m128d qy = bcast ? _mm_set1_pd(*y2) : _mm_setzero_pd();
+	size_t i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m128d dx = _mm_sub_pd(_mm_loadu_pd(x1 + i),
+					bcast ? qx : _mm_loadu_pd(x2 + i));
+		__m128d dy = _mm_sub_pd(_mm_loadu_pd(y1 + i),
+					bcast ? qy : _mm_loadu_pd(y2 + i));
+		__m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx),
+					_mm_mul_pd(dy, dy));
+		_mm_storeu_pd(out + i, sq ? d2 : _mm_sqrt_pd(d2));
+	}
+	scalar_body(x1 + i, y1 + i, bcast ? x2 : x2 + i, bcast ? y2 : y2 + i,
+		    out + i, n - i, sq, bcast);
+}
+
+__attribute__((target("sse2")))
+void
+pdist_sse2(const double *x1, const double *y1, const double *x2,
+	   const double *y2, double *out, size_t n, int sq, int bcast)
+{
+	PDIST_SPECIALIZE(sse2_body, x1, y1, x2, y2, out, n, sq, bcast);
+}
+
+__attribute__((target("avx"), always_inline))
+static inline void
+avx_body(const double *x1, const double *y1, const double *x2,
+	 const double *y2, double *out, size_t n, const int sq,
+	 const int bcast)
+{
+	__m256d qx = bcast ? _mm256_set1_pd(*x2) : _mm256_setzero_pd();
+	__m256d qy = bcast ? _mm256_set1_pd(*y2) : _mm256_setzero_pd();
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x1 + i),
+			bcast ? qx : _mm256_loadu_pd(x2 + i));
+		__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y1 + i),
+			bcast ? qy : _mm256_loadu_pd(y2 + i));
+		__m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx),
+					   _mm256_mul_pd(dy, dy));
+		_mm256_storeu_pd(out + i, sq ? d2 : _mm256_sqrt_pd(d2));
+	}
+	scalar_body(x1 + i, y1 + i, bcast ? x2 : x2 + i, bcast ? y2 : y2 + i,
+		    out + i, n - i, sq, bcast);
+}
+
+__attribute__((target("avx")))
+void
+pdist_avx(const double *x1, const double *y1, const double *x2,
+	  const double *y2, double *out, size_t n, int sq, int bcast)
+{
+	PDIST_SPECIALIZE(avx_body, x1, y1, x2, y2, out, n, sq, bcast);
+}
+
+
+// Runtime dispatch, once, before main() runs.
+
+int
+pdist_have_avx(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+}
+
+static pdist_fn pdist_impl;
+
+__attribute__((constructor))
+static void
+pdist_dispatch(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx"))
+		pdist_impl = pdist_avx;
+	else if (__builtin_cpu_supports("sse2"))
+		pdist_impl = pdist_sse2;
+	else
+		pdist_impl = pdist_scalar;
+}
+
+void
+point_dist_pairs(const double *x1, const double *y1, const double *x2,
+		 const double *y2, double *out, size_t n)
+{
+	pdist_impl(x1, y1, x2, y2, out, n, 0, 0);
+}
+
+void
+point_dist2_pairs(const double *x1, const double *y1, const double *x2,
+		  const double *y2, double *out, size_t n)
+{
+	pdist_impl(x1, y1, x2, y2, out, n, 1, 0);
+}
+
+void
+point_dist_from(double qx, double qy, const double *x, const double *y,
+		double *out, size_t n)
+{
+	pdist_impl(x, y, &qx, &qy, out, n, 0, 1);
+}
+
+void
+point_dist2_from(double qx, double qy, const double *x, const double *y,
+		 double *out, size_t n)
+{
+	pdist_impl(x, y, &qx, &qy, out, n, 1, 1);
+}
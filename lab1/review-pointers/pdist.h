@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+// Batched versions of point_dist() from ex4.c, over points stored as a
+// structure of arrays (SoA): point i is (x[i], y[i]).  Keeping the x's
+// together and the y's together lets one vector instruction work on 2
+// (SSE2) or 4 (AVX) points at once, where an array of struct point would
+// need shuffling first.
+//
+// The pair functions write the distance between point i of the first
+// array and point i of the second into out[i].  The "from" functions
+// write the distance from the single point (qx, qy) to every point.  The
+// dist2 functions write squared distances instead, skipping the square
+// root: they are enough to compare distances, since a < b exactly when
+// a * a < b * b for distances.
+//
+// Each call uses the fastest kernel the processor supports, chosen when
+// the program starts.
+
+void point_dist_pairs(const double *x1, const double *y1,
+		      const double *x2, const double *y2,
+		      double *out, size_t n);
+void point_dist2_pairs(const double *x1, const double *y1,
+		       const double *x2, const double *y2,
+		       double *out, size_t n);
+void point_dist_from(double qx, double qy, const double *x, const double *y,
+		     double *out, size_t n);
+void point_dist2_from(double qx, double qy, const double *x, const double *y,
+		      double *out, size_t n);
+
+// The kernels behind all four, for testing and benchmarks: "sq" selects
+// squared distances, and "bcast" uses (x2[0], y2[0]) for every point of
+// the second array.  Calling a kernel the processor does not support
+// crashes.
+typedef void (*pdist_fn)(const double *x1, const double *y1,
+			 const double *x2, const double *y2,
+			 double *out, size_t n, int sq, int bcast);
+void pdist_scalar(const double *x1, const double *y1,
+		  const double *x2, const double *y2,
+		  double *out, size_t n, int sq, int bcast);
+void pdist_sse2(const double *x1, const double *y1,
+		const double *x2, const double *y2,
+		double *out, size_t n, int sq, int bcast);
+void pdist_avx(const double *x1, const double *y1,
+	       const double *x2, const double *y2,
+	       double *out, size_t n, int sq, int bcast);
+
+// Returns 1 if the processor supports AVX.
+int pdist_have_avx(void);
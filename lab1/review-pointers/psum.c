@@ -0,0 +1,180 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "psum.h"
+#include "sum.h"
+
+#define MAXTHREADS	256
+#define MINCHUNK	(64 * 1024)	// fewest elements worth a thread
+#define CACHELINE	64
+
+// Chunk boundaries are multiples of this many elements, so no two threads
+// write the same cache line of "out".
+#define CHUNKALIGN	(CACHELINE / sizeof(long long))
+
+// Each thread's partial sum has a cache line to itself, so threads storing
+// their sums do not invalidate each other's lines ("false sharing").
+struct partial {
+	long long sum;
+} __attribute__((aligned(CACHELINE)));
+
+struct job {
+	const int *arr;
+	long long *out;			// NULL for a plain sum
+	size_t n;
+	int nthreads;			// and chunks
+	int inclusive;
+	// Between the two scan passes, everyone waits until 'unsummed',
+	// the number of chunks not summed yet, is 0.
+	pthread_mutex_t lock;
+	pthread_cond_t summed;
+	int unsummed;
+	struct partial partials[MAXTHREADS];
+};
+
+struct worker {
+	struct job *job;
+	int id;
+	pthread_t thread;
+};
+
+static int
+thread_count(size_t n, int nthreads)
+{
+	if (nthreads <= 0)
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if ((size_t) nthreads > n / MINCHUNK)
+		nthreads = (int) (n / MINCHUNK);
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+	return nthreads < 1 ? 1 : nthreads;
+}
+
+// The first element of thread "id"'s chunk.
+static size_t
+chunk_start(const struct job *job, int id)
+{
+	size_t start = job->n / job->nthreads * id;
+	return id == job->nthreads ? job->n : start - start % CHUNKALIGN;
+}
+
+static void
+chunk_sum(struct job *job, int id)
+{
+	size_t start = chunk_start(job, id);
+	size_t end = chunk_start(job, id + 1);
+
+	job->partials[id].sum = array_sum64(job->arr + start, end - start);
+}
+
+static void
+chunk_scan(struct job *job, int id)
+{
+	size_t start = chunk_start(job, id);
+	size_t end = chunk_start(job, id + 1);
+	long long sum = 0;
+
+	for (int i = 0; i < id; i++)
+		sum += job->partials[i].sum;
+	if (job->inclusive)
+		for (size_t i = start; i < end; i++)
+			job->out[i] = sum += job->arr[i];
+	else
+		for (size_t i = start; i < end; i++) {
+			job->out[i] = sum;
+			sum += job->arr[i];
+		}
+}
+
+// Count "nchunks" more chunks as summed, then wait until all are.
+static void
+job_summed(struct job *job, int nchunks)
+{
+	pthread_mutex_lock(&job->lock);
+	job->unsummed -= nchunks;
+	if (job->unsummed == 0)
+		pthread_cond_broadcast(&job->summed);
+	while (job->unsummed > 0)
+		pthread_cond_wait(&job->summed, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct job *job = w->job;
+
+	chunk_sum(job, w->id);
+	if (job->out) {
+		job_summed(job, 1);
+		chunk_scan(job, w->id);
+	}
+	return NULL;
+}
+
+// Run "job" on its threads.  The calling thread does chunk 0, and the
+// chunks of any threads that could not be started.
+static void
+job_run(struct job *job)
+{
+	struct worker workers[MAXTHREADS];
+	int i, nstarted;
+
+	if (job->out) {
+		pthread_mutex_init(&job->lock, NULL);
+		pthread_cond_init(&job->summed, NULL);
+		job->unsummed = job->nthreads;
+	}
+	for (i = 0; i < job->nthreads; i++) {
+		workers[i].job = job;
+		workers[i].id = i;
+	}
+	for (nstarted = 1; nstarted < job->nthreads; nstarted++)
+		if (pthread_create(&workers[nstarted].thread, NULL, worker_run,
+				   &workers[nstarted]) != 0)
+			break;
+
+	chunk_sum(job, 0);
+	for (i = nstarted; i < job->nthreads; i++)
+		chunk_sum(job, i);
+	if (job->out) {
+		job_summed(job, 1 + job->nthreads - nstarted);
+		chunk_scan(job, 0);
+		for (i = nstarted; i < job->nthreads; i++)
+			chunk_scan(job, i);
+	}
+
+	for (i = 1; i < nstarted; i++)
+		pthread_join(workers[i].thread, NULL);
+	if (job->out) {
+		pthread_cond_destroy(&job->summed);
+		pthread_mutex_destroy(&job->lock);
+	}
+}
+
+long long
+array_sum_parallel(const int *arr, size_t n, int nthreads)
+{
+	struct job job = {
+		.arr = arr, .n = n, .nthreads = thread_count(n, nthreads)
+	};
+	long long sum = 0;
+
+	job_run(&job);
+	for (int i = 0; i < job.nthreads; i++)
+		sum += job.partials[i].sum;
+	return sum;
+}
+
+void
+array_scan_parallel(const int *arr, long long *out, size_t n, int nthreads,
+		    int inclusive)
+{
+	struct job job = {
+		.arr = arr, .out = out, .n = n,
+		.nthreads = thread_count(n, nthreads), .inclusive = inclusive
+	};
+
+	job_run(&job);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+// Parallel versions of array_sum() from ex3.c, using POSIX threads.
+//
+// Both functions split the "n" ints at "arr" into one contiguous chunk per
+// thread.  "nthreads" is how many threads to use; 0 means one per online
+// CPU.  Small arrays use fewer threads, since starting a thread costs more
+// than summing a few thousand ints.  If a thread cannot be started, the
+// calling thread does its chunk too.
+
+// Return the sum of the array as a long long (see array_sum64()).
+long long array_sum_parallel(const int *arr, size_t n, int nthreads);
+
+// Write the running sums of the array to "out": out[i] is the sum of
+// arr[0] through arr[i] if "inclusive" is nonzero, and of arr[0] through
+// arr[i - 1] (so out[0] is 0) otherwise.
+//
+// Uses the two-pass blocked algorithm: every thread sums its chunk; then
+// every thread adds up the sums of the chunks before its own, and writes
+// its chunk's running sums starting from there.  Each element is read
+// twice and written once, however many threads there are.
+void array_scan_parallel(const int *arr, long long *out, size_t n,
+			 int nthreads, int inclusive);
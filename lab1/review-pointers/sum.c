@@ -0,0 +1,210 @@
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "sum.h"
+
+// Each vector version adds single elements until "arr" is aligned to the
+// vector size (the "head"), then whole aligned vectors, several at a time
+// into independent accumulators so the additions overlap, and then the
+// remaining elements one by one (the "tail").
+//
+// Wrapping sums add in unsigned arithmetic, which is defined to wrap, and
+// convert back to int at the end.  64-bit sums sign-extend every element
+// to 64 bits before adding it.
+
+int
+array_sum_scalar(const int *arr, size_t n)
+{
+	unsigned sum = 0;
+	for (size_t i = 0; i < n; i++)
+		sum += arr[i];
+	return (int) sum;
+}
+
+long long
+array_sum64_scalar(const int *arr, size_t n)
+{
+	long long sum = 0;
+	for (size_t i = 0; i < n; i++)
+		sum += arr[i];
+	return sum;
+}
+
+
+// SSE2: 4 ints per vector.
+
+__attribute__((target("sse2")))
+static inline unsigned
+hsum_epi32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+	return (unsigned) _mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse2")))
+static inline long long
+hsum_epi64(__m128i v)
+{
+	long long lanes[2];
+	_mm_storeu_si128((__m128i *) lanes, v);
+	return lanes[0] + lanes[1];
+}
+
+// Add the 4 ints in "v", sign-extended, to the 2 long longs in "acc".
+__attribute__((target("sse2")))
+static inline __m128i
+add_widened(__m128i acc, __m128i v)
+{
+	__m128i sign = _mm_srai_epi32(v, 31);
+	acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+	return _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+}
+
+__attribute__((target("sse2")))
+int
+array_sum_sse2(const int *arr, size_t n)
+{
+	__m128i acc0 = _mm_setzero_si128(), acc1 = acc0, acc2 = acc0,
+		acc3 = acc0;
+	unsigned sum = 0;
+
+	for (; n > 0 && ((uintptr_t) arr & 15); n--)
+		sum += *arr++;
+	for (; n >= 16; n -= 16, arr += 16) {
+		const __m128i *v = (const __m128i *) arr;
+		acc0 = _mm_add_epi32(acc0, _mm_load_si128(v));
+		acc1 = _mm_add_epi32(acc1, _mm_load_si128(v + 1));
+		acc2 = _mm_add_epi32(acc2, _mm_load_si128(v + 2));
+		acc3 = _mm_add_epi32(acc3, _mm_load_si128(v + 3));
+	}
+	acc0 = _mm_add_epi32(_mm_add_epi32(acc0, acc1),
+			     _mm_add_epi32(acc2, acc3));
+	sum += hsum_epi32(acc0);
+	while (n-- > 0)
+		sum += *arr++;
+	return (int) sum;
+}
+
+__attribute__((target("sse2")))
+long long
+array_sum64_sse2(const int *arr, size_t n)
+{
+	__m128i acc0 = _mm_setzero_si128(), acc1 = acc0;
+	long long sum = 0;
+
+	for (; n > 0 && ((uintptr_t) arr & 15); n--)
+		sum += *arr++;
+	for (; n >= 8; n -= 8, arr += 8) {
+		const __m128i *v = (const __m128i *) arr;
+		acc0 = add_widened(acc0, _mm_load_si128(v));
+		acc1 = add_widened(acc1, _mm_load_si128(v + 1));
+	}
+	sum += hsum_epi64(_mm_add_epi64(acc0, acc1));
+	while (n-- > 0)
+		sum += *arr++;
+	return sum;
+}
+
+
+// AVX2: 8 ints per vector.
+
+__attribute__((target("avx2")))
+int
+array_sum_avx2(const int *arr, size_t n)
+{
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0,
+		acc3 = acc0;
+	unsigned sum = 0;
+
+	for (; n > 0 && ((uintptr_t) arr & 31); n--)
+		sum += *arr++;
+	for (; n >= 32; n -= 32, arr += 32) {
+		const __m256i *v = (const __m256i *) arr;
+		acc0 = _mm256_add_epi32(acc0, _mm256_load_si256(v));
+		acc1 = _mm256_add_epi32(acc1, _mm256_load_si256(v + 1));
+		acc2 = _mm256_add_epi32(acc2, _mm256_load_si256(v + 2));
+		acc3 = _mm256_add_epi32(acc3, _mm256_load_si256(v + 3));
+	}
+	acc0 = _mm256_add_epi32(_mm256_add_epi32(acc0, acc1),
+				_mm256_add_epi32(acc2, acc3));
+	sum += hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(acc0),
+					_mm256_extracti128_si256(acc0, 1)));
+	while (n-- > 0)
+		sum += *arr++;
+	return (int) sum;
+}
+
+__attribute__((target("avx2")))
+long long
+array_sum64_avx2(const int *arr, size_t n)
+{
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0,
+		acc3 = acc0;
+	long long sum = 0;
+
+	for (; n > 0 && ((uintptr_t) arr & 31); n--)
+		sum += *arr++;
+	for (; n >= 16; n -= 16, arr += 16) {
+		const __m128i *v = (const __m128i *) arr;
+		acc0 = _mm256_add_epi64(acc0,
+			_mm256_cvtepi32_epi64(_mm_load_si128(v)));
+		acc1 = _mm256_add_epi64(acc1,
+			_mm256_cvtepi32_epi64(_mm_load_si128(v + 1)));
+		acc2 = _mm256_add_epi64(acc2,
+			_mm256_cvtepi32_epi64(_mm_load_si128(v + 2)));
+		acc3 = _mm256_add_epi64(acc3,
+			_mm256_cvtepi32_epi64(_mm_load_si128(v + 3)));
+	}
+	acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+				_mm256_add_epi64(acc2, acc3));
+	sum += hsum_epi64(_mm_add_epi64(_mm256_castsi256_si128(acc0),
+					_mm256_extracti128_si256(acc0, 1)));
+	while (n-- > 0)
+		sum += *arr++;
+	return sum;
+}
+
+
+// Runtime dispatch, once, before main() runs, so threads never race to
+// set it up.  SSE2 is part of every x86-64 processor; 32-bit builds fall
+// back to the scalar loops without it.
+
+int
+array_sum_have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static int (*sum_impl)(const int *, size_t);
+static long long (*sum64_impl)(const int *, size_t);
+
+__attribute__((constructor))
+static void
+sum_dispatch(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		sum64_impl = array_sum64_avx2;
+		sum_impl = array_sum_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		sum64_impl = array_sum64_sse2;
+		sum_impl = array_sum_sse2;
+	} else {
+		sum64_impl = array_sum64_scalar;
+		sum_impl = array_sum_scalar;
+	}
+}
+
+int
+array_sum_fast(const int *arr, size_t n)
+{
+	return sum_impl(arr, n);
+}
+
+long long
+array_sum64(const int *arr, size_t n)
+{
+	return sum64_impl(arr, n);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+// Vectorized versions of array_sum() from ex3.c.
+//
+// The array_sum_* functions return the sum of the "n" ints at "arr"
+// wrapped to an int, as the scalar loop does on common hardware (but
+// without its undefined behavior on overflow).  The array_sum64_*
+// functions add into a long long instead, so they cannot overflow for any
+// array that fits in memory.
+//
+// array_sum_fast() and array_sum64() call the fastest version the
+// processor supports, chosen when the program starts.  The others are for
+// testing and benchmarks; calling a version the processor does not
+// support crashes.
+
+int array_sum_scalar(const int *arr, size_t n);
+int array_sum_sse2(const int *arr, size_t n);
+int array_sum_avx2(const int *arr, size_t n);
+int array_sum_fast(const int *arr, size_t n);
+
+long long array_sum64_scalar(const int *arr, size_t n);
+long long array_sum64_sse2(const int *arr, size_t n);
+long long array_sum64_avx2(const int *arr, size_t n);
+long long array_sum64(const int *arr, size_t n);
+
+// Returns 1 if the processor supports AVX2.
+int array_sum_have_avx2(void);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <time.h>
+
+// Wall-clock time in seconds, for the benchmarks.
+static inline double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,124 @@
+#ifndef WEENSYOS_SYNC_H
+#define WEENSYOS_SYNC_H
+#include "process.h"
+#include "lib.h"
+
+/*****************************************************************************
+ * sync.h
+ *
+ *   Mutexes and condition variables for miniprocos applications, built on
+ *   the atomic operations in lib.h and on sys_futex_wait/sys_futex_wake.
+ *   All processes share globals, so a mutex_t or cond_t is simply a global
+ *   that every process uses.  Initialize both to all zeros.
+ *
+ *   Locking and unlocking an uncontended mutex is a single atomic
+ *   instruction, with no system call.  Only a process that finds the mutex
+ *   held enters the kernel, to sleep on the mutex's futex; and only an
+ *   unlock that might have sleepers enters the kernel to wake one.
+ *
+ *****************************************************************************/
+
+// A mutex's state is 0 (unlocked), 1 (locked, no waiters), or 2 (locked,
+// maybe waiters).
+typedef struct mutex {
+	volatile int m_state;
+} mutex_t;
+
+// A condition variable's sequence number changes on every signal, so a
+// waiter that has released its mutex does not sleep through a signal that
+// came in the meantime.  Signals only make a system call if some process
+// is waiting.
+typedef struct cond {
+	volatile int c_seq;
+	volatile int c_waiters;
+} cond_t;
+
+#define MUTEX_INIT	{ 0 }
+#define COND_INIT	{ 0, 0 }
+
+
+/*****************************************************************************
+ * mutex_lock(m), mutex_trylock(m), mutex_unlock(m)
+ *
+ *   Lock and unlock a mutex.  mutex_trylock() returns 1 if it locked the
+ *   mutex and 0 if it was already locked.
+ *
+ *****************************************************************************/
+
+static inline int
+mutex_trylock(mutex_t *m)
+{
+	return atomic_cmpxchg(&m->m_state, 0, 1) == 0;
+}
+
+static void
+mutex_lock(mutex_t *m)
+{
+	int c = atomic_cmpxchg(&m->m_state, 0, 1);
+	if (c == 0)
+		return;
+	// Contended.  Mark the mutex as having waiters, then sleep until
+	// it is unlocked; whoever takes it this way leaves it marked, since
+	// other processes may still be asleep.
+	if (c != 2)
+		c = atomic_xchg(&m->m_state, 2);
+	while (c != 0) {
+		sys_futex_wait(&m->m_state, 2);
+		c = atomic_xchg(&m->m_state, 2);
+	}
+}
+
+static void
+mutex_unlock(mutex_t *m)
+{
+	if (atomic_xadd(&m->m_state, -1) != 1) {
+		m->m_state = 0;
+		sys_futex_wake(&m->m_state, 1);
+	}
+}
+
+
+/*****************************************************************************
+ * cond_wait(c, m), cond_signal(c), cond_broadcast(c)
+ *
+ *   cond_wait() releases mutex 'm', which the caller must hold, waits for
+ *   cond_signal() or cond_broadcast() on 'c', and locks 'm' again before
+ *   returning.  It may return without a signal, so callers wait in a loop
+ *   that rechecks their condition.  cond_signal() wakes one waiter, and
+ *   cond_broadcast() wakes them all.
+ *
+ *****************************************************************************/
+
+static void
+cond_wait(cond_t *c, mutex_t *m)
+{
+	int seq;
+
+	atomic_xadd(&c->c_waiters, 1);
+	seq = c->c_seq;
+	mutex_unlock(m);
+	sys_futex_wait(&c->c_seq, seq);
+	atomic_xadd(&c->c_waiters, -1);
+	// Relock as a contended mutex: other waiters woken by a broadcast
+	// may be queued behind us.
+	while (atomic_xchg(&m->m_state, 2) != 0)
+		sys_futex_wait(&m->m_state, 2);
+}
+
+static inline void
+cond_signal(cond_t *c)
+{
+	atomic_xadd(&c->c_seq, 1);
+	if (c->c_waiters)
+		sys_futex_wake(&c->c_seq, 1);
+}
+
+static inline void
+cond_broadcast(cond_t *c)
+{
+	atomic_xadd(&c->c_seq, 1);
+	if (c->c_waiters)
+		sys_futex_wake(&c->c_seq, -1);
+}
+
+#endif
@@ -14,8 +14,15 @@ typedef signed char int8_t;
 typedef unsigned char uint8_t;
 typedef short int16_t;
 typedef unsigned short uint16_t;
+#ifndef WEENSYOS_HOSTSIM
 typedef long int32_t;
 typedef unsigned long uint32_t;
+#else
+// The host simulator (build/hostsim-x86.c) compiles the kernel for a
+// 64-bit host, where 'long' is 64 bits.
+typedef int int32_t;
+typedef unsigned int uint32_t;
+#endif
 typedef long long int64_t;
 typedef unsigned long long uint64_t;
 
@@ -23,9 +30,16 @@ typedef unsigned long long uint64_t;
 // We use pointer types to represent virtual addresses,
 // uintptr_t to represent the numerical values of virtual addresses,
 // and physaddr_t to represent physical addresses.
+// (In the host simulator they are as long as host pointers.)
+#ifndef WEENSYOS_HOSTSIM
 typedef int32_t intptr_t;
 typedef uint32_t uintptr_t;
 typedef uint32_t physaddr_t;
+#else
+typedef long intptr_t;
+typedef unsigned long uintptr_t;
+typedef unsigned long physaddr_t;
+#endif
 
 typedef uint32_t pte_t;
 typedef pte_t *pagedirectory_t;
@@ -34,10 +48,10 @@ typedef pte_t *pagedirectory_t;
 typedef uint32_t ppn_t;
 
 // size_t is used for memory object sizes.
-typedef uint32_t size_t;
+typedef uintptr_t size_t;
 // ssize_t is a signed version of ssize_t, used in case there might be an
 // error return.
-typedef int32_t ssize_t;
+typedef intptr_t ssize_t;
 
 // off_t is used for file offsets and lengths.
 typedef int32_t off_t;
@@ -31,6 +31,10 @@
  *   when an interrupt or exception happens.
  *   In miniprocos, it should jump to the assembly code in 'k-int.S'.
  *
+ *   Each CPU calls segments_init() once, with its CPU number, to load its
+ *   own segment table and task state; CPU 0 also builds the interrupt
+ *   descriptor table, which all CPUs share.
+ *
  *   The taskstate_t, segmentdescriptor_t, and pseduodescriptor_t types
  *   are defined by the x86 hardware.
  *
@@ -43,12 +47,16 @@
 #define SEGSEL_APP_DATA		0x20		// application data segment
 #define SEGSEL_TASKSTATE	0x28		// task state segment
 
-// The task descriptor defines the state the processor should set up
-// when taking an interrupt.
-static taskstate_t kernel_task_descriptor;
+// Each CPU has its own task descriptor, which defines the state the
+// processor should set up when taking an interrupt -- in particular, the
+// CPU's own kernel stack.
+static taskstate_t kernel_task_descriptor[NCPU];
 
-// Segments
-static segmentdescriptor_t segments[] = {
+// Segments.  Each CPU has a copy of this table, differing only in the
+// task state segment, which points at the CPU's own task descriptor.
+#define NSEGMENTS		6
+static segmentdescriptor_t segments[NCPU][NSEGMENTS];
+static const segmentdescriptor_t segments_template[NSEGMENTS] = {
 	SEG_NULL,				// ignored
 	SEG(STA_X | STA_R, 0, 0xFFFFFFFF, 0),	// SEGSEL_KERN_CODE
 	SEG(STA_W, 0, 0xFFFFFFFF, 0),		// SEGSEL_KERN_DATA
@@ -56,12 +64,8 @@ static segmentdescriptor_t segments[] = {
 	SEG(STA_W, 0, 0xFFFFFFFF, 3),		// SEGSEL_APP_DATA
 	SEG_NULL /* defined below */		// SEGSEL_TASKSTATE
 };
-pseudodescriptor_t global_descriptor_table = {
-	sizeof(segments) - 1,
-	(uintptr_t) segments
-};
 
-// Interrupt descriptors
+// Interrupt descriptors, shared by all CPUs
 static gatedescriptor_t interrupt_descriptors[256];	/* initialized below */
 pseudodescriptor_t interrupt_descriptor_table = {
 	sizeof(interrupt_descriptors) - 1,
@@ -70,45 +74,468 @@ pseudodescriptor_t interrupt_descriptor_table = {
 
 // Particular interrupt handler routines
 extern void (*sys_int_handlers[])(void);
-extern void default_int_handler(void);
+extern void (*hw_int_handlers[])(void);
+extern void page_fault_handler(void);
+extern void ipi_wakeup_handler(void);
+extern void spurious_int_handler(void);
+extern void profile_int_handler(void);
+extern void (*default_int_handlers[])(void);
 
 
-void
-segments_init(void)
+// Set up the interrupt descriptor table.  The boot CPU does this once.
+static void
+interrupts_init(void)
 {
 	int i;
 
-	// Set task state segment
-	segments[SEGSEL_TASKSTATE >> 3]
-		= SEG16(STS_T32A, (uint32_t) &kernel_task_descriptor,
-			sizeof(taskstate_t), 0);
-	segments[SEGSEL_TASKSTATE >> 3].sd_s = 0;
-
-	// Set up kernel task descriptor, so we can receive interrupts
-	kernel_task_descriptor.ts_esp0 = KERNEL_STACK_TOP;
-	kernel_task_descriptor.ts_ss0 = SEGSEL_KERN_DATA;
-
-	// Set up interrupt descriptor table.
-	// Most interrupts are effectively ignored
+	// Most interrupts are unexpected, and are reported as such
 	for (i = 0; i < sizeof(interrupt_descriptors) / sizeof(gatedescriptor_t); i++)
 		SETGATE(interrupt_descriptors[i], 0,
-			SEGSEL_KERN_CODE, default_int_handler, 0);
+			SEGSEL_KERN_CODE, default_int_handlers[i], 0);
+
+	// Page faults are handled by the kernel (see program_fault()).
+	SETGATE(interrupt_descriptors[INT_PAGEFAULT], 0,
+		SEGSEL_KERN_CODE, page_fault_handler, 0);
 
 	// System calls get special handling.
 	// Note that the last argument is '3'.  This means that unprivileged
 	// (level-3) applications may generate these interrupts.
-	for (i = INT_SYS_GETPID; i < INT_SYS_GETPID + 10; i++)
+	for (i = INT_SYS_GETPID; i < INT_SYS_GETPID + NSYSCALLS; i++)
 		SETGATE(interrupt_descriptors[i], 0,
 			SEGSEL_KERN_CODE, sys_int_handlers[i - INT_SYS_GETPID], 3);
 
+	// Hardware interrupts may only be generated by hardware.
+	for (i = INT_IRQ0; i < INT_IRQ0 + NIRQS; i++)
+		SETGATE(interrupt_descriptors[i], 0,
+			SEGSEL_KERN_CODE, hw_int_handlers[i - INT_IRQ0], 0);
+
+	// So may interrupts from other CPUs' local APICs.
+	SETGATE(interrupt_descriptors[INT_IPI_WAKEUP], 0,
+		SEGSEL_KERN_CODE, ipi_wakeup_handler, 0);
+	SETGATE(interrupt_descriptors[INT_SPURIOUS], 0,
+		SEGSEL_KERN_CODE, spurious_int_handler, 0);
+	SETGATE(interrupt_descriptors[INT_PROFILE], 0,
+		SEGSEL_KERN_CODE, profile_int_handler, 0);
+}
+
+void
+segments_init(int cpu)
+{
+	segmentdescriptor_t *gdt = segments[cpu];
+	pseudodescriptor_t gdt_desc;
+	int i;
+
+	if (cpu == 0)
+		interrupts_init();
+
+	// Set task state segment
+	for (i = 0; i < NSEGMENTS; i++)
+		gdt[i] = segments_template[i];
+	gdt[SEGSEL_TASKSTATE >> 3]
+		= SEG16(STS_T32A, (uint32_t) &kernel_task_descriptor[cpu],
+			sizeof(taskstate_t), 0);
+	gdt[SEGSEL_TASKSTATE >> 3].sd_s = 0;
+
+	// Set up kernel task descriptor, so we can receive interrupts
+	// on this CPU's kernel stack
+	kernel_task_descriptor[cpu].ts_esp0 = KERNEL_STACK_TOP
+		- cpu * KERNEL_STACK_SLOT;
+	kernel_task_descriptor[cpu].ts_ss0 = SEGSEL_KERN_DATA;
+
 	// Reload segment pointers
-	asm volatile("lgdt global_descriptor_table\n\t"
-		     "ltr %0\n\t"
+	gdt_desc.idtd_lim = sizeof(segments[cpu]) - 1;
+	gdt_desc.idtd_base = (uintptr_t) gdt;
+	asm volatile("lgdt %0\n\t"
+		     "ltr %1\n\t"
 		     "lidt interrupt_descriptor_table"
-		     : : "r" ((uint16_t) SEGSEL_TASKSTATE));
+		     : : "m" (gdt_desc), "r" ((uint16_t) SEGSEL_TASKSTATE));
 
 	// Convince compiler that all symbols were used
-	(void) global_descriptor_table, (void) interrupt_descriptor_table;
+	(void) interrupt_descriptor_table;
+}
+
+
+
+/*****************************************************************************
+ * paging_init
+ *
+ *   Turn on paging with an identity mapping: each virtual address below
+ *   MEMSIZE_PHYSICAL maps to the same physical address, so nothing in the
+ *   kernel moves.  All pages are accessible to applications, as before.
+ *   The only exception is the application region, APP_REGION_START up to
+ *   APP_REGION_END, which starts out unmapped.  The program loader maps
+ *   its pages on demand when a process first touches them.
+ *   Above physical memory, the process stack region (STACK_REGION_START up
+ *   to MEMSIZE_VIRTUAL) also starts out unmapped; the kernel maps page
+ *   frames there as process stacks grow.  The guard page below each CPU's
+ *   kernel stack is never mapped.
+ *
+ *   page_map(va, pa, perm) maps the page at 'va' to physical page 'pa'
+ *   with permissions 'perm' (PTE_P | PTE_W | PTE_U, say), or unmaps it if
+ *   'perm' is 0.  page_lookup(va) returns the physical page mapped at
+ *   'va', or 0 if none is, and page_perm(va) its permissions.
+ *
+ *   Each CPU caches mappings in its TLB.  page_map() flushes only this
+ *   CPU's entry; other CPUs notice that a mapping has changed, and flush
+ *   their whole TLB, the next time they run a process (see run()).  Until
+ *   then, they only run processes that were already running, which have no
+ *   business touching pages being unmapped.  A change that only lets
+ *   applications do more with the same page, as when the program loader
+ *   maps a page for itself and then for the application, flushes nothing
+ *   elsewhere: an access that a stale entry refuses faults, which removes
+ *   the entry, and program_fault() finds it allowed.  (The kernel runs
+ *   without CR0_WP, so PTE_W only restricts applications.)
+ *
+ *****************************************************************************/
+
+static pte_t kernel_pagedir[NPDENTRIES]
+	__attribute__((aligned(PAGESIZE)));
+static pte_t kernel_pagetables[MEMSIZE_VIRTUAL / PTSIZE][NPTENTRIES]
+	__attribute__((aligned(PAGESIZE)));
+
+void
+paging_init(void)
+{
+	uintptr_t va;
+	int cpu;
+
+	for (va = 0; va < MEMSIZE_VIRTUAL; va += PTSIZE)
+		kernel_pagedir[PDX(va)] = (physaddr_t) kernel_pagetables[PDX(va)]
+			| PTE_P | PTE_W | PTE_U;
+	for (va = 0; va < MEMSIZE_PHYSICAL; va += PAGESIZE)
+		if (va < APP_REGION_START || va >= APP_REGION_END)
+			kernel_pagetables[PDX(va)][PTX(va)] =
+				va | PTE_P | PTE_W | PTE_U;
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		va = KERNEL_STACK_TOP - (cpu + 1) * KERNEL_STACK_SLOT;
+		kernel_pagetables[PDX(va)][PTX(va)] = 0;
+	}
+
+	lcr3(kernel_pagedir);
+	lcr0(rcr0() | CR0_PG);
+}
+
+// Bumped whenever a mapping that other CPUs may have cached changes in a
+// way that they must see; see run().
+static uint32_t tlb_generation;
+
+void
+page_map(uintptr_t va, physaddr_t pa, int perm)
+{
+	pte_t *pte = &kernel_pagetables[PDX(va)][PTX(va)];
+	pte_t old = *pte, new = (perm ? PTE_ADDR(pa) | perm : 0);
+
+	// a stale copy of 'old' must go if it reaches another page, or lets
+	// an application do something 'new' does not
+	if ((old & PTE_P)
+	    && (!(new & PTE_P) || PTE_ADDR(old) != PTE_ADDR(new)
+		|| ((old & PTE_U)
+		    && (!(new & PTE_U) || (old & PTE_W & ~new)))))
+		tlb_generation++;
+	*pte = new;
+	invlpg((void *) va);
+}
+
+physaddr_t
+page_lookup(uintptr_t va)
+{
+	pte_t pte = kernel_pagetables[PDX(va)][PTX(va)];
+	return (pte & PTE_P ? PTE_ADDR(pte) : 0);
+}
+
+// Return the permission bits 'va' is mapped with, or 0 if it is unmapped.
+int
+page_perm(uintptr_t va)
+{
+	pte_t pte = kernel_pagetables[PDX(va)][PTX(va)];
+	return (pte & PTE_P ? pte & 0xFFF : 0);
+}
+
+
+
+
+/*****************************************************************************
+ * interrupt_controller_init
+ *
+ *   Program the two 8259A interrupt controllers so that hardware IRQs 0-15
+ *   arrive as interrupts INT_IRQ0 through INT_IRQ0 + 15, instead of
+ *   colliding with the processor's exception numbers.  Every IRQ starts out
+ *   masked; irq_enable() unmasks one when a driver wants it.
+ *
+ *****************************************************************************/
+
+#define IO_PIC1		0x20		// master 8259A
+#define IO_PIC2		0xA0		// slave 8259A
+#define IRQ_SLAVE	2		// IRQ at which the slave connects
+
+static uint16_t irq_mask = 0xFFFF & ~(1 << IRQ_SLAVE);
+
+static void
+irq_mask_set(void)
+{
+	outb(IO_PIC1 + 1, irq_mask);
+	outb(IO_PIC2 + 1, irq_mask >> 8);
+}
+
+void
+interrupt_controller_init(void)
+{
+	// ICW1: edge triggered, cascaded, ICW4 follows
+	outb(IO_PIC1, 0x11);
+	outb(IO_PIC2, 0x11);
+	// ICW2: vector offsets
+	outb(IO_PIC1 + 1, INT_IRQ0);
+	outb(IO_PIC2 + 1, INT_IRQ0 + 8);
+	// ICW3: master has a slave at IRQ_SLAVE; slave's cascade identity
+	outb(IO_PIC1 + 1, 1 << IRQ_SLAVE);
+	outb(IO_PIC2 + 1, IRQ_SLAVE);
+	// ICW4: 8086 mode, normal EOI
+	outb(IO_PIC1 + 1, 0x01);
+	outb(IO_PIC2 + 1, 0x01);
+
+	irq_mask_set();
+}
+
+void
+irq_enable(int irq)
+{
+	irq_mask &= ~(1 << irq);
+	irq_mask_set();
+}
+
+// Acknowledge a hardware interrupt so the controller will deliver more.
+void
+irq_eoi(int irq)
+{
+	if (irq >= 8)
+		outb(IO_PIC2, 0x20);
+	outb(IO_PIC1, 0x20);
+}
+
+
+
+/*****************************************************************************
+ * local APIC
+ *
+ *   Each CPU has a local APIC, which delivers its interrupts and lets it
+ *   interrupt other CPUs.  The 8259A controllers above still deliver
+ *   hardware IRQs, to CPU 0 only, through its local APIC's LINT0 pin
+ *   ("virtual wire" mode).  The local APIC is only used to start the other
+ *   CPUs and to send them wakeup interrupts (see k-smp.c), and for the
+ *   profiler's timer on the other CPUs (see k-profile.c).
+ *
+ *   lapic_map(pa) maps the local APIC registers, which are at the same
+ *   address on every CPU, but each CPU sees its own.
+ *   lapic_init(bsp) enables this CPU's local APIC; 'bsp' is 1 on the boot
+ *   CPU, which keeps receiving IRQs.  lapic_id() returns this CPU's APIC
+ *   ID.  lapic_ipi(apicid, vector) sends interrupt 'vector' to the CPU with
+ *   APIC ID 'apicid', and lapic_eoi() acknowledges one.
+ *   lapic_start_ap(apicid, addr) starts an application processor (AP) in
+ *   real mode at physical address 'addr', which must be page-aligned and
+ *   below 1 MB, with the INIT-SIPI-SIPI sequence from Intel's
+ *   MultiProcessor Specification.
+ *   lapic_timer_start(hz, vector) makes this CPU's local APIC timer send it
+ *   interrupt 'vector' 'hz' times a second.
+ *
+ *****************************************************************************/
+
+static volatile uint32_t *lapic;	// set by lapic_map()
+
+#define LAPIC_ID	(0x020 / 4)	// ID
+#define LAPIC_TPR	(0x080 / 4)	// Task Priority
+#define LAPIC_EOI	(0x0B0 / 4)	// End Of Interrupt
+#define LAPIC_SVR	(0x0F0 / 4)	// Spurious Interrupt Vector
+#define   LAPIC_ENABLE		0x00000100
+#define LAPIC_ESR	(0x280 / 4)	// Error Status
+#define LAPIC_ICRLO	(0x300 / 4)	// Interrupt Command
+#define   LAPIC_INIT		0x00000500
+#define   LAPIC_STARTUP		0x00000600
+#define   LAPIC_BUSY		0x00001000
+#define   LAPIC_ASSERT		0x00004000
+#define   LAPIC_LEVEL		0x00008000
+#define LAPIC_ICRHI	(0x310 / 4)	// Interrupt Command [63:32]
+#define LAPIC_TIMER	(0x320 / 4)	// Local Vector Table: timer
+#define   LAPIC_PERIODIC	0x00020000
+#define LAPIC_LINT0	(0x350 / 4)	//   LINT0 pin
+#define LAPIC_LINT1	(0x360 / 4)	//   LINT1 pin
+#define LAPIC_ERROR	(0x370 / 4)	//   errors
+#define   LAPIC_MASKED		0x00010000
+#define   LAPIC_EXTINT		0x00000700
+#define   LAPIC_NMI		0x00000400
+#define LAPIC_TICR	(0x380 / 4)	// Timer Initial Count
+#define LAPIC_TCCR	(0x390 / 4)	// Timer Current Count
+#define LAPIC_TDCR	(0x3E0 / 4)	// Timer Divide Configuration
+#define   LAPIC_X16		0x00000003
+
+// Map the local APIC's registers, at physical address 'pa' (far above
+// physical memory), uncached and for the kernel only.
+static pte_t lapic_pagetable[NPTENTRIES]
+	__attribute__((aligned(PAGESIZE)));
+
+void
+lapic_map(physaddr_t pa)
+{
+	kernel_pagedir[PDX(pa)] = (physaddr_t) lapic_pagetable | PTE_P | PTE_W;
+	lapic_pagetable[PTX(pa)] = PTE_ADDR(pa) | PTE_P | PTE_W | PTE_PCD
+		| PTE_PWT;
+	lapic = (volatile uint32_t *) pa;
+}
+
+static void
+lapic_write(int reg, uint32_t value)
+{
+	lapic[reg] = value;
+	(void) lapic[LAPIC_ID];		// wait for the write to finish
+}
+
+// Busy-wait for 'us' microseconds, using the cycle counter.
+static void
+delay_us(uint32_t us)
+{
+	uint64_t end = read_cycle_counter()
+		+ (uint64_t) us * (tsc_khz / 1000);
+	while (read_cycle_counter() < end)
+		asm volatile("pause");
+}
+
+void
+lapic_init(int bsp)
+{
+	lapic_write(LAPIC_SVR, LAPIC_ENABLE | INT_SPURIOUS);
+	lapic_write(LAPIC_TIMER, LAPIC_MASKED);
+	lapic_write(LAPIC_LINT0, bsp ? LAPIC_EXTINT : LAPIC_MASKED);
+	lapic_write(LAPIC_LINT1, bsp ? LAPIC_NMI : LAPIC_MASKED);
+	lapic_write(LAPIC_ERROR, LAPIC_MASKED);
+	// clearing the error status takes back-to-back writes
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_EOI, 0);
+	lapic_write(LAPIC_TPR, 0);
+}
+
+int
+lapic_id(void)
+{
+	return lapic[LAPIC_ID] >> 24;
+}
+
+void
+lapic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+static void
+lapic_icr(int apicid, uint32_t command)
+{
+	lapic_write(LAPIC_ICRHI, apicid << 24);
+	lapic_write(LAPIC_ICRLO, command);
+	while (lapic[LAPIC_ICRLO] & LAPIC_BUSY)
+		asm volatile("pause");
+}
+
+void
+lapic_ipi(int apicid, int vector)
+{
+	lapic_icr(apicid, vector);
+}
+
+void
+lapic_start_ap(int apicid, physaddr_t addr)
+{
+	int i;
+
+	// INIT, asserted then deasserted, resets the AP to wait for a
+	// startup IPI
+	lapic_icr(apicid, LAPIC_INIT | LAPIC_LEVEL | LAPIC_ASSERT);
+	delay_us(200);
+	lapic_icr(apicid, LAPIC_INIT | LAPIC_LEVEL);
+	delay_us(10000);
+
+	// The startup IPI's vector is the page number of the code to run.
+	// The specification says to send it twice.
+	for (i = 0; i < 2; i++) {
+		lapic_icr(apicid, LAPIC_STARTUP | (addr >> 12));
+		delay_us(200);
+	}
+}
+
+void
+lapic_timer_start(int hz, int vector)
+{
+	uint32_t per_10ms;
+
+	// The timer counts at the bus clock divided by 16, which differs
+	// from machine to machine: count down for 10 ms to measure it.
+	lapic_write(LAPIC_TDCR, LAPIC_X16);
+	lapic_write(LAPIC_TIMER, LAPIC_MASKED);
+	lapic_write(LAPIC_TICR, 0xFFFFFFFF);
+	delay_us(10000);
+	per_10ms = 0xFFFFFFFF - lapic[LAPIC_TCCR];
+
+	lapic_write(LAPIC_TIMER, LAPIC_PERIODIC | vector);
+	lapic_write(LAPIC_TICR, MAX(per_10ms / 10 * 1000 / hz, 1));
+}
+
+
+
+/*****************************************************************************
+ * tsc_calibrate
+ *
+ *   Measure how fast the processor's cycle counter runs, by counting cycles
+ *   while channel 2 of the 8253 interval timer counts down 10 ms, and store
+ *   the result in the shared variable 'tsc_khz'.  Benchmark applications use
+ *   it to turn cycle counts into times.
+ *
+ *****************************************************************************/
+
+#define IO_TIMER_CMD	0x43		// 8253 command register
+#define IO_TIMER_CH2	0x42		// 8253 channel 2 counter
+#define IO_SPEAKER	0x61		// channel 2 gate (bit 0), output (bit 5)
+#define TIMER_FREQ	1193182		// 8253 input clock, in Hz
+
+void
+tsc_calibrate(void)
+{
+	uint32_t count = TIMER_FREQ / 100;
+	uint64_t start;
+
+	// gate channel 2 on, speaker off
+	outb(IO_SPEAKER, (inb(IO_SPEAKER) & ~0x02) | 0x01);
+	// channel 2, low byte then high byte, mode 0 (interrupt on terminal
+	// count): the output goes high when the count reaches 0
+	outb(IO_TIMER_CMD, 0xB0);
+	outb(IO_TIMER_CH2, count & 0xFF);
+	outb(IO_TIMER_CH2, count >> 8);
+
+	start = read_cycle_counter();
+	while (!(inb(IO_SPEAKER) & 0x20))
+		/* do nothing */;
+	tsc_khz = (uint32_t) ((read_cycle_counter() - start) >> 4) / 10 * 16;
+}
+
+
+
+/*****************************************************************************
+ * timer_init
+ *
+ *   Program channel 0 of the 8253 interval timer to interrupt on IRQ_TIMER
+ *   'hz' times a second.
+ *
+ *****************************************************************************/
+
+#define IO_TIMER_CH0	0x40		// 8253 channel 0 counter
+
+void
+timer_init(int hz)
+{
+	uint32_t count = (TIMER_FREQ + hz / 2) / hz;
+
+	// channel 0, low byte then high byte, mode 2 (rate generator)
+	outb(IO_TIMER_CMD, 0x34);
+	outb(IO_TIMER_CH0, count & 0xFF);
+	outb(IO_TIMER_CH0, count >> 8);
+	irq_enable(IRQ_TIMER);
 }
 
 
@@ -126,6 +553,9 @@ void
 special_registers_init(process_t *proc)
 {
 	memset(&proc->p_registers, 0, sizeof(registers_t));
+	// Applications run with interrupts enabled, so hardware interrupts
+	// (the timer, say) reach the kernel while they run.
+	proc->p_registers.reg_eflags = EFLAGS_IF;
 	proc->p_registers.reg_cs = SEGSEL_APP_CODE | 3;
 	proc->p_registers.reg_ds = SEGSEL_APP_DATA | 3;
 	proc->p_registers.reg_es = SEGSEL_APP_DATA | 3;
@@ -159,9 +589,89 @@ console_clear(void)
 
 
 /*****************************************************************************
- * console_read_digit
+ * idle, halt, log_write, shutdown
+ *
+ *   idle() waits for the next hardware interrupt without spinning: it
+ *   enables interrupts and halts the processor in one step (an interrupt
+ *   that arrives just after 'sti' is still delivered after 'hlt' starts),
+ *   then disables interrupts again once the handler has returned.
+ *
+ *   halt() stops the processor for good, with interrupts disabled.  It is
+ *   how the kernel stops on a fault, too, so it writes out the profile
+ *   first (see k-profile.c).
+ *
+ *   log_write(s, n) writes raw bytes to the parallel port, which QEMU saves
+ *   in log.txt.
  *
- *   Read a single digit from the keyboard and return it.
+ *   shutdown() writes out the profile and copies the screen to the parallel
+ *   port, which QEMU saves in log.txt, then asks the emulator to power
+ *   off.  If that doesn't work it halts.
+ *
+ *****************************************************************************/
+
+void
+idle(void)
+{
+	asm volatile("sti; hlt; cli" : : : "memory");
+}
+
+void
+halt(void)
+{
+	profile_dump();
+	while (1)
+		asm volatile("cli; hlt");
+}
+
+#define IO_LPT		0x378
+
+static void
+parallel_port_putc(int c)
+{
+	int i;
+	for (i = 0; i < 12800 && !(inb(IO_LPT + 1) & 0x80); i++)
+		/* wait for the printer to be ready */;
+	outb(IO_LPT, c);
+	outb(IO_LPT + 2, 0x0D);
+	outb(IO_LPT + 2, 0x08);
+}
+
+// Write 'n' bytes from 's' to the parallel port, so QEMU saves them in
+// log.txt.
+void
+log_write(const char *s, size_t n)
+{
+	while (n-- > 0)
+		parallel_port_putc(*s++);
+}
+
+void
+shutdown(void)
+{
+	int row, col, len;
+
+	profile_dump();
+	for (row = 0; row < 25; row++) {
+		const uint16_t *line = CONSOLE_BEGIN + row * 80;
+		for (len = 80; len > 0 && (line[len - 1] & 0xFF) == ' '; len--)
+			/* trim trailing spaces */;
+		for (col = 0; col < len; col++)
+			parallel_port_putc(line[col] & 0xFF);
+		parallel_port_putc('\n');
+	}
+
+	outw(0x604, 0x2000);		// QEMU (ICH9 and newer PIIX4 ACPI)
+	outw(0xB004, 0x2000);		// Bochs and older QEMU
+	halt();
+}
+
+
+
+/*****************************************************************************
+ * console_read_key
+ *
+ *   Read a digit or a letter from the keyboard and return it, as a
+ *   lowercase ASCII character, or return -1 if no such key was pressed.
  *
  *****************************************************************************/
 
@@ -169,8 +679,12 @@ console_clear(void)
 #define KBS_DIB 0x01
 #define KBDATAP 0x60
 
+// Scan codes 0x10-0x32: the three rows of letters.
+static const char letter_keys[] =
+	"qwertyuiop\0\0\0\0asdfghjkl\0\0\0\0\0zxcvbnm";
+
 int
-console_read_digit(void)
+console_read_key(void)
 {
 	uint8_t data;
 
@@ -179,17 +693,19 @@ console_read_digit(void)
 
 	data = inb(KBDATAP);
 	if (data >= 0x02 && data <= 0x0A)
-		return data - 0x02 + 1;
+		return '1' + data - 0x02;
 	else if (data == 0x0B)
-		return 0;
+		return '0';
+	else if (data >= 0x10 && data <= 0x32 && letter_keys[data - 0x10])
+		return letter_keys[data - 0x10];
 	else if (data >= 0x47 && data <= 0x49)
-		return data - 0x47 + 7;
+		return '7' + data - 0x47;
 	else if (data >= 0x4B && data <= 0x4D)
-		return data - 0x4B + 4;
+		return '4' + data - 0x4B;
 	else if (data >= 0x4F && data <= 0x51)
-		return data - 0x4F + 1;
+		return '1' + data - 0x4F;
 	else if (data == 0x53)
-		return 0;
+		return '0';
 	else
 		return -1;
 }
@@ -201,15 +717,27 @@ console_read_digit(void)
  *   Run the process with the supplied process descriptor.
  *   This means reloading all the relevant registers from the descriptor's
  *   p_registers member, using the 'popal', 'popl', and 'iret'
- *   instructions.
+ *   instructions.  It also releases the kernel lock, if this CPU holds it.
  *
  *****************************************************************************/
 
 void
 run(process_t *proc)
 {
+	cpu_t *c = this_cpu();
+
 	current = proc;
 
+	// Flush this CPU's TLB if another CPU has changed a mapping since
+	// the last flush (see page_map).
+	if (c->c_tlbgen != tlb_generation) {
+		c->c_tlbgen = tlb_generation;
+		tlbflush();
+	}
+
+	if (c->c_locked)
+		kernel_unlock();
+
 	asm volatile("movl %0,%%esp\n\t"
 		     "popal\n\t"
 		     "popl %%es\n\t"
@@ -275,12 +275,22 @@ rcr0(void)
 	return val;
 }
 
+#ifdef WEENSYOS_HOSTSIM
+// The host simulator (build/hostsim-x86.c) runs the kernel on host stacks
+// and takes no page faults, so it supplies %esp and %cr2 itself.
+extern uint32_t hostsim_esp, hostsim_cr2;
+#endif
+
 static inline uint32_t
 rcr2(void)
 {
+#ifndef WEENSYOS_HOSTSIM
 	uint32_t val;
 	asm volatile("movl %%cr2,%0" : "=r" (val));
 	return val;
+#else
+	return hostsim_cr2;
+#endif
 }
 
 static inline void
@@ -344,9 +354,13 @@ read_ebp(void)
 static inline uint32_t
 read_esp(void)
 {
+#ifndef WEENSYOS_HOSTSIM
         uint32_t esp;
         asm volatile("movl %%esp,%0" : "=r" (esp));
         return esp;
+#else
+        return hostsim_esp;
+#endif
 }
 
 static inline void
@@ -528,4 +542,33 @@ typedef struct segmentdescriptor {
 #define STS_IG32	0xE	    // 32-bit Interrupt Gate
 #define STS_TG32	0xF	    // 32-bit Trap Gate
 
+// Paging: a page directory holds NPDENTRIES entries, each pointing to a
+// page table of NPTENTRIES page table entries (PTEs), each mapping PAGESIZE
+// bytes.  A page table therefore maps PTSIZE bytes.
+#define PAGESIZE	4096
+#define NPDENTRIES	1024
+#define NPTENTRIES	1024
+#define PTSIZE		(PAGESIZE * NPTENTRIES)
+#define PDX(va)		(((uintptr_t) (va) >> 22) & 0x3FF)
+#define PTX(va)		(((uintptr_t) (va) >> 12) & 0x3FF)
+#define PTE_ADDR(pte)	((physaddr_t) (pte) & ~0xFFF)
+
+// Page table/directory entry flags
+#define PTE_P		0x001	// Present
+#define PTE_W		0x002	// Writeable
+#define PTE_U		0x004	// User
+#define PTE_PWT		0x008	// Write-Through
+#define PTE_PCD		0x010	// Cache-Disable
+#define PTE_A		0x020	// Accessed
+#define PTE_D		0x040	// Dirty
+#define PTE_PS		0x080	// Page Size
+
+// Page fault error code bits
+#define PFERR_PRESENT	0x1	// fault was a protection violation
+#define PFERR_WRITE	0x2	// fault was caused by a write
+#define PFERR_USER	0x4	// fault happened in user mode
+
+// Processor exceptions
+#define INT_PAGEFAULT	14
+
 #endif /* !WEENSYOS_X86_H */